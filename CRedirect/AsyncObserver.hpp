@@ -0,0 +1,104 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CREDIRECT_ASYNC_OBSERVER_HPP__
+#define __CREDIRECT_ASYNC_OBSERVER_HPP__
+
+#include <CRedirect_config.h>
+#include <LineObserver.hpp>
+#include <RedirectOptions.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+
+/**
+ * @struct AsyncObserverStats
+ * @brief Counters describing how far an AsyncObserver lags behind its stream.
+ */
+struct AsyncObserverStats {
+    std::uint64_t enqueued = 0;     /**< Lines accepted into the queue. */
+    std::uint64_t delivered = 0;    /**< Lines handed to the wrapped observer. */
+    std::uint64_t dropped = 0;      /**< Lines discarded by the overflow policy. */
+    std::size_t pending = 0;        /**< Lines queued or being delivered right now. */
+    std::size_t maxPending = 0;     /**< Largest number of pending lines seen. */
+};
+
+/**
+ * @class AsyncObserver
+ * @brief Runs a LineObserver on its own worker thread behind a bounded queue.
+ *
+ * Attach the AsyncObserver instead of the wrapped observer to isolate a slow sink: the
+ * monitor thread only copies each batch into the queue, and the worker delivers queued
+ * lines to the wrapped observer in batches. What happens when the queue is full is
+ * decided per observer by its OverflowPolicy.
+ *
+ * Detach the AsyncObserver from every stream before destroying it. The destructor
+ * delivers whatever is still queued before it returns.
+ */
+class AsyncObserver final : public LineObserver {
+public:
+    /**
+     * @brief Starts the worker thread for an observer.
+     *
+     * @param observer The observer to run asynchronously, it must outlive the AsyncObserver.
+     * @param capacity Number of lines the queue holds before the overflow policy applies.
+     * @param overflow What to do with a line when the queue is full.
+     */
+    CREDIRECT_EXPORT
+    explicit AsyncObserver(LineObserver* observer,
+                           std::size_t capacity = LIB_CREDIRECT_ASYNC_QUEUE_SIZE,
+                           OverflowPolicy overflow = OverflowPolicy::Block);
+
+    /**
+     * @brief Delivers the remaining lines and stops the worker thread.
+     */
+    CREDIRECT_EXPORT
+    ~AsyncObserver();
+
+    CREDIRECT_EXPORT
+    void update(std::string_view line) override;
+
+    /**
+     * @brief Copies the batch into the queue, applying the overflow policy line by line.
+     */
+    CREDIRECT_EXPORT
+    void updateBatch(const std::string_view* lines, std::size_t count) override;
+
+    /**
+     * @brief Returns a snapshot of the lag counters.
+     */
+    CREDIRECT_EXPORT
+    AsyncObserverStats stats() const;
+
+private:
+    AsyncObserver(const AsyncObserver&) = delete;
+    AsyncObserver& operator=(const AsyncObserver&) = delete;
+    AsyncObserver(AsyncObserver&&) = delete;
+    AsyncObserver& operator=(AsyncObserver&&) = delete;
+
+    void deliver();
+
+    struct AsyncObserverPimpl;
+    struct AsyncObserverPimpl* d;
+};
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // __CREDIRECT_ASYNC_OBSERVER_HPP__
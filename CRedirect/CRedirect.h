@@ -20,6 +20,10 @@
 #define __CREDIRECT_H__
 
 #include <CRedirect_config.h>
+#include <AsyncObserver.hpp>
+#include <MessageRouter.hpp>
+#include <MetadataObserver.hpp>
+#include <StreamMerger.hpp>
 
 #ifdef LIB_CREDIRECT_ENABLE_CERR
 #include <CerrRedirect.hpp>
@@ -30,5 +34,15 @@
 #ifdef LIB_CREDIRECT_ENABLE_COUT
 #include <CoutRedirect.hpp>
 #endif
+#ifdef LIB_CREDIRECT_ENABLE_FD
+#include <FdRedirect.hpp>
+#endif
+#ifdef LIB_CREDIRECT_ENABLE_FILE_SINK
+#include <FileSink.hpp>
+#include <MappedSegmentSink.hpp>
+#endif
+#ifdef LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+#include <FlightRecorder.hpp>
+#endif
 
 #endif  // __CREDIRECT_H__
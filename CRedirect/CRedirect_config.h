@@ -0,0 +1,159 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CRedirect_CONFIG_H__
+#define __CRedirect_CONFIG_H__
+
+#define LIB_CREDIRECT_VERSION_MAJOR 0
+#define LIB_CREDIRECT_VERSION_MINOR 1
+#define LIB_CREDIRECT_VERSION_PATCH 0
+#define LIB_CREDIRECT_VERSION ((LIB_CREDIRECT_VERSION_MAJOR)<<24) | \
+                              ((LIB_CREDIRECT_VERSION_MINOR)<<16) | \
+                              ((LIB_CREDIRECT_VERSION_PATCH)<<8) 
+
+#define LIB_CREDIRECT_ENABLE_CERR
+#define LIB_CREDIRECT_ENABLE_CLOG
+#define LIB_CREDIRECT_ENABLE_COUT
+#define LIB_CREDIRECT_ENABLE_FD
+/* #undef LIB_CREDIRECT_ENABLE_FILE_SINK */
+#define LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+/* #undef LIB_CREDIRECT_AUTOSTART_CERR */
+/* #undef LIB_CREDIRECT_AUTOSTART_CLOG */
+/* #undef LIB_CREDIRECT_AUTOSTART_COUT */
+#define LIB_CREDIRECT_ENABLE_SIMD
+#define LIB_CREDIRECT_CAPTURE_TSC
+/* #undef LIB_CREDIRECT_NAMESPACE */
+#define LIB_CREDIRECT_INITIAL_BUFFER_SIZE 1024
+#define LIB_CREDIRECT_RING_BUFFER_SIZE 65536
+#define LIB_CREDIRECT_BUFFER_ENGINE Mutex
+#define LIB_CREDIRECT_WAKEUP_POLICY Newline
+#define LIB_CREDIRECT_WAKEUP_HIGH_WATER_MARK 16384
+#define LIB_CREDIRECT_WAKEUP_DELAY_US 1000
+#define LIB_CREDIRECT_ASYNC_QUEUE_SIZE 4096
+#define LIB_CREDIRECT_MERGE_WINDOW_US 5000
+#define LIB_CREDIRECT_MERGE_CAPACITY 4096
+#define LIB_CREDIRECT_DISPATCH_MODE Thread
+#define LIB_CREDIRECT_DISPATCHER_THREADS 1
+/* #undef LIB_CREDIRECT_THREAD_STAGING */
+/* #undef LIB_CREDIRECT_MAX_BUFFER_SIZE */
+#define LIB_CREDIRECT_OVERFLOW_POLICY Block
+/* #undef LIB_CREDIRECT_BLOCK_TIMEOUT_MS */
+#define LIB_CREDIRECT_FILE_SINK_BATCH_SIZE 1048576
+#define LIB_CREDIRECT_FILE_SINK_FLUSH_INTERVAL_MS 100
+/* #undef LIB_CREDIRECT_FLIGHT_RECORDER_SIZE */
+#define LIB_CREDIRECT_MAPPED_SEGMENT_SIZE 67108864
+
+#ifndef LIB_CREDIRECT_INITIAL_BUFFER_SIZE
+# define LIB_CREDIRECT_INITIAL_BUFFER_SIZE 1024
+#endif
+
+#ifndef LIB_CREDIRECT_RING_BUFFER_SIZE
+# define LIB_CREDIRECT_RING_BUFFER_SIZE 65536
+#endif
+
+#ifndef LIB_CREDIRECT_BUFFER_ENGINE
+# define LIB_CREDIRECT_BUFFER_ENGINE Mutex
+#endif
+#define LIB_CREDIRECT_DEFAULT_BUFFER_ENGINE BufferEngine::LIB_CREDIRECT_BUFFER_ENGINE
+
+#ifndef LIB_CREDIRECT_WAKEUP_POLICY
+# define LIB_CREDIRECT_WAKEUP_POLICY Newline
+#endif
+#define LIB_CREDIRECT_DEFAULT_WAKEUP_POLICY WakeupPolicy::LIB_CREDIRECT_WAKEUP_POLICY
+
+#ifndef LIB_CREDIRECT_WAKEUP_HIGH_WATER_MARK
+# define LIB_CREDIRECT_WAKEUP_HIGH_WATER_MARK 16384
+#endif
+
+#ifndef LIB_CREDIRECT_WAKEUP_DELAY_US
+# define LIB_CREDIRECT_WAKEUP_DELAY_US 1000
+#endif
+
+#ifndef LIB_CREDIRECT_ASYNC_QUEUE_SIZE
+# define LIB_CREDIRECT_ASYNC_QUEUE_SIZE 4096
+#endif
+
+#ifndef LIB_CREDIRECT_MERGE_WINDOW_US
+# define LIB_CREDIRECT_MERGE_WINDOW_US 5000
+#endif
+
+#ifndef LIB_CREDIRECT_MERGE_CAPACITY
+# define LIB_CREDIRECT_MERGE_CAPACITY 4096
+#endif
+
+#ifndef LIB_CREDIRECT_DISPATCH_MODE
+# define LIB_CREDIRECT_DISPATCH_MODE Thread
+#endif
+#define LIB_CREDIRECT_DEFAULT_DISPATCH_MODE DispatchMode::LIB_CREDIRECT_DISPATCH_MODE
+
+#ifndef LIB_CREDIRECT_DISPATCHER_THREADS
+# define LIB_CREDIRECT_DISPATCHER_THREADS 1
+#endif
+
+#ifdef LIB_CREDIRECT_THREAD_STAGING
+# define LIB_CREDIRECT_DEFAULT_THREAD_STAGING true
+#else
+# define LIB_CREDIRECT_DEFAULT_THREAD_STAGING false
+#endif
+
+#ifndef LIB_CREDIRECT_MAX_BUFFER_SIZE
+# define LIB_CREDIRECT_MAX_BUFFER_SIZE 0
+#endif
+
+#ifndef LIB_CREDIRECT_OVERFLOW_POLICY
+# define LIB_CREDIRECT_OVERFLOW_POLICY Block
+#endif
+#define LIB_CREDIRECT_DEFAULT_OVERFLOW_POLICY OverflowPolicy::LIB_CREDIRECT_OVERFLOW_POLICY
+
+#ifndef LIB_CREDIRECT_BLOCK_TIMEOUT_MS
+# define LIB_CREDIRECT_BLOCK_TIMEOUT_MS 0
+#endif
+
+#ifndef LIB_CREDIRECT_FILE_SINK_BATCH_SIZE
+# define LIB_CREDIRECT_FILE_SINK_BATCH_SIZE 1048576
+#endif
+
+#ifndef LIB_CREDIRECT_FILE_SINK_FLUSH_INTERVAL_MS
+# define LIB_CREDIRECT_FILE_SINK_FLUSH_INTERVAL_MS 100
+#endif
+
+#ifndef LIB_CREDIRECT_FLIGHT_RECORDER_SIZE
+# define LIB_CREDIRECT_FLIGHT_RECORDER_SIZE 0
+#endif
+
+#ifndef LIB_CREDIRECT_MAPPED_SEGMENT_SIZE
+# define LIB_CREDIRECT_MAPPED_SEGMENT_SIZE 67108864
+#endif
+
+#include <CRedirect_export.h>
+
+#ifdef __GNUC__
+# define HIDDEN __attribute__((visibility("hidden")))
+#elif MSVC
+# define HIDDEN
+#endif
+
+#ifdef LIB_CREDIRECT_NAMESPACE
+# define LIB_CREDIRECT_NAMESPACE_BEGIN namespace LIB_CREDIRECT_NAMESPACE {
+# define LIB_CREDIRECT_NAMESPACE_END }
+#else
+# define LIB_CREDIRECT_NAMESPACE_BEGIN
+# define LIB_CREDIRECT_NAMESPACE_END
+#endif
+
+#endif  // __CRedirect_CONFIG_H__
@@ -0,0 +1,86 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CREDIRECT_CAPTURE_CLOCK_HPP__
+#define __CREDIRECT_CAPTURE_CLOCK_HPP__
+#include <CRedirect_config.h>
+#include <chrono>
+#include <cstdint>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+
+/**
+ * @class CaptureClock
+ * @brief Cheap monotonic clock used to stamp data when the writers publish it.
+ *
+ * On x86 with an invariant time stamp counter a reading is a single rdtsc, and the ticks
+ * are converted to std::chrono::steady_clock only on the reader side, with a rate that
+ * is calibrated against steady_clock and refined as the process runs. Elsewhere, and
+ * with LIB_CREDIRECT_CAPTURE_TSC turned off, the ticks are steady_clock nanoseconds.
+ *
+ * It also hands out the global sequence numbers that order publishes across all
+ * redirected streams of the process.
+ */
+class HIDDEN CaptureClock {
+public:
+    /**
+     * @brief Converts ticks to steady_clock time points with one calibration snapshot.
+     */
+    class Conversion {
+    public:
+        /**
+         * @brief Returns the steady_clock time of a reading of now().
+         */
+        std::chrono::steady_clock::time_point toTimePoint(std::uint64_t ticks) const;
+
+    private:
+        friend class CaptureClock;
+        std::uint64_t anchorTicks = 0;
+        std::int64_t anchorNanoseconds = 0;
+        double nanosecondsPerTick = 1.0;
+    };
+
+    /**
+     * @brief Returns the current time in ticks, safe to call from any thread.
+     */
+    static std::uint64_t now();
+
+    /**
+     * @brief Draws the next global sequence number, the first one is 1.
+     */
+    static std::uint64_t nextSequence();
+
+    /**
+     * @brief Returns the last global sequence number drawn so far, 0 if none.
+     */
+    static std::uint64_t lastSequence();
+
+    /**
+     * @brief Returns the current calibration, to convert a batch of readings.
+     *
+     * The first call may wait up to a millisecond for the initial calibration.
+     */
+    static Conversion conversion();
+
+private:
+    CaptureClock() = delete;
+};
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // __CREDIRECT_CAPTURE_CLOCK_HPP__
@@ -22,6 +22,9 @@
 #ifdef LIB_CREDIRECT_ENABLE_CERR
 #include <StreamRedirect.hpp>
 #include <StreamObserver.hpp>
+#include <LineObserver.hpp>
+#include <MetadataObserver.hpp>
+#include <RedirectOptions.hpp>
 #include <string>
 
 LIB_CREDIRECT_NAMESPACE_BEGIN
@@ -42,11 +45,32 @@ public:
      * @brief Constructs a CerrRedirect instance that redirects std::cerr.
      * 
      * This constructor initializes the CerrRedirect instance, setting up the necessary
-     * stream redirection and observer notification mechanisms.
+     * stream redirection and observer notification mechanisms. It uses defaultOptions().
      */
     CREDIRECT_EXPORT
     CerrRedirect();
 
+    /**
+     * @brief Constructs a CerrRedirect instance with explicit redirect options.
+     * 
+     * The options only take effect for the first instance, later instances share the
+     * already running redirection of std::cerr.
+     * 
+     * @param options Buffer engine and sizes used for the redirected stream.
+     */
+    CREDIRECT_EXPORT
+    explicit CerrRedirect(const RedirectOptions& options);
+
+    /**
+     * @brief Constructs a CerrRedirect instance with the default options and the given dispatch mode.
+     * 
+     * For example CerrRedirect(DispatchMode::Inline) delivers lines on the writing thread.
+     * 
+     * @param mode Dispatch mode used for the redirected stream.
+     */
+    CREDIRECT_EXPORT
+    explicit CerrRedirect(DispatchMode mode);
+
     /**
      * @brief Destroys the CerrRedirect instance and restores std::cerr.
      * 
@@ -77,6 +101,61 @@ public:
     CREDIRECT_EXPORT
     static void detach(StreamObserver* observer);
 
+    /**
+     * @brief Attaches a zero-copy observer to the CerrRedirect instance.
+     * 
+     * The observer receives views into the stream buffer of std::cerr, one batch of
+     * lines per wakeup of the monitor thread.
+     * 
+     * @param observer Pointer to the LineObserver instance to attach.
+     */
+    CREDIRECT_EXPORT
+    static void attach(LineObserver* observer);
+    
+    /**
+     * @brief Detaches a zero-copy observer from the CerrRedirect instance.
+     * 
+     * @param observer Pointer to the LineObserver instance to detach.
+     */
+    CREDIRECT_EXPORT
+    static void detach(LineObserver* observer);
+
+    /**
+     * @brief Attaches an observer that receives the capture time and sequence number of every line.
+     * 
+     * The capture time is taken when the data is published to the stream buffer of std::cerr,
+     * so the observer can tell how long each line was queued.
+     * 
+     * @param observer Pointer to the MetadataObserver instance to attach.
+     */
+    CREDIRECT_EXPORT
+    static void attach(MetadataObserver* observer);
+    
+    /**
+     * @brief Detaches an observer that receives line metadata.
+     * 
+     * @param observer Pointer to the MetadataObserver instance to detach.
+     */
+    CREDIRECT_EXPORT
+    static void detach(MetadataObserver* observer);
+
+    /**
+     * @brief Returns the data dropped by the overflow policy and the buffer size of std::cerr.
+     * 
+     * @return Counters of the redirected stream.
+     */
+    CREDIRECT_EXPORT
+    static RedirectStats stats();
+
+    /**
+     * @brief Returns the options used by the default constructor.
+     * 
+     * These are the default RedirectOptions except that every write wakes the monitor
+     * thread, since error output is expected to be seen as soon as it is written.
+     */
+    CREDIRECT_EXPORT
+    static RedirectOptions defaultOptions();
+
 private:    
     /**
      * @brief Disables copy and move operations for the CerrRedirect class.
@@ -23,6 +23,9 @@
 #ifdef LIB_CREDIRECT_ENABLE_CERR
 #include <StreamRedirect.hpp>
 #include <StreamObserver.hpp>
+#include <LineObserver.hpp>
+#include <MetadataObserver.hpp>
+#include <RedirectOptions.hpp>
 #include <iostream>
 #include <streambuf>
 #include <string>
@@ -40,6 +43,27 @@ public:
     CREDIRECT_EXPORT
     ClogRedirect();
 
+    /**
+     * @brief Constructs a ClogRedirect instance with explicit redirect options.
+     * 
+     * The options only take effect for the first instance, later instances share the
+     * already running redirection of std::clog.
+     * 
+     * @param options Buffer engine and sizes used for the redirected stream.
+     */
+    CREDIRECT_EXPORT
+    explicit ClogRedirect(const RedirectOptions& options);
+
+    /**
+     * @brief Constructs a ClogRedirect instance with the default options and the given dispatch mode.
+     * 
+     * For example ClogRedirect(DispatchMode::Inline) delivers lines on the writing thread.
+     * 
+     * @param mode Dispatch mode used for the redirected stream.
+     */
+    CREDIRECT_EXPORT
+    explicit ClogRedirect(DispatchMode mode);
+
     /**
      * @brief Destroys the ClogRedirect instance and restores std::clog.
      * 
@@ -71,6 +95,52 @@ public:
     CREDIRECT_EXPORT
     static void detach(StreamObserver* observer);
 
+    /**
+     * @brief Attaches a zero-copy observer to the ClogRedirect instance.
+     * 
+     * The observer receives views into the stream buffer of std::clog, one batch of
+     * lines per wakeup of the monitor thread.
+     * 
+     * @param observer Pointer to the LineObserver instance to attach.
+     */
+    CREDIRECT_EXPORT
+    static void attach(LineObserver* observer);
+    
+    /**
+     * @brief Detaches a zero-copy observer from the ClogRedirect instance.
+     * 
+     * @param observer Pointer to the LineObserver instance to detach.
+     */
+    CREDIRECT_EXPORT
+    static void detach(LineObserver* observer);
+
+    /**
+     * @brief Attaches an observer that receives the capture time and sequence number of every line.
+     * 
+     * The capture time is taken when the data is published to the stream buffer of std::clog,
+     * so the observer can tell how long each line was queued.
+     * 
+     * @param observer Pointer to the MetadataObserver instance to attach.
+     */
+    CREDIRECT_EXPORT
+    static void attach(MetadataObserver* observer);
+    
+    /**
+     * @brief Detaches an observer that receives line metadata.
+     * 
+     * @param observer Pointer to the MetadataObserver instance to detach.
+     */
+    CREDIRECT_EXPORT
+    static void detach(MetadataObserver* observer);
+
+    /**
+     * @brief Returns the data dropped by the overflow policy and the buffer size of std::clog.
+     * 
+     * @return Counters of the redirected stream.
+     */
+    CREDIRECT_EXPORT
+    static RedirectStats stats();
+
 private:
     /**
      * @brief Disables copy and move operations for the ClogRedirect class.
@@ -23,6 +23,9 @@
 #ifdef LIB_CREDIRECT_ENABLE_COUT
 #include <StreamRedirect.hpp>
 #include <StreamObserver.hpp>
+#include <LineObserver.hpp>
+#include <MetadataObserver.hpp>
+#include <RedirectOptions.hpp>
 #include <iostream>
 #include <streambuf>
 #include <string>
@@ -40,6 +43,27 @@ public:
     CREDIRECT_EXPORT
     CoutRedirect();
 
+    /**
+     * @brief Constructs a CoutRedirect instance with explicit redirect options.
+     * 
+     * The options only take effect for the first instance, later instances share the
+     * already running redirection of std::cout.
+     * 
+     * @param options Buffer engine and sizes used for the redirected stream.
+     */
+    CREDIRECT_EXPORT
+    explicit CoutRedirect(const RedirectOptions& options);
+
+    /**
+     * @brief Constructs a CoutRedirect instance with the default options and the given dispatch mode.
+     * 
+     * For example CoutRedirect(DispatchMode::Inline) delivers lines on the writing thread.
+     * 
+     * @param mode Dispatch mode used for the redirected stream.
+     */
+    CREDIRECT_EXPORT
+    explicit CoutRedirect(DispatchMode mode);
+
     /**
      * @brief Destroys the CoutRedirect instance and restores std::cout.
      * 
@@ -71,6 +95,52 @@ public:
     CREDIRECT_EXPORT
     static void detach(StreamObserver* observer);
 
+    /**
+     * @brief Attaches a zero-copy observer to the CoutRedirect instance.
+     * 
+     * The observer receives views into the stream buffer of std::cout, one batch of
+     * lines per wakeup of the monitor thread.
+     * 
+     * @param observer Pointer to the LineObserver instance to attach.
+     */
+    CREDIRECT_EXPORT
+    static void attach(LineObserver* observer);
+    
+    /**
+     * @brief Detaches a zero-copy observer from the CoutRedirect instance.
+     * 
+     * @param observer Pointer to the LineObserver instance to detach.
+     */
+    CREDIRECT_EXPORT
+    static void detach(LineObserver* observer);
+
+    /**
+     * @brief Attaches an observer that receives the capture time and sequence number of every line.
+     * 
+     * The capture time is taken when the data is published to the stream buffer of std::cout,
+     * so the observer can tell how long each line was queued.
+     * 
+     * @param observer Pointer to the MetadataObserver instance to attach.
+     */
+    CREDIRECT_EXPORT
+    static void attach(MetadataObserver* observer);
+    
+    /**
+     * @brief Detaches an observer that receives line metadata.
+     * 
+     * @param observer Pointer to the MetadataObserver instance to detach.
+     */
+    CREDIRECT_EXPORT
+    static void detach(MetadataObserver* observer);
+
+    /**
+     * @brief Returns the data dropped by the overflow policy and the buffer size of std::cout.
+     * 
+     * @return Counters of the redirected stream.
+     */
+    CREDIRECT_EXPORT
+    static RedirectStats stats();
+
 private:
     /**
      * @brief Disables copy and move operations for the CoutRedirect class.
@@ -0,0 +1,110 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CREDIRECT_DISPATCHER_HPP__
+#define __CREDIRECT_DISPATCHER_HPP__
+#include <CRedirect_config.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+
+/**
+ * @class Dispatcher
+ * @brief Pool of threads that runs the readers of many redirected streams.
+ *
+ * A stream is represented by a Task. Writers schedule the task when the wakeup policy asks
+ * for the reader to run, or with a delay when their data may wait. A task is queued at most
+ * once and never runs on two threads at a time, so the lines of a stream keep their order;
+ * a task scheduled while it runs is run again once it returns.
+ */
+class HIDDEN Dispatcher {
+public:
+    /**
+     * @class Task
+     * @brief Work item of one stream, runs its reader without blocking.
+     */
+    class Task {
+    public:
+        explicit Task(std::function<void()> run) : run(std::move(run)) {}
+
+    private:
+        friend class Dispatcher;
+
+        const std::function<void()> run;
+        std::atomic<bool> scheduled{false};    // queued, or scheduled again while running
+        std::atomic<bool> timed{false};        // a delayed schedule is pending
+        bool running = false;                  // the following are protected by the dispatcher
+        bool rerun = false;
+        bool removed = false;
+    };
+
+    /**
+     * @brief Starts a pool with the given number of threads (at least one).
+     */
+    explicit Dispatcher(std::size_t threads);
+
+    /**
+     * @brief Stops and joins the threads, tasks still queued are not run.
+     */
+    ~Dispatcher();
+
+    /**
+     * @brief Returns the pool shared by all redirected streams, starting it if needed.
+     *
+     * The pool lives as long as a stream holds the returned pointer. The thread count
+     * only applies when the pool is started.
+     */
+    static std::shared_ptr<Dispatcher> shared(std::size_t threads);
+
+    /**
+     * @brief Queues a task to run as soon as a thread is free.
+     */
+    void schedule(Task* task);
+
+    /**
+     * @brief Queues a task to run after a delay, unless it is queued or delayed already.
+     */
+    void schedule(Task* task, std::chrono::microseconds delay);
+
+    /**
+     * @brief Removes a task from the pool, waiting for it to finish if it is running.
+     *
+     * The task is never run again afterwards and may be destroyed.
+     */
+    void remove(Task* task);
+
+private:
+    Dispatcher(const Dispatcher&) = delete;
+    Dispatcher& operator=(const Dispatcher&) = delete;
+    Dispatcher(Dispatcher&&) = delete;
+    Dispatcher& operator=(Dispatcher&&) = delete;
+
+    void enqueue(Task* task);
+    void dispatch();
+
+    struct DispatcherPimpl;
+    struct DispatcherPimpl* d;
+};
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // __CREDIRECT_DISPATCHER_HPP__
@@ -0,0 +1,137 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CREDIRECT_FD_REDIRECT_HPP__
+#define __CREDIRECT_FD_REDIRECT_HPP__
+
+#include <CRedirect_config.h>
+#ifdef LIB_CREDIRECT_ENABLE_FD
+#include <StreamObserver.hpp>
+#include <LineObserver.hpp>
+#include <RedirectOptions.hpp>
+#include <cstddef>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+
+/**
+ * @class FdRedirect
+ * @brief Redirects a file descriptor, such as 1 (stdout) or 2 (stderr), into a pipe and notifies observers.
+ *
+ * Unlike CoutRedirect, which only replaces the stream buffer of std::cout, this captures
+ * everything written to the descriptor: printf, write(2), C libraries and child processes
+ * that inherit it. A pump thread drains the pipe with large reads. In Thread and Inline
+ * dispatch mode it is the monitor thread of the redirect and hands the lines to the
+ * observers straight from its read buffer; in Shared dispatch mode it writes them to a
+ * stream buffer serviced by the dispatcher pool, like the stream redirects.
+ *
+ * When a file sink is given every byte is also written to it; on Linux the bytes are
+ * duplicated with tee(2) and moved with splice(2), without passing through user space.
+ *
+ * Writes of up to PIPE_BUF bytes are atomic, so lines written concurrently by several
+ * threads or processes stay whole as long as each one is written at once.
+ */
+class FdRedirect {
+public:
+    /**
+     * @brief Redirects a file descriptor into a pipe.
+     *
+     * C stdio buffers are flushed first so that earlier output still reaches the original
+     * destination. If the pipe cannot be set up the descriptor is left untouched and
+     * active() returns false.
+     *
+     * @param fd The file descriptor to capture, for example 1 for stdout.
+     * @param options Buffer engine, sizes and dispatch mode used for the captured output.
+     * @param fileSink Descriptor of a file that also receives everything captured, -1 for none.
+     *                 It must stay open until the FdRedirect is destroyed.
+     */
+    CREDIRECT_EXPORT
+    explicit FdRedirect(int fd, const RedirectOptions& options = RedirectOptions(), int fileSink = -1);
+
+    /**
+     * @brief Restores the file descriptor and delivers what was captured before.
+     *
+     * Processes that still hold the write end of the pipe, such as children that outlive
+     * the FdRedirect, get EPIPE on their next write.
+     */
+    CREDIRECT_EXPORT
+    ~FdRedirect();
+
+    /**
+     * @brief Returns true if the file descriptor is being captured.
+     */
+    CREDIRECT_EXPORT
+    bool active() const;
+
+    /**
+     * @brief Attaches an observer that receives every captured line.
+     *
+     * @param observer Pointer to the StreamObserver instance to attach.
+     */
+    CREDIRECT_EXPORT
+    void attach(StreamObserver* observer);
+
+    /**
+     * @brief Detaches an observer.
+     *
+     * @param observer Pointer to the StreamObserver instance to detach.
+     */
+    CREDIRECT_EXPORT
+    void detach(StreamObserver* observer);
+
+    /**
+     * @brief Attaches a zero-copy observer that receives every captured line.
+     *
+     * @param observer Pointer to the LineObserver instance to attach.
+     */
+    CREDIRECT_EXPORT
+    void attach(LineObserver* observer);
+
+    /**
+     * @brief Detaches a zero-copy observer.
+     *
+     * @param observer Pointer to the LineObserver instance to detach.
+     */
+    CREDIRECT_EXPORT
+    void detach(LineObserver* observer);
+
+    /**
+     * @brief Returns the data dropped by the overflow policy and the buffer size.
+     *
+     * @return Counters of the captured output, all zero unless the dispatch mode is Shared
+     *         since the pipe itself is the buffer otherwise.
+     */
+    CREDIRECT_EXPORT
+    RedirectStats stats() const;
+
+private:
+    FdRedirect(const FdRedirect&) = delete;
+    FdRedirect& operator=(const FdRedirect&) = delete;
+    FdRedirect(FdRedirect&&) = delete;
+    FdRedirect& operator=(FdRedirect&&) = delete;
+
+    void pump();
+    bool transfer(char* data, std::size_t capacity, std::size_t& size);
+
+    struct FdRedirectPimpl;
+    struct FdRedirectPimpl* d;
+};
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // LIB_CREDIRECT_ENABLE_FD
+#endif // __CREDIRECT_FD_REDIRECT_HPP__
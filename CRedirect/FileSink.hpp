@@ -0,0 +1,220 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CREDIRECT_FILE_SINK_HPP__
+#define __CREDIRECT_FILE_SINK_HPP__
+
+#include <CRedirect_config.h>
+#ifdef LIB_CREDIRECT_ENABLE_FILE_SINK
+#include <LineObserver.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+
+/**
+ * @enum SyncPolicy
+ * @brief Decides when a FileSink forces written data to the disk with fdatasync(2).
+ */
+enum class SyncPolicy {
+    None,       /**< Never sync, leave it to the operating system. */
+    Interval,   /**< Sync after a batch once the sync interval has passed since the last sync. */
+    EveryBatch  /**< Sync after every batch, the writer thread waits for the disk. */
+};
+
+/**
+ * @struct FileSinkOptions
+ * @brief Construction time settings for a FileSink.
+ *
+ * The defaults of the sizes and the flush interval are taken from the CMake configuration.
+ */
+struct FileSinkOptions {
+    /**
+     * @brief Amount of pending data in bytes that wakes the writer thread before the flush interval.
+     */
+    std::size_t batchSize = LIB_CREDIRECT_FILE_SINK_BATCH_SIZE;
+
+    /**
+     * @brief Longest time a line waits before the writer thread writes it.
+     */
+    std::chrono::milliseconds flushInterval = std::chrono::milliseconds(LIB_CREDIRECT_FILE_SINK_FLUSH_INTERVAL_MS);
+
+    /**
+     * @brief When written data is synced to the disk.
+     */
+    SyncPolicy sync = SyncPolicy::None;
+
+    /**
+     * @brief Shortest time between two syncs with the Interval policy.
+     */
+    std::chrono::milliseconds syncInterval = std::chrono::milliseconds(1000);
+
+    /**
+     * @brief Largest amount of pending data in bytes, lines beyond it are dropped, 0 for no limit.
+     */
+    std::size_t maxPending = 0;
+
+    /**
+     * @brief Appended to every line.
+     */
+    std::string lineEnding = "\n";
+
+    /**
+     * @brief Size in bytes after which the file is rotated, 0 for no size based rotation.
+     */
+    std::uint64_t rotateSize = 0;
+
+    /**
+     * @brief Age after which a non-empty file is rotated, 0 for no time based rotation.
+     */
+    std::chrono::seconds rotateInterval = std::chrono::seconds(0);
+
+    /**
+     * @brief Whether the next file reserves rotateSize bytes of disk space when it is created (Linux only).
+     */
+    bool preallocate = false;
+
+    /**
+     * @brief Number of rotated segments kept, older ones are deleted, 0 to keep all of them.
+     */
+    std::size_t maxSegments = 0;
+
+    /**
+     * @brief Called on the housekeeping thread with the name of every rotated segment once it is closed.
+     *
+     * Use it to compress or ship the segment. It runs before old segments are deleted, and
+     * deletion only removes the segment under the name passed here.
+     */
+    std::function<void(const std::string&)> onSegment;
+};
+
+/**
+ * @struct FileSinkStats
+ * @brief Counters of a FileSink.
+ */
+struct FileSinkStats {
+    std::uint64_t bytesWritten = 0;     /**< Bytes written to the file. */
+    std::uint64_t batches = 0;          /**< Batches written, each with a single writev(2) unless it was short. */
+    std::uint64_t syncs = 0;            /**< Calls to fdatasync(2). */
+    std::uint64_t droppedLines = 0;     /**< Lines discarded because maxPending was reached. */
+    std::uint64_t errors = 0;           /**< Batches that could not be written completely. */
+    std::uint64_t rotations = 0;        /**< Files rotated or reopened. */
+    std::size_t pending = 0;            /**< Bytes waiting for the writer thread. */
+};
+
+/**
+ * @class FileSink
+ * @brief Line observer that appends lines to a file from a writer thread, in large batches.
+ *
+ * Lines are copied into a list of fixed size blocks under a short lock, so a producer
+ * never waits for the disk. The writer thread swaps the list for an empty one and writes
+ * all of its blocks with one writev(2), when batchSize bytes are pending, when the flush
+ * interval has passed, or when flush() is called. Written blocks are reused.
+ *
+ * The file can be rotated by size, by age or on request. The next file is opened, and
+ * optionally preallocated, ahead of time on a housekeeping thread, which also closes,
+ * reports and deletes old segments. The writer thread only renames the current file to
+ * "<path>.<date>-<time>.<n>", renames the prepared file to the path, and carries on with its
+ * descriptor. When the prepared file is not ready yet the writer keeps to the current file.
+ *
+ * Detach the FileSink from every stream before destroying it. The destructor writes and
+ * syncs whatever is still pending.
+ */
+class FileSink final : public LineObserver {
+public:
+    /**
+     * @brief Opens a file for appending and starts the writer thread.
+     *
+     * If the file cannot be opened active() returns false and lines are discarded.
+     *
+     * @param path File to append to, created if it does not exist.
+     * @param options Batch size, flush interval, sync policy and line ending.
+     */
+    CREDIRECT_EXPORT
+    explicit FileSink(const std::string& path, const FileSinkOptions& options = FileSinkOptions());
+
+    /**
+     * @brief Writes the pending lines, syncs the file unless the policy is None, and closes it.
+     */
+    CREDIRECT_EXPORT
+    ~FileSink();
+
+    /**
+     * @brief Returns true if the file is open.
+     */
+    CREDIRECT_EXPORT
+    bool active() const;
+
+    CREDIRECT_EXPORT
+    void update(std::string_view line) override;
+
+    /**
+     * @brief Copies the batch into the pending blocks, waking the writer thread on batchSize.
+     */
+    CREDIRECT_EXPORT
+    void updateBatch(const std::string_view* lines, std::size_t count) override;
+
+    /**
+     * @brief Waits until every line passed so far has been written to the file.
+     */
+    CREDIRECT_EXPORT
+    void flush();
+
+    /**
+     * @brief Asks for the file to be rotated after the next batch, if it is not empty.
+     */
+    CREDIRECT_EXPORT
+    void rotate();
+
+    /**
+     * @brief Switches to another file, opened for appending in the background.
+     *
+     * Lines keep going to the current file until the new one is open. Later rotations
+     * rotate the new file. If it cannot be opened the current file is kept.
+     *
+     * @param path File to append to from now on.
+     */
+    CREDIRECT_EXPORT
+    void reopen(const std::string& path);
+
+    /**
+     * @brief Returns a snapshot of the counters.
+     */
+    CREDIRECT_EXPORT
+    FileSinkStats stats() const;
+
+private:
+    FileSink(const FileSink&) = delete;
+    FileSink& operator=(const FileSink&) = delete;
+    FileSink(FileSink&&) = delete;
+    FileSink& operator=(FileSink&&) = delete;
+
+    void write();
+
+    struct FileSinkPimpl;
+    struct FileSinkPimpl* d;
+};
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // LIB_CREDIRECT_ENABLE_FILE_SINK
+#endif // __CREDIRECT_FILE_SINK_HPP__
@@ -0,0 +1,137 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CREDIRECT_FLIGHT_RECORDER_HPP__
+#define __CREDIRECT_FLIGHT_RECORDER_HPP__
+
+#include <CRedirect_config.h>
+#ifdef LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+#include <LineObserver.hpp>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+
+/**
+ * @class FlightRecorder
+ * @brief Keeps the most recent lines in a preallocated ring to dump them after a crash.
+ *
+ * Recording a batch of lines takes one atomic reservation and a memcpy per line, and never
+ * allocates. Older lines are overwritten as the ring wraps around. Every FlightRecorder is
+ * registered so that dump() and the crash handlers set up by install() write all of them,
+ * oldest line first, using async-signal-safe calls only.
+ *
+ * A redirected stream keeps a FlightRecorder of its own when RedirectOptions::flightRecorderSize
+ * is set; one can also be attached to any stream as a LineObserver. A line that is being
+ * recorded when the process crashes may be dumped partly written.
+ */
+class FlightRecorder final : public LineObserver {
+public:
+    /**
+     * @brief Allocates the ring and registers it for dumping.
+     *
+     * Only a limited number of recorders can be registered at once, active() returns false
+     * for one that could not be, its lines are still recorded but not dumped.
+     *
+     * @param name Written before the lines of this recorder in a dump, up to 63 characters.
+     * @param capacity Size of the ring in bytes, rounded up to a power of two.
+     */
+    CREDIRECT_EXPORT
+    FlightRecorder(const std::string& name, std::size_t capacity);
+
+    /**
+     * @brief Unregisters the recorder and frees the ring.
+     *
+     * If a dump is running, the ring is freed only after the dump has finished.
+     */
+    CREDIRECT_EXPORT
+    ~FlightRecorder();
+
+    /**
+     * @brief Returns true if the recorder is included in dumps.
+     */
+    CREDIRECT_EXPORT
+    bool active() const;
+
+    CREDIRECT_EXPORT
+    void update(std::string_view line) override;
+
+    /**
+     * @brief Copies the batch into the ring with a single reservation, each line followed by a newline.
+     */
+    CREDIRECT_EXPORT
+    void updateBatch(const std::string_view* lines, std::size_t count) override;
+
+    /**
+     * @brief Writes the lines of every registered recorder to a file descriptor.
+     *
+     * Only async-signal-safe calls are used, so it may be called from a signal handler.
+     *
+     * @param fd Open file descriptor to write to.
+     */
+    CREDIRECT_EXPORT
+    static void dump(int fd);
+
+    /**
+     * @brief Dumps every recorder to fd when the process dies from a fatal signal or std::terminate.
+     *
+     * Handlers are installed for SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT, running on an
+     * alternate signal stack where the crashing thread has one. Alternate stacks are per
+     * thread: install() sets one up for the calling thread, the threads of the library set up
+     * their own when they start, and other threads call installAlternateStack(). The dump is
+     * written once, then the previous handler runs, so the process still terminates the way
+     * it would have. The descriptor is not closed by the library.
+     *
+     * @param fd File descriptor opened beforehand, for example a log file or stderr.
+     * @return false if a handler could not be installed.
+     */
+    CREDIRECT_EXPORT
+    static bool install(int fd);
+
+    /**
+     * @brief Gives the calling thread an alternate signal stack, unless it already has one.
+     *
+     * Without one, a stack overflow on the thread cannot be dumped because the signal handler
+     * has no stack to run on. The stack is released when the thread exits.
+     *
+     * @return false if the stack could not be set up.
+     */
+    CREDIRECT_EXPORT
+    static bool installAlternateStack();
+
+    /**
+     * @brief Restores the signal handlers and the terminate handler replaced by install().
+     */
+    CREDIRECT_EXPORT
+    static void uninstall();
+
+private:
+    FlightRecorder(const FlightRecorder&) = delete;
+    FlightRecorder& operator=(const FlightRecorder&) = delete;
+    FlightRecorder(FlightRecorder&&) = delete;
+    FlightRecorder& operator=(FlightRecorder&&) = delete;
+
+    struct FlightRecorderPimpl;
+    struct FlightRecorderPimpl* d;
+};
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+#endif // __CREDIRECT_FLIGHT_RECORDER_HPP__
@@ -0,0 +1,65 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CREDIRECT_LINE_OBSERVER_HPP__
+#define __CREDIRECT_LINE_OBSERVER_HPP__
+
+#include <CRedirect_config.h>
+#include <cstddef>
+#include <string_view>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+
+/**
+ * @class LineObserver
+ * @brief Observer that receives lines as views into the stream buffer, without copies.
+ *
+ * The views passed to update() and updateBatch() point directly into the buffer of the
+ * redirected stream and are only valid for the duration of the call. An observer that
+ * needs a line afterwards must copy it.
+ */
+class LineObserver {
+public:
+    virtual ~LineObserver() = default;
+
+    /**
+     * @brief Called for every complete line written to the redirected stream.
+     *
+     * @param line The line without its trailing newline, valid only during the call.
+     */
+    virtual void update(std::string_view line) = 0;
+
+    /**
+     * @brief Called once per wakeup of the monitor thread with every complete line it read.
+     *
+     * The default implementation calls update() for each line. Override it to amortize
+     * per-call work such as locking or system calls over the whole batch.
+     *
+     * @param lines Pointer to the first line of the batch, valid only during the call.
+     * @param count Number of lines in the batch.
+     */
+    virtual void updateBatch(const std::string_view* lines, std::size_t count) {
+        for(std::size_t i = 0; i < count; ++i) {
+            update(lines[i]);
+        }
+    }
+};
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // __CREDIRECT_LINE_OBSERVER_HPP__
@@ -0,0 +1,58 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CREDIRECT_LINE_SPLITTER_HPP__
+#define __CREDIRECT_LINE_SPLITTER_HPP__
+#include <CRedirect_config.h>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+
+/**
+ * @class LineSplitter
+ * @brief Splits raw stream data into lines with a vectorized newline search.
+ *
+ * On x86 the search compares 32 (AVX2) or 16 (SSE2) bytes at a time and emits every
+ * newline found in a block before loading the next one. The implementation is selected
+ * once at runtime from the features of the CPU; other architectures, and builds with
+ * LIB_CREDIRECT_ENABLE_SIMD turned off, use a scalar search.
+ */
+class HIDDEN LineSplitter {
+public:
+    /**
+     * @brief Appends every complete line of a region to `lines`.
+     *
+     * @param data Start of the region, which must begin at the start of a line.
+     * @param size Size of the region in bytes.
+     * @param scanned Leading bytes of the region already known to hold no newline.
+     * @param lines Receives views of the complete lines, without their newlines.
+     * @return The number of bytes covered by the complete lines, the partial
+     *         trailing line starts at this offset.
+     */
+    static std::size_t split(const char* data, std::size_t size, std::size_t scanned,
+                             std::vector<std::string_view>& lines);
+
+private:
+    LineSplitter() = delete;
+};
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // __CREDIRECT_LINE_SPLITTER_HPP__
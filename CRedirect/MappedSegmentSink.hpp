@@ -0,0 +1,142 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CREDIRECT_MAPPED_SEGMENT_SINK_HPP__
+#define __CREDIRECT_MAPPED_SEGMENT_SINK_HPP__
+
+#include <CRedirect_config.h>
+#ifdef LIB_CREDIRECT_ENABLE_FILE_SINK
+#include <LineObserver.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+
+/**
+ * @struct MappedSegmentOptions
+ * @brief Construction time settings for a MappedSegmentSink.
+ */
+struct MappedSegmentOptions {
+    /**
+     * @brief Size in bytes of every segment file, a line longer than this is dropped.
+     */
+    std::size_t segmentSize = LIB_CREDIRECT_MAPPED_SEGMENT_SIZE;
+
+    /**
+     * @brief How often the background thread starts writeback of the committed data.
+     */
+    std::chrono::milliseconds writebackInterval = std::chrono::milliseconds(100);
+
+    /**
+     * @brief Whether a full segment is synced to the disk before it is closed.
+     */
+    bool syncOnRollover = false;
+
+    /**
+     * @brief Appended to every line.
+     */
+    std::string lineEnding = "\n";
+};
+
+/**
+ * @struct MappedSegmentStats
+ * @brief Counters of a MappedSegmentSink.
+ */
+struct MappedSegmentStats {
+    std::uint64_t bytesCommitted = 0;   /**< Bytes copied into all segments. */
+    std::uint64_t segments = 0;         /**< Segment files used so far, including the current one. */
+    std::uint64_t droppedLines = 0;     /**< Lines discarded because they were too long or no segment could be created. */
+};
+
+/**
+ * @class MappedSegmentSink
+ * @brief Line observer that copies lines into memory mapped, preallocated segment files.
+ *
+ * Segments are named "<path>.000001", "<path>.000002" and so on, starting after the last
+ * one that exists. Each is allocated at its full size and mapped before it is used, so
+ * appending a batch costs an atomic reservation, a memcpy and an atomic commit, without
+ * any system call. Writers never wait for each other, except at the end of a segment.
+ *
+ * The data lives in the page cache as soon as it is copied, so it survives a crash of the
+ * process. A background thread starts writeback of the committed data, closes full
+ * segments, truncating them to their committed length, and maps the next segment ahead of
+ * time. After a crash the current segment keeps its full size and its data ends at the
+ * first NUL byte.
+ *
+ * Detach the MappedSegmentSink from every stream before destroying it.
+ */
+class MappedSegmentSink final : public LineObserver {
+public:
+    /**
+     * @brief Creates and maps the first segment and starts the background thread.
+     *
+     * If the segment cannot be created active() returns false and lines are discarded.
+     *
+     * @param path Name of the segments, without the index.
+     * @param options Segment size, writeback interval and line ending.
+     */
+    CREDIRECT_EXPORT
+    explicit MappedSegmentSink(const std::string& path, const MappedSegmentOptions& options = MappedSegmentOptions());
+
+    /**
+     * @brief Stops the background thread and truncates the current segment to its committed length.
+     */
+    CREDIRECT_EXPORT
+    ~MappedSegmentSink();
+
+    /**
+     * @brief Returns true if lines are being stored.
+     */
+    CREDIRECT_EXPORT
+    bool active() const;
+
+    CREDIRECT_EXPORT
+    void update(std::string_view line) override;
+
+    /**
+     * @brief Copies the batch into the current segment with a single reservation.
+     */
+    CREDIRECT_EXPORT
+    void updateBatch(const std::string_view* lines, std::size_t count) override;
+
+    /**
+     * @brief Returns a snapshot of the counters.
+     */
+    CREDIRECT_EXPORT
+    MappedSegmentStats stats() const;
+
+private:
+    MappedSegmentSink(const MappedSegmentSink&) = delete;
+    MappedSegmentSink& operator=(const MappedSegmentSink&) = delete;
+    MappedSegmentSink(MappedSegmentSink&&) = delete;
+    MappedSegmentSink& operator=(MappedSegmentSink&&) = delete;
+
+    void append(const std::string_view* lines, std::size_t count, std::size_t size);
+    void writeback();
+
+    struct MappedSegmentSinkPimpl;
+    struct MappedSegmentSinkPimpl* d;
+};
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // LIB_CREDIRECT_ENABLE_FILE_SINK
+#endif // __CREDIRECT_MAPPED_SEGMENT_SINK_HPP__
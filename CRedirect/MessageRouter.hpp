@@ -0,0 +1,120 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CREDIRECT_MESSAGE_ROUTER_HPP__
+#define __CREDIRECT_MESSAGE_ROUTER_HPP__
+
+#include <CRedirect_config.h>
+#include <LineObserver.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+
+/**
+ * @class MessageRouter
+ * @brief Delivers messages published once, tagged with a level and destinations, to the observers that subscribed to them.
+ *
+ * A message that is meant for several outputs, such as a log line for the log file and the
+ * console, is published once instead of being written to several redirected streams and
+ * split into lines again by each of them. Levels and destinations are numbered by the
+ * application, up to 32 of each. An observer receives a message when the message's level
+ * is in its level mask and one of the message's destinations is in its destination mask,
+ * so it can subscribe by level, by destination, or both.
+ *
+ * Messages are delivered on the publishing thread, in batches, without taking a lock;
+ * the observers must be thread safe when several threads publish.
+ */
+class MessageRouter final {
+public:
+    static constexpr std::uint32_t kAll = 0xffffffffu;  /**< Mask matching every level or destination. */
+
+    CREDIRECT_EXPORT
+    MessageRouter();
+
+    /**
+     * @brief Destroys the router, no message may be published while or after it is destroyed.
+     */
+    CREDIRECT_EXPORT
+    ~MessageRouter();
+
+    /**
+     * @brief Subscribes an observer, or changes the masks of one that is subscribed.
+     *
+     * @param observer Observer that receives the matching messages.
+     * @param levels Bit `1 << level` is set for every level the observer wants.
+     * @param destinations Bit `1 << destination` is set for every destination the observer wants.
+     */
+    CREDIRECT_EXPORT
+    void attach(LineObserver* observer, std::uint32_t levels = kAll, std::uint32_t destinations = kAll);
+
+    /**
+     * @brief Unsubscribes an observer.
+     *
+     * When it returns the observer is no longer being called and may be destroyed, so it
+     * must not be called from within an observer.
+     *
+     * @param observer Observer to unsubscribe.
+     */
+    CREDIRECT_EXPORT
+    void detach(LineObserver* observer);
+
+    /**
+     * @brief Returns the destinations that at least one observer subscribed to for a level.
+     *
+     * A single atomic load, to skip formatting a message nobody receives or to write the
+     * destinations nobody subscribed to some other way.
+     *
+     * @param level Level of a message.
+     * @return Bit `1 << destination` is set for every destination with a subscriber.
+     */
+    CREDIRECT_EXPORT
+    std::uint32_t coverage(unsigned level) const;
+
+    /**
+     * @brief Delivers a batch of messages of one level and set of destinations.
+     *
+     * @param lines Messages without a trailing newline, valid only during the call.
+     * @param count Number of messages.
+     * @param level Level of the messages, below 32.
+     * @param destinations Bit `1 << destination` is set for every destination of the messages.
+     * @return true if at least one observer received the messages.
+     */
+    CREDIRECT_EXPORT
+    bool publish(const std::string_view* lines, std::size_t count, unsigned level, std::uint32_t destinations);
+
+    /**
+     * @brief Delivers a single message.
+     */
+    CREDIRECT_EXPORT
+    bool publish(std::string_view line, unsigned level, std::uint32_t destinations);
+
+private:
+    MessageRouter(const MessageRouter&) = delete;
+    MessageRouter& operator=(const MessageRouter&) = delete;
+    MessageRouter(MessageRouter&&) = delete;
+    MessageRouter& operator=(MessageRouter&&) = delete;
+
+    struct MessageRouterPimpl;
+    struct MessageRouterPimpl* d;
+};
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // __CREDIRECT_MESSAGE_ROUTER_HPP__
@@ -0,0 +1,81 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CREDIRECT_METADATA_OBSERVER_HPP__
+#define __CREDIRECT_METADATA_OBSERVER_HPP__
+
+#include <CRedirect_config.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+
+/**
+ * @struct LineMetadata
+ * @brief When and in which order a line was written to its stream.
+ */
+struct LineMetadata {
+    /**
+     * @brief Position of the line in its stream, counting from 0 in the order the lines were published.
+     */
+    std::uint64_t sequence = 0;
+
+    /**
+     * @brief Sequence number of the publish that completed the line, shared by all redirected streams.
+     *
+     * It is drawn by the writer, so it orders lines of different streams the way they were
+     * published. Lines completed by the same publish have the same number.
+     */
+    std::uint64_t globalSequence = 0;
+
+    /**
+     * @brief When the writer published the line's newline, before it was queued for the observers.
+     *
+     * Comparing it with std::chrono::steady_clock::now() in the observer gives the queueing delay.
+     */
+    std::chrono::steady_clock::time_point captured;
+};
+
+/**
+ * @class MetadataObserver
+ * @brief Observer that receives lines together with their capture time and sequence number.
+ *
+ * Lines are views into the buffer of the redirected stream, exactly as for a LineObserver,
+ * and are only valid for the duration of the call. The capture time is taken by the writing
+ * thread when the data is published, so it is not affected by how long the line waited
+ * for the monitor thread.
+ */
+class MetadataObserver {
+public:
+    virtual ~MetadataObserver() = default;
+
+    /**
+     * @brief Called once per wakeup of the monitor thread with every complete line it read.
+     *
+     * @param lines Pointer to the first line of the batch, valid only during the call.
+     * @param metadata Metadata of each line, `metadata[i]` belongs to `lines[i]`.
+     * @param count Number of lines in the batch.
+     */
+    virtual void updateBatch(const std::string_view* lines, const LineMetadata* metadata, std::size_t count) = 0;
+};
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // __CREDIRECT_METADATA_OBSERVER_HPP__
@@ -0,0 +1,108 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CREDIRECT_MIRRORED_BUFFER_HPP__
+#define __CREDIRECT_MIRRORED_BUFFER_HPP__
+#include <CRedirect_config.h>
+#include <cstddef>
+#include <cstdint>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+
+/**
+ * @class MirroredBuffer
+ * @brief Power of two sized byte buffer for circular use, mapped twice back to back when possible.
+ *
+ * When the platform supports it the same physical pages are mapped at
+ * [data(), data() + capacity()) and again at [data() + capacity(), data() + 2 * capacity()),
+ * so any range of up to capacity() bytes starting inside the first mapping is contiguous
+ * in memory even if it wraps around the end of the circular buffer. If the double mapping
+ * cannot be created a plain allocation is used and mirrored() returns false, in which case
+ * callers must split wrapped ranges themselves.
+ */
+class HIDDEN MirroredBuffer {
+public:
+    /**
+     * @brief Constructs an empty buffer without storage.
+     */
+    MirroredBuffer();
+
+    /**
+     * @brief Constructs a buffer of at least the requested capacity.
+     *
+     * @param capacity Capacity in bytes, rounded up to a power of two (and to the page size when mirrored).
+     */
+    explicit MirroredBuffer(std::size_t capacity);
+
+    /**
+     * @brief Releases the mappings or the allocation.
+     */
+    ~MirroredBuffer();
+
+    MirroredBuffer(MirroredBuffer&& other) noexcept;
+    MirroredBuffer& operator=(MirroredBuffer&& other) noexcept;
+
+    /**
+     * @brief Returns the start of the buffer.
+     */
+    char* data() const;
+
+    /**
+     * @brief Returns the capacity of the buffer in bytes.
+     */
+    std::size_t capacity() const;
+
+    /**
+     * @brief Returns true if the buffer is followed by a mirror of itself.
+     */
+    bool mirrored() const;
+
+    /**
+     * @brief Returns the number of bytes that are contiguous in memory starting at a logical position.
+     *
+     * @param position Logical (unwrapped) position in the circular buffer.
+     * @param size Number of bytes wanted.
+     * @return size if the range is contiguous, otherwise the number of bytes up to the end of the buffer.
+     */
+    std::size_t contiguous(std::uint64_t position, std::size_t size) const;
+
+    /**
+     * @brief Returns a pointer to a logical (unwrapped) position in the circular buffer.
+     */
+    char* at(std::uint64_t position) const;
+
+    /**
+     * @brief Copies a range of this buffer into another circular buffer at the same logical position.
+     *
+     * @param target Buffer receiving the data.
+     * @param position Logical position of the first byte.
+     * @param size Number of bytes to copy, at most the capacity of both buffers.
+     */
+    void copyTo(MirroredBuffer& target, std::uint64_t position, std::size_t size) const;
+
+private:
+    MirroredBuffer(const MirroredBuffer&) = delete;
+    MirroredBuffer& operator=(const MirroredBuffer&) = delete;
+
+    struct MirroredBufferPimpl;
+    struct MirroredBufferPimpl* d;
+};
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // __CREDIRECT_MIRRORED_BUFFER_HPP__
@@ -0,0 +1,172 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CREDIRECT_REDIRECT_OPTIONS_HPP__
+#define __CREDIRECT_REDIRECT_OPTIONS_HPP__
+#include <CRedirect_config.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ios>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+
+/**
+ * @enum BufferEngine
+ * @brief Selects the buffer implementation used between the writers and the monitor thread.
+ */
+enum class BufferEngine {
+    Mutex,      /**< Growable buffer protected by a single mutex. */
+    LockFree    /**< Bounded lock-free multi-producer/single-consumer ring. */
+};
+
+/**
+ * @enum WakeupPolicy
+ * @brief Decides when a write wakes the monitor thread.
+ *
+ * Whatever the policy, a write that brings the amount of unread data to the high-water mark
+ * wakes the monitor thread, and data that did not wake it is picked up after at most the
+ * coalescing delay, so the policies only trade wakeups against latency.
+ */
+enum class WakeupPolicy {
+    EveryWrite, /**< Wake on every flush, lowest latency (default for std::cerr). */
+    Newline,    /**< Wake when the written data contains a newline. */
+    Coalesce    /**< Only wake on the high-water mark, otherwise batch writes for the coalescing delay. */
+};
+
+/**
+ * @enum DispatchMode
+ * @brief Selects which thread reads the redirected stream and notifies its observers.
+ */
+enum class DispatchMode {
+    Thread,     /**< Every redirected stream has a monitor thread of its own. */
+    Shared,     /**< All redirected streams are serviced by one shared pool of dispatcher threads. */
+    Inline      /**< Complete lines are delivered on the writing thread, observers must be thread safe. */
+};
+
+/**
+ * @enum OverflowPolicy
+ * @brief Decides what happens to new data when a bounded queue or buffer is full.
+ */
+enum class OverflowPolicy {
+    Block,      /**< Wait until there is room, lossless but stalls the writer. */
+    DropOldest, /**< Discard the oldest queued entry to make room. */
+    DropNewest  /**< Discard the new entry. */
+};
+
+/**
+ * @struct RedirectStats
+ * @brief Counters of a redirected stream whose buffer is bounded.
+ */
+struct RedirectStats {
+    std::uint64_t droppedBytes = 0;     /**< Bytes discarded by the overflow policy. */
+    std::uint64_t droppedLines = 0;     /**< Newlines among the discarded bytes. */
+    std::size_t bufferSize = 0;         /**< Current capacity of the buffer in bytes. */
+};
+
+/**
+ * @struct RedirectOptions
+ * @brief Construction time settings for a redirected stream.
+ *
+ * The defaults are taken from the CMake configuration.
+ */
+struct RedirectOptions {
+    /**
+     * @brief Buffer engine used by the redirected stream.
+     */
+    BufferEngine engine = LIB_CREDIRECT_DEFAULT_BUFFER_ENGINE;
+
+    /**
+     * @brief Initial size of the Mutex engine buffer.
+     */
+    std::streamsize initialBufferSize = LIB_CREDIRECT_INITIAL_BUFFER_SIZE;
+
+    /**
+     * @brief Capacity of the LockFree engine ring, rounded up to a power of two.
+     */
+    std::size_t ringBufferSize = LIB_CREDIRECT_RING_BUFFER_SIZE;
+
+    /**
+     * @brief When writes wake the monitor thread.
+     */
+    WakeupPolicy wakeup = LIB_CREDIRECT_DEFAULT_WAKEUP_POLICY;
+
+    /**
+     * @brief Amount of unread data in bytes that always wakes the monitor thread.
+     */
+    std::size_t wakeupHighWaterMark = LIB_CREDIRECT_WAKEUP_HIGH_WATER_MARK;
+
+    /**
+     * @brief Longest time data that did not wake the monitor thread waits before it is read.
+     */
+    std::chrono::microseconds wakeupDelay = std::chrono::microseconds(LIB_CREDIRECT_WAKEUP_DELAY_US);
+
+    /**
+     * @brief Whether the stream gets its own monitor thread or uses the shared dispatcher pool.
+     */
+    DispatchMode dispatch = LIB_CREDIRECT_DEFAULT_DISPATCH_MODE;
+
+    /**
+     * @brief Number of threads of the shared dispatcher pool, used by the stream that starts it.
+     */
+    std::size_t dispatcherThreads = LIB_CREDIRECT_DISPATCHER_THREADS;
+
+    /**
+     * @brief Whether every writing thread stages its output and publishes complete lines only.
+     *
+     * Writers then share no put area, and lines written by different threads never interleave.
+     * A partial line is held, even across a flush, until its newline is written or the stream
+     * is closed. Inline dispatch mode always keeps partial lines per thread.
+     */
+    bool threadStaging = LIB_CREDIRECT_DEFAULT_THREAD_STAGING;
+
+    /**
+     * @brief Largest size in bytes the Mutex engine buffer may grow to, 0 for no limit.
+     *
+     * The LockFree engine is always bounded by ringBufferSize. The Mutex engine buffer
+     * shrinks back towards initialBufferSize once a burst has been read.
+     */
+    std::size_t maxBufferSize = LIB_CREDIRECT_MAX_BUFFER_SIZE;
+
+    /**
+     * @brief What a writer does when the buffer is full and may not grow.
+     *
+     * DropOldest discards the oldest complete lines the monitor thread has not taken yet,
+     * with the LockFree engine it behaves like DropNewest because the writers cannot
+     * reclaim space from the ring. An observer that writes to the stream it observes must
+     * not be combined with Block unless blockTimeout is set.
+     */
+    OverflowPolicy overflow = LIB_CREDIRECT_DEFAULT_OVERFLOW_POLICY;
+
+    /**
+     * @brief Longest time a writer blocks with the Block policy before its data is dropped, 0 to wait forever.
+     */
+    std::chrono::milliseconds blockTimeout = std::chrono::milliseconds(LIB_CREDIRECT_BLOCK_TIMEOUT_MS);
+
+    /**
+     * @brief Size in bytes of the FlightRecorder ring of recent lines kept by the stream, 0 to keep none.
+     *
+     * The lines are recorded before any observer sees them and are dumped by the crash
+     * handlers of FlightRecorder::install(). Ignored unless LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER is set.
+     */
+    std::size_t flightRecorderSize = LIB_CREDIRECT_FLIGHT_RECORDER_SIZE;
+};
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // __CREDIRECT_REDIRECT_OPTIONS_HPP__
@@ -0,0 +1,152 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CREDIRECT_RING_BUFFER_HPP__
+#define __CREDIRECT_RING_BUFFER_HPP__
+#include <CRedirect_config.h>
+#include <RedirectOptions.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+
+/**
+ * @class RingBuffer
+ * @brief Bounded lock-free multi-producer/single-consumer byte ring.
+ *
+ * Producers reserve space by advancing a shared head cursor with an atomic
+ * compare-and-swap, copy their bytes into the reserved record and then commit
+ * the record by publishing its length. Every record carries the CaptureClock
+ * time at which it was written and a global sequence number. The single consumer walks committed
+ * records in reservation order. A record never wraps around the end of the
+ * ring; when it would, the producer fills the remainder with a padding record.
+ *
+ * The consumer sleeps on a condition variable only when the ring is empty and
+ * producers only touch the associated mutex when the consumer is asleep. How
+ * eagerly a commit wakes the consumer is controlled by a WakeupPolicy.
+ */
+class HIDDEN RingBuffer {
+public:
+    /**
+     * @brief Constructs a ring with at least the requested capacity.
+     *
+     * @param capacity Capacity in bytes, rounded up to a power of two.
+     * @param wakeup When a commit wakes the consumer.
+     * @param highWaterMark Amount of unread data in bytes that always wakes the consumer.
+     * @param delay Longest time the consumer waits for a wakeup once data that did not wake it is readable.
+     */
+    explicit RingBuffer(std::size_t capacity, 
+                        WakeupPolicy wakeup = WakeupPolicy::EveryWrite,
+                        std::size_t highWaterMark = LIB_CREDIRECT_WAKEUP_HIGH_WATER_MARK,
+                        std::chrono::microseconds delay = std::chrono::microseconds(LIB_CREDIRECT_WAKEUP_DELAY_US));
+
+    /**
+     * @brief Destroys the ring and releases its storage.
+     */
+    ~RingBuffer();
+
+    /**
+     * @brief Copies data into the ring, waiting for space when the ring is full.
+     *
+     * Data larger than half of the ring is split into several records.
+     *
+     * @param data Pointer to the bytes to write.
+     * @param size Number of bytes to write.
+     * @return The number of bytes written, less than size only if the ring was terminated.
+     */
+    std::size_t write(const char* data, std::size_t size);
+
+    /**
+     * @brief Hands every committed record to the consumer callback and frees its space.
+     *
+     * Must only be called from the single consumer thread.
+     *
+     * @param consumer Called once per record with a pointer to the payload, its size, the
+     *                 CaptureClock time at which it was written and its global sequence number
+     *                 (0 unless the payload holds a newline).
+     * @return The number of payload bytes consumed.
+     */
+    std::size_t consume(const std::function<void(const char*, std::size_t, std::uint64_t, std::uint64_t)>& consumer);
+
+    /**
+     * @brief Blocks the consumer until a committed record is available or the ring is terminated.
+     *
+     * If the available data did not ask for a wakeup, the consumer keeps waiting for one for at
+     * most the coalescing delay so that further writes are read in the same batch.
+     *
+     * @return true if data is available, false if the ring was terminated and is empty.
+     */
+    bool wait();
+
+    /**
+     * @brief Returns true if at least one committed record is waiting for the consumer.
+     */
+    bool readable() const;
+
+    /**
+     * @brief Marks the ring as terminated and wakes all waiting threads.
+     */
+    void terminate();
+
+    /**
+     * @brief Returns the usable capacity of the ring in bytes.
+     */
+    std::size_t capacity() const;
+
+    /**
+     * @brief Installs a callback that is told about every commit instead of waking a waiting consumer.
+     *
+     * Must be installed before the first write. The callback is called from the producers with
+     * true when the wakeup policy asks for the consumer to run now and false otherwise.
+     *
+     * @param notifier Callback taking whether the consumer should run immediately.
+     */
+    void setNotifier(std::function<void(bool)> notifier);
+
+    /**
+     * @brief Selects what a producer does when the ring is full.
+     *
+     * Must be set before the first write. Block waits for space, for at most `timeout` unless
+     * it is zero; any other policy drops the record right away, since producers cannot reclaim
+     * space from the consumer. Dropped data still counts as written.
+     *
+     * @param overflow Policy applied to a record that does not fit.
+     * @param timeout Longest time a blocked producer waits before its record is dropped, 0 to wait forever.
+     */
+    void setOverflow(OverflowPolicy overflow, std::chrono::milliseconds timeout);
+
+    /**
+     * @brief Returns the dropped data counters and the capacity of the ring.
+     */
+    RedirectStats stats() const;
+
+private:
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+    RingBuffer(RingBuffer&&) = delete;
+    RingBuffer& operator=(RingBuffer&&) = delete;
+
+    struct RingBufferPimpl;
+    struct RingBufferPimpl* d;
+};
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // __CREDIRECT_RING_BUFFER_HPP__
@@ -0,0 +1,136 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CREDIRECT_SNAPSHOT_HPP__
+#define __CREDIRECT_SNAPSHOT_HPP__
+#include <CRedirect_config.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+
+/**
+ * @class Snapshot
+ * @brief Immutable value read without a lock and replaced as a whole by a writer.
+ *
+ * Readers register with one of two counters, selected by the current epoch, for as long
+ * as they use the value. Writers are serialized by a mutex of the owner; they publish a
+ * new value and retire the old one, which is freed once no reader can still be using it.
+ * reclaim() frees the retired values if no reader is registered at all, synchronize()
+ * waits for the readers that may have seen them, so a writer can hand back resources that
+ * only the old value referred to.
+ *
+ * @tparam T Type of the value.
+ */
+template<typename T>
+class HIDDEN Snapshot {
+public:
+    /**
+     * @brief Registration of a reader, the value it was given stays valid until it is destroyed.
+     */
+    class Reader {
+    public:
+        explicit Reader(const Snapshot& snapshot) :
+            readers(snapshot.readers[snapshot.epoch.load() & 1]) {
+            readers.fetch_add(1);
+            value = snapshot.current.load();
+        }
+
+        ~Reader() {
+            readers.fetch_sub(1, std::memory_order_release);
+        }
+
+        const T& operator*() const { return *value; }
+        const T* operator->() const { return value; }
+
+    private:
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        std::atomic<unsigned>& readers;
+        const T* value;
+    };
+
+    explicit Snapshot(T value = T()) :
+        current(new T(std::move(value))),
+        epoch(0),
+        readers{ {0}, {0} } {}
+
+    ~Snapshot() {
+        delete current.load();
+    }
+
+    /**
+     * @brief Returns the current value, called by a writer.
+     */
+    const T& get() const {
+        return *current.load();
+    }
+
+    /**
+     * @brief Publishes a new value and retires the current one, called by a writer.
+     */
+    void replace(T value) {
+        retired.emplace_back(current.exchange(new T(std::move(value))));
+    }
+
+    /**
+     * @brief Frees the retired values if no reader is registered, called by a writer.
+     *
+     * A reader that could still use a retired value registered with one of the counters
+     * before the value was replaced, so seeing both counters at zero afterwards proves it
+     * has finished.
+     */
+    void reclaim() {
+        if(readers[0].load() == 0 && readers[1].load() == 0) {
+            retired.clear();
+        }
+    }
+
+    /**
+     * @brief Waits until every reader that may have seen a retired value has finished, then frees them.
+     *
+     * The epoch is flipped twice, and each time the counter of the previous epoch is waited
+     * on. New readers register with the other counter, so neither wait can be starved.
+     */
+    void synchronize() {
+        for(int i = 0; i < 2; ++i) {
+            unsigned previous = epoch.fetch_add(1);
+            while(readers[previous & 1].load() != 0) {
+                std::this_thread::yield();
+            }
+        }
+        retired.clear();
+    }
+
+private:
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    std::atomic<const T*> current;
+    std::atomic<unsigned> epoch;
+    mutable std::atomic<unsigned> readers[2];
+    std::vector<std::unique_ptr<const T>> retired;
+};
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // __CREDIRECT_SNAPSHOT_HPP__
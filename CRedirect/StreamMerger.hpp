@@ -0,0 +1,137 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef __CREDIRECT_STREAM_MERGER_HPP__
+#define __CREDIRECT_STREAM_MERGER_HPP__
+
+#include <CRedirect_config.h>
+#include <MetadataObserver.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+
+/**
+ * @struct MergedLine
+ * @brief A line of the merged timeline and the stream it was written to.
+ */
+struct MergedLine {
+    std::string_view source;    /**< Name given to the input the line arrived on. */
+    std::string_view text;      /**< The line without its trailing newline. */
+    LineMetadata metadata;      /**< Capture time and sequence numbers of the line. */
+};
+
+/**
+ * @class MergedObserver
+ * @brief Observer that receives the lines of several streams as one ordered timeline.
+ */
+class MergedObserver {
+public:
+    virtual ~MergedObserver() = default;
+
+    /**
+     * @brief Called from the merger thread with lines in global sequence order.
+     *
+     * @param lines Pointer to the first line of the batch, valid only during the call.
+     * @param count Number of lines in the batch.
+     */
+    virtual void updateBatch(const MergedLine* lines, std::size_t count) = 0;
+};
+
+/**
+ * @struct StreamMergerStats
+ * @brief Counters of a StreamMerger.
+ */
+struct StreamMergerStats {
+    std::uint64_t merged = 0;       /**< Lines handed to the observer. */
+    std::uint64_t late = 0;         /**< Lines that arrived after a line published later had been handed out. */
+    std::uint64_t forced = 0;       /**< Lines handed out early because the reorder buffer was full. */
+    std::size_t pending = 0;        /**< Lines held in the reorder buffer or being delivered right now. */
+    std::size_t maxPending = 0;     /**< Largest number of pending lines seen. */
+};
+
+/**
+ * @class StreamMerger
+ * @brief Merges the lines of several redirected streams into one timeline ordered by global sequence number.
+ *
+ * Attach an input of the merger to every stream that is part of the timeline, for example
+ * `CoutRedirect::attach(merger.input("cout"))`. The monitor threads only copy their batches
+ * into the merger, a thread of its own orders them and delivers them to the observer.
+ *
+ * Writers draw global sequence numbers when they publish a line, so the number that follows
+ * the last one delivered can be delivered right away. A line after a gap, whose predecessor
+ * may still be queued in another stream, is held until the gap is filled, for at most the
+ * reorder window after it arrived or until the reorder buffer is full. Gaps that are never
+ * filled come from publishes to streams that are not merged and from dropped lines.
+ *
+ * Detach every input from its stream before destroying the StreamMerger. The destructor
+ * delivers whatever is still held before it returns.
+ */
+class StreamMerger final {
+public:
+    /**
+     * @brief Starts the merger thread.
+     *
+     * @param observer Receives the merged timeline, it must outlive the StreamMerger.
+     * @param window Longest time a line is held waiting for an earlier one.
+     * @param capacity Number of lines held before the oldest is delivered regardless.
+     */
+    CREDIRECT_EXPORT
+    explicit StreamMerger(MergedObserver* observer,
+                          std::chrono::microseconds window = std::chrono::microseconds(LIB_CREDIRECT_MERGE_WINDOW_US),
+                          std::size_t capacity = LIB_CREDIRECT_MERGE_CAPACITY);
+
+    /**
+     * @brief Delivers the held lines in order and stops the merger thread.
+     */
+    CREDIRECT_EXPORT
+    ~StreamMerger();
+
+    /**
+     * @brief Returns a new input to attach to a stream, owned by the StreamMerger.
+     *
+     * @param source Name reported with every line that arrives on this input.
+     * @return The observer to attach to the stream.
+     */
+    CREDIRECT_EXPORT
+    MetadataObserver* input(const std::string& source);
+
+    /**
+     * @brief Returns a snapshot of the counters.
+     */
+    CREDIRECT_EXPORT
+    StreamMergerStats stats() const;
+
+private:
+    StreamMerger(const StreamMerger&) = delete;
+    StreamMerger& operator=(const StreamMerger&) = delete;
+    StreamMerger(StreamMerger&&) = delete;
+    StreamMerger& operator=(StreamMerger&&) = delete;
+
+    void merge();
+
+    struct StreamMergerPimpl;
+    struct StreamMergerPimpl* d;
+};
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // __CREDIRECT_STREAM_MERGER_HPP__
@@ -20,7 +20,12 @@
 #define __CREDIRECT_STREAM_REDIRECT_HPP__
 #include <CRedirect_config.h>
 #include <StreamObserver.hpp>
+#include <LineObserver.hpp>
+#include <MetadataObserver.hpp>
+#include <RedirectOptions.hpp>
+#include <cstddef>
 #include <string>
+#include <string_view>
 
 LIB_CREDIRECT_NAMESPACE_BEGIN
 
@@ -35,15 +40,25 @@ LIB_CREDIRECT_NAMESPACE_BEGIN
  */
 class StreamRedirect final {
 public:
-    StreamRedirect(std::ostream& stream);
+    StreamRedirect(std::ostream& stream, const RedirectOptions& options = RedirectOptions(), const std::string& name = "stream");
     ~StreamRedirect();
 
     void attach(StreamObserver* observer);
     void detach(StreamObserver* observer);
+    void attach(LineObserver* observer);
+    void detach(LineObserver* observer);
+    void attach(MetadataObserver* observer);
+    void detach(MetadataObserver* observer);
     void notify(const std::string& line);
+    void notify(const std::string_view* lines, std::size_t count);
+    RedirectStats stats() const;
 
 private:    
     void monitorStream();
+    void dispatchStream();
+    void deliver(const char* data, std::size_t size);
+    void deliverLast(const char* data, std::size_t size);
+    void notify(const std::string_view* lines, std::size_t count, const char* view);
 
     struct StreamRedirectPimpl;
     struct StreamRedirectPimpl* d;
@@ -19,22 +19,39 @@
 #ifndef __CREDIRECT_SYNCHRONOUSSTREAMBUF_HPP__
 #define __CREDIRECT_SYNCHRONOUSSTREAMBUF_HPP__
 #include <CRedirect_config.h>
+#include <RedirectOptions.hpp>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <sstream>
+#include <string_view>
 
 LIB_CREDIRECT_NAMESPACE_BEGIN
 
 class HIDDEN SynchronousStreamBuf : public std::basic_streambuf<char> {
 public:
+    /**
+     * @brief When and in which order data was published.
+     */
+    struct Capture {
+        std::uint64_t ticks;        /**< CaptureClock time of the publish. */
+        std::uint64_t sequence;     /**< Global sequence number of the publish, 0 if unknown. */
+    };
+
     /**
      * @brief Constructor for the SynchronousStreamBuf class.
      * 
-     * This constructor initializes the SynchronousStreamBuf instance with a specified initial buffer size.
-     * It sets up the internal buffer and initializes the stream pointers.
+     * This constructor initializes the SynchronousStreamBuf instance with the buffer engine
+     * selected in the options. The Mutex engine uses a growable buffer of options.initialBufferSize
+     * bytes, the LockFree engine uses a bounded ring of options.ringBufferSize bytes and leaves
+     * the put area empty so that every write reserves its space in the ring directly. With
+     * options.threadStaging the put area is empty for both engines and each writing thread
+     * stages its output until it has complete lines to commit.
      * 
-     * @param initial_size The initial size of the buffer (default is LIB_CREDIRECT_INITIAL_BUFFER_SIZE).
+     * @param options Buffer engine and sizes (defaults are taken from the CMake configuration).
      */
-    SynchronousStreamBuf(std::streamsize initial_size = LIB_CREDIRECT_INITIAL_BUFFER_SIZE);
+    explicit SynchronousStreamBuf(const RedirectOptions& options = RedirectOptions());
     
     /**
      * @brief Destructor for the SynchronousStreamBuf class.
@@ -53,6 +70,76 @@ public:
      */
     void terminate();
 
+    /**
+     * @brief Returns a view of all unconsumed data, waiting until some of it is new.
+     * 
+     * This is the zero-copy alternative to reading through a std::istream and must not be mixed
+     * with it. Only the single reader thread may call it. The view stays valid until the next call
+     * to read(); consume() releases its first bytes so the writers can reuse the space.
+     * 
+     * @param data Set to the first unconsumed byte.
+     * @param size Set to the number of unconsumed bytes.
+     * @return true if the view holds data not returned before, false once the stream has been
+     *         terminated and nothing new will arrive (the view then holds what was left unconsumed).
+     */
+    bool read(const char*& data, std::size_t& size);
+
+    /**
+     * @brief Returns a view of all unconsumed data without waiting.
+     * 
+     * Same as read() for a reader that is scheduled through the notifier instead of blocking.
+     * 
+     * @param data Set to the first unconsumed byte.
+     * @param size Set to the number of unconsumed bytes.
+     * @return true if the view holds data not returned before.
+     */
+    bool poll(const char*& data, std::size_t& size);
+
+    /**
+     * @brief Installs a callback that is told about published data instead of waking a blocked reader.
+     * 
+     * The callback receives true when the wakeup policy asks for the reader to run now and false
+     * when the data may wait for the coalescing delay. It may be called with internal locks held
+     * and must not call back into the stream buffer. Install it before anything is written.
+     * 
+     * @param notifier Callback taking whether the reader should run immediately.
+     */
+    void setNotifier(std::function<void(bool)> notifier);
+
+    /**
+     * @brief Installs the callback that receives complete lines in Inline dispatch mode.
+     * 
+     * Lines are delivered on the writing thread as soon as their newline is written, a partial
+     * line is kept per thread until it is completed or the stream buffer is terminated.
+     * 
+     * @param sink Callback receiving a batch of lines, valid only during the call.
+     */
+    void setLineSink(std::function<void(const std::string_view*, std::size_t)> sink);
+
+    /**
+     * @brief Releases the first bytes of the view returned by read().
+     * 
+     * @param size Number of bytes that have been processed.
+     */
+    void consume(std::size_t size);
+
+    /**
+     * @brief Returns when and in which order the line holding a byte of the view returned by read() or poll() was published.
+     *
+     * Writers stamp their data with CaptureClock::now() and CaptureClock::nextSequence() when they
+     * publish it, in sync() or when they commit it to the engine, if it completes a line. Only the
+     * reader thread may call it, for a byte not yet consumed.
+     *
+     * @param offset Offset of the byte in the view.
+     * @return The stamp of the publish that completed the line holding the byte.
+     */
+    Capture captured(std::size_t offset) const;
+
+    /**
+     * @brief Returns the data dropped by the overflow policy and the current size of the buffer.
+     */
+    RedirectStats stats() const;
+
 protected:
     /**
      * @brief Underflow function for the SynchronousStreamBuf class.
@@ -76,11 +163,37 @@ protected:
      */
     int_type overflow(int_type ch) override;
 
+    /**
+     * @brief Writes a sequence of characters to the SynchronousStreamBuf instance.
+     * 
+     * With the LockFree engine the whole sequence is published to the ring as a single record
+     * (or as several records if it is larger than half of the ring). With the Mutex engine a sequence
+     * that fits in the put area is copied in one step; a larger one takes the mutex once, publishes
+     * what is pending, grows the buffer at most once and copies the rest in bulk.
+     * 
+     * @param s Pointer to the characters to write.
+     * @param count Number of characters to write.
+     * @return The number of characters written.
+     */
+    std::streamsize xsputn(const char_type* s, std::streamsize count) override;
+
+    /**
+     * @brief Reads a sequence of characters from the SynchronousStreamBuf instance.
+     * 
+     * Copies whole spans of the get area at a time and only calls underflow() when the get area
+     * is exhausted, blocking until count characters were read or the stream is terminated.
+     * 
+     * @param s Pointer to the destination buffer.
+     * @param count Number of characters to read.
+     * @return The number of characters read.
+     */
+    std::streamsize xsgetn(char_type* s, std::streamsize count) override;
+
     /**
      * @brief Synchronizes the SynchronousStreamBuf instance.
      * 
-     * This method flushes the current contents of the stream buffer, moving any data from the get area to the put area.
-     * It resizes the internal buffer if necessary and notifies any waiting threads that new data is available.
+     * This method publishes the current contents of the put area to the reader by advancing the published
+     * position of the circular buffer, without copying, and wakes the reader as the wakeup policy asks.
      * 
      * @return 0 on success, or -1 if the stream has been terminated.
      */
@@ -98,6 +211,22 @@ private:
     SynchronousStreamBuf(SynchronousStreamBuf&&) = delete;
     SynchronousStreamBuf& operator=(SynchronousStreamBuf&&) = delete;
 
+    /**
+     * @brief Helpers for the circular buffer of the Mutex engine, called with the mutex held.
+     */
+    bool publish();
+    void resetPutArea();
+    bool growBuffer(std::size_t minimum);
+    void shrinkBuffer();
+    bool makeRoom(std::unique_lock<std::mutex>& lock, std::size_t wanted, std::size_t needed);
+    bool dropOldest(std::size_t needed);
+
+    /**
+     * @brief Helpers for thread staging, publishing complete lines of one writer at a time.
+     */
+    std::streamsize stage(const char_type* s, std::streamsize count);
+    bool commit(const char* data, std::size_t size);
+
     /**
      * @struct SynchronousStreamBufPimpl
      * @brief Private implementation (Pimpl) for the SynchronousStreamBuf class.
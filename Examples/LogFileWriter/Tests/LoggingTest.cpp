@@ -0,0 +1,348 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+
+#include <LogFileWriterConfig.h>
+#include <Logging.hpp>
+#include <LineObserver.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Collects the messages published through the logging router, in every destination.
+ */
+class MessageCollector : public LineObserver {
+public:
+    MessageCollector() {
+        basic_logging::router().attach(this);
+    }
+
+    ~MessageCollector() {
+        basic_logging::router().detach(this);
+    }
+
+    void update(std::string_view line) override {
+        std::lock_guard<std::mutex> lock(mtx);
+        lines.emplace_back(line);
+    }
+
+    std::mutex mtx;
+    std::vector<std::string> lines;
+};
+
+/**
+ * @brief Compile time checks of the pieces a format string is parsed into.
+ */
+constexpr bool isPiece(const LogFormat::Piece& piece, std::size_t offset, std::size_t length, bool argument) {
+    return piece.argument == argument && (argument || (piece.offset == offset && piece.length == length));
+}
+
+constexpr LogFormat::Layout<1> placeholder("{}");
+static_assert(placeholder.valid && placeholder.count == 1 && placeholder.arguments == 1 && placeholder.literalSize == 0);
+static_assert(isPiece(placeholder.pieces[0], 0, 0, true));
+
+constexpr LogFormat::Layout<1> openBrace("{{");
+static_assert(openBrace.valid && openBrace.count == 1 && openBrace.arguments == 0 && openBrace.literalSize == 1);
+static_assert(isPiece(openBrace.pieces[0], 0, 1, false));
+
+constexpr LogFormat::Layout<1> closeBrace("}}");
+static_assert(closeBrace.valid && closeBrace.count == 1 && closeBrace.arguments == 0 && closeBrace.literalSize == 1);
+static_assert(isPiece(closeBrace.pieces[0], 0, 1, false));
+
+constexpr LogFormat::Layout<3> trailing("a {} tail");
+static_assert(trailing.valid && trailing.count == 3 && trailing.arguments == 1 && trailing.literalSize == 7);
+static_assert(isPiece(trailing.pieces[0], 0, 2, false) && isPiece(trailing.pieces[1], 0, 0, true) &&
+              isPiece(trailing.pieces[2], 4, 5, false));
+
+// Pieces past the capacity are counted, parse() sizes the array with that count
+static_assert(LogFormat::Layout<1>("a {} tail {{{}}}").count == 5);
+static_assert(!LogFormat::Layout<1>("a {x}").valid && !LogFormat::Layout<1>("a } b").valid);
+
+/**
+ * @brief Test function for LOG_FORMAT
+ *
+ * Messages are formatted as the equivalent operator<< statement would, with {{ and }} written
+ * as single braces, and the parsed format holds exactly one piece per segment and placeholder.
+ */
+int test002() {
+    MessageCollector collector;
+
+    static constexpr auto layout = LogFormat::parse<int, std::string>([] { return "{} of {} {{done}}"; });
+    static_assert(sizeof(layout.pieces) == 5 * sizeof(LogFormat::Piece));
+
+    LOG_FORMAT(info, "read {} bytes from {} in {}s", 42, std::string("file"), 1.5);
+    LOG_FORMAT(warn, "{}{{{}}}", 'a', "b");
+    LOG_FORMAT(err, "no arguments");
+    return collector.lines == std::vector<std::string>{ "[info] read 42 bytes from file in 1.5s", "[warn] a{b}", "[error] no arguments" } ? 0 : 1;
+}
+
+/**
+ * @brief Test function for DeferredLog
+ *
+ * Deferred messages must be formatted in the order they were logged once flush() returns.
+ * Messages that do not fit in a full ring must be dropped, counted and reported in warnings,
+ * and the ring of a thread must be released once the thread has exited. Messages logged in
+ * bursts with pauses between them must be delivered without a flush, as the background
+ * thread is woken from its sleep by the first message of every burst.
+ */
+int test001() {
+    MessageCollector collector;
+
+    LOG_DEFERRED(info, "deferred {} of {} at {}", 1, 2u, 0.5);
+    LOG_DEFERRED(warn, "text {} {} {{kept}}", std::string("string"), "literal");
+    DeferredLog::flush();
+    if(collector.lines != std::vector<std::string>{ "[info] deferred 1 of 2 at 0.5", "[warn] text string literal {kept}" }) {
+        return 1;
+    }
+    collector.lines.clear();
+
+    // A thread filling its ring far faster than it is drained
+    const int count = 1000;
+    const std::string large(8192, 'x');
+    const DeferredLogStats before = DeferredLog::stats();
+    std::thread([&large, count] {
+        for(int i = 0; i < count; ++i) {
+            LOG_DEFERRED(info, "{} {}", i, large);
+        }
+    }).join();
+    DeferredLog::flush();
+    const DeferredLogStats after = DeferredLog::stats();
+
+    // Every drain that found messages dropped reports how many
+    const std::uint64_t dropped = after.dropped - before.dropped;
+    const std::string warning = " deferred log messages dropped";
+    std::size_t delivered = 0;
+    std::uint64_t reported = 0;
+    for(const std::string& line : collector.lines) {
+        delivered += line.rfind("[info] ", 0) == 0 && line.size() > large.size() ? 1 : 0;
+        if(line.rfind("[warn] ", 0) == 0 && line.size() > warning.size() &&
+           line.compare(line.size() - warning.size(), warning.size(), warning) == 0) {
+            reported += std::strtoull(line.c_str() + 7, nullptr, 10);
+        }
+    }
+    if(dropped == 0 || delivered + dropped != count || reported != dropped) {
+        return 1;
+    }
+
+    // The ring of the exited thread was drained and released
+    if(after.buffers != before.buffers) {
+        return 1;
+    }
+    collector.lines.clear();
+
+    const int threads = 4;
+    const int bursts = 20;
+    std::vector<std::thread> writers;
+    for(int t = 0; t < threads; ++t) {
+        writers.emplace_back([t] {
+            for(int burst = 0; burst < bursts; ++burst) {
+                for(int i = 0; i < 10; ++i) {
+                    LOG_DEFERRED(info, "burst {} {} {}", t, burst, i);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        });
+    }
+    for(auto& writer : writers) {
+        writer.join();
+    }
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while(std::chrono::steady_clock::now() < deadline) {
+        {
+            std::lock_guard<std::mutex> lock(collector.mtx);
+            if(collector.lines.size() >= static_cast<std::size_t>(threads * bursts * 10)) {
+                return collector.lines.size() == static_cast<std::size_t>(threads * bursts * 10) ? 0 : 1;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return 1;
+}
+
+/**
+ * @brief Test function for level changes in the middle of a message
+ *
+ * A message that began while its level was enabled must be logged whole. Insertions made
+ * while the level is disabled and no message is in progress are not kept, the first one
+ * after the level is enabled begins a new message. Neither leaves a fragment in front of
+ * the next message of the thread.
+ */
+int test003() {
+    MessageCollector collector;
+    const LogLevel previous = basic_logging::setLogLevel(LogLevel::Info);
+
+    info << "begun ";
+    basic_logging::setLogLevel(LogLevel::Warning);
+    info << "while " << "disabled" << std::endl;
+
+    info << "dropped ";
+    basic_logging::setLogLevel(LogLevel::Info);
+    info << "begins when enabled" << std::endl;
+    info << "next" << std::endl;
+
+    info << "formatted ";
+    basic_logging::setLogLevel(LogLevel::Warning);
+    LOG_FORMAT(info, "{} of {}", 1, 2);
+    LOG_FORMAT(info, "disabled {}", 3);
+    info.flush();
+
+    basic_logging::setLogLevel(previous);
+    return collector.lines == std::vector<std::string>{ "[info] begun while disabled", "[info] begins when enabled", "[info] next",
+                                                        "[info] formatted 1 of 2" } ? 0 : 1;
+}
+
+/**
+ * @brief Test function for messages written by several threads at once
+ *
+ * Each thread builds its messages from several insertions. Every message must arrive once,
+ * whole, without text of another thread in the middle of it.
+ */
+int test004() {
+    MessageCollector collector;
+    const LogLevel previous = basic_logging::setLogLevel(LogLevel::Info);
+
+    const int threads = 8;
+    const int count = 500;
+    std::vector<std::thread> writers;
+    for(int t = 0; t < threads; ++t) {
+        writers.emplace_back([t, count] {
+            for(int i = 0; i < count; ++i) {
+                info << "thread " << t << " message " << i << " of " << count << std::endl;
+            }
+        });
+    }
+    for(auto& writer : writers) {
+        writer.join();
+    }
+    basic_logging::setLogLevel(previous);
+
+    std::set<std::string> expected;
+    for(int t = 0; t < threads; ++t) {
+        for(int i = 0; i < count; ++i) {
+            expected.insert("[info] thread " + std::to_string(t) + " message " + std::to_string(i) + " of " + std::to_string(count));
+        }
+    }
+    const std::set<std::string> received(collector.lines.begin(), collector.lines.end());
+    return collector.lines.size() == expected.size() && received == expected ? 0 : 1;
+}
+
+/**
+ * @brief Test function for LogModule and configure()
+ *
+ * A module must follow the global level until it is given a level of its own, and again
+ * after resetLevel(). configure() must set the global level and the levels of the modules it
+ * names, reject unknown modules and levels, and apply the other entries. A module logger and
+ * a global logger of the same level must keep their messages apart within a thread.
+ */
+int test005() {
+    MessageCollector collector;
+    const LogLevel previous = basic_logging::setLogLevel(LogLevel::Info);
+    {
+        LogModule net("net");
+        LogModule storage("storage");
+        logging<LogLevel::Debug> netDebug(net);
+        logging<LogLevel::Info> netInfo(net);
+        logging<LogLevel::Debug> storageDebug(storage);
+
+        if(LogModule::find("net") != &net || LogModule::find("none") != nullptr || net.level() != LogLevel::Info) {
+            return 1;
+        }
+        netDebug << "hidden" << std::endl;
+
+        net.setLevel(LogLevel::Debug);
+        netDebug << "net debug" << std::endl;
+        storageDebug << "hidden" << std::endl;
+        debug << "hidden" << std::endl;
+
+        // A module with a level of its own keeps it when the global level changes
+        basic_logging::setLogLevel(LogLevel::Error);
+        netDebug << "kept its level" << std::endl;
+        net.resetLevel();
+        netDebug << "hidden" << std::endl;
+        if(net.level() != LogLevel::Error || storage.level() != LogLevel::Error) {
+            return 1;
+        }
+
+        if(!basic_logging::configure("warn,net=debug") || basic_logging::logLevel() != LogLevel::Warning ||
+           net.level() != LogLevel::Debug || storage.level() != LogLevel::Warning) {
+            return 1;
+        }
+        netDebug << "configured" << std::endl;
+        storageDebug << "hidden" << std::endl;
+        info << "hidden" << std::endl;
+        warn << "global warn" << std::endl;
+
+        if(basic_logging::configure("net=default, unknown=debug, storage=loud") || net.level() != LogLevel::Warning) {
+            return 1;
+        }
+
+        basic_logging::setLogLevel(LogLevel::Info);
+        info << "global ";
+        netInfo << "module" << std::endl;
+        info << "message" << std::endl;
+    }
+    basic_logging::setLogLevel(previous);
+
+    return collector.lines == std::vector<std::string>{ "[debug] net debug", "[debug] kept its level", "[debug] configured",
+                                                        "[warn] global warn", "[info] module", "[info] global message" } ? 0 : 1;
+}
+
+int parseArguments(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <test_number>" << std::endl;
+        return -1;
+    }
+
+    int testNumber = std::atoi(argv[1]);
+    return testNumber;
+}
+
+int main(int argc, char** argv) {
+
+    int testNumber = parseArguments(argc, argv);
+    if (testNumber < 0) {
+        return -1;
+    }
+
+    switch (testNumber) {
+        case 1:
+            return test001();
+
+        case 2:
+            return test002();
+
+        case 3:
+            return test003();
+
+        case 4:
+            return test004();
+
+        case 5:
+            return test005();
+
+        default:
+            std::cerr << "Unknown test number: " << testNumber << std::endl;
+            return -1;
+    }
+}
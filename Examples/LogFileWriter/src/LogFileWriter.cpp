@@ -18,41 +18,119 @@
  */
 #include <LogFileWriterConfig.h>
 #include <LogFileWriter.hpp>
+#include <Logging.hpp>
 #include <CerrRedirect.hpp>
 #include <ClogRedirect.hpp>
+#include <FileSink.hpp>
+#include <MappedSegmentSink.hpp>
 
-#include <atomic>
-#include <condition_variable>
-#include <filesystem>
+#include <iostream>
+#ifndef LIB_CREDIRECT_ENABLE_FILE_SINK
+#include <fstream>
 #include <mutex>
-#include <ostream>
-#include <thread>
+#endif
 
 namespace fs = std::filesystem;
 
+#ifdef USE_MAPPED_LOG
+/**
+ * @brief Lines are copied into memory mapped segments of the log file, which survive a
+ * crash of the process and cost no system call per line.
+ */
+using LogSink = MappedSegmentSink;
+
+static MappedSegmentOptions logFileOptions()
+{
+    MappedSegmentOptions options;
+    options.lineEnding = "\r\n";
+    return options;
+}
+#elif defined(LIB_CREDIRECT_ENABLE_FILE_SINK)
+/**
+ * @brief Lines are written by a FileSink, batched on its writer thread, so neither the
+ * monitor thread nor the writers of the redirected stream wait for the disk. The log is
+ * rotated daily or at 64 MiB, and the last 8 segments are kept.
+ */
+using LogSink = FileSink;
+
+static FileSinkOptions logFileOptions()
+{
+    FileSinkOptions options;
+    options.lineEnding = "\r\n";
+    options.rotateSize = 64 * 1024 * 1024;
+    options.rotateInterval = std::chrono::hours(24);
+    options.maxSegments = 8;
+    return options;
+}
+#else
+/**
+ * @brief Without the file sinks the lines are appended to a std::ofstream under a mutex,
+ * on the thread that delivers them.
+ */
+class HIDDEN LogSink {
+public:
+    explicit LogSink(const std::string& fileName) :
+        fileName(fileName),
+        file(fileName, std::ios::out | std::ios::app) {}
+
+    bool active() const { return file.is_open(); }
+
+    void update(std::string_view message) { updateBatch(&message, 1); }
+
+    void updateBatch(const std::string_view* messages, std::size_t count)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!file.is_open()) {
+            file.open(fileName, std::ios::out | std::ios::app);
+            if (!file.is_open()) {
+                std::cerr << "Log file is not open: " + fileName;
+                return;
+            }
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            file.write(messages[i].data(), messages[i].size());
+            file << "\r\n";
+        }
+    }
+
+    void reopen(const std::string& newFileName)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        file.close();
+        fileName = newFileName;
+        file.open(fileName, std::ios::out | std::ios::app);
+    }
+
+private:
+    std::string fileName;
+    std::ofstream file;
+    std::mutex mtx;
+};
+#endif
+
 struct HIDDEN LogFileWriter::LogFileWriterPimpl {
-    std::ofstream logFile;
+    explicit LogFileWriterPimpl(const fs::path& logFileName) :
+        logFileName(logFileName),
+#ifdef LIB_CREDIRECT_ENABLE_FILE_SINK
+        sink(logFileName.string(), logFileOptions()) {}
+#else
+        sink(logFileName.string()) {}
+#endif
+
     fs::path logFileName;
-    std::thread flushThread;
-    std::atomic<bool> terminate;
-    std::atomic<int> flushInterval;
-    std::mutex mtx;
-    std::condition_variable cv;
+    LogSink sink;
 };
 
 LogFileWriter::LogFileWriter(const fs::path& logFileName) 
 {
-    d = new LogFileWriterPimpl();
-    d->logFileName = logFileName;
-    d->logFile.open(logFileName, std::ios::out | std::ios::app);
+    d = new LogFileWriterPimpl(logFileName);
     
-    if (!d->logFile.is_open()) {
+    if (!d->sink.active()) {
         std::cerr << "Unable to open log file: " + logFileName.string();
     }
 
-    d->terminate = false;
-    d->flushInterval = 10;
-    d->flushThread = std::thread(LogFileWriter::flushLogfile, d);
+    // Log messages are published to the file directly instead of going through std::clog
+    basic_logging::router().attach(this, MessageRouter::kAll, destinationMask(LogDestination::Log));
 
 #ifdef USE_CLOG_REDIRECT
     ClogRedirect::attach(this);
@@ -64,51 +142,33 @@ LogFileWriter::LogFileWriter(const fs::path& logFileName)
 
 LogFileWriter::~LogFileWriter()
 {
+    basic_logging::router().detach(this);
 #ifdef USE_CLOG_REDIRECT
     ClogRedirect::detach(this);
 #endif
 #ifdef USE_CERR_REDIRECT
     CerrRedirect::detach(this);
 #endif
-    d->terminate = true;
-    d->cv.notify_all();
-    if(d->flushThread.joinable()) {
-        d->flushThread.join();
-    }
-    if (d->logFile.is_open()) {
-        d->logFile.close();
-    }
     delete d;
 }
 
-void HIDDEN LogFileWriter::flushLogfile(LogFileWriterPimpl* d) 
+void LogFileWriter::update(std::string_view message)
 {
-    std::unique_lock<std::mutex> lock(d->mtx);
-    while(!d->terminate) {
-        d->cv.wait_for(lock, 
-            std::chrono::seconds(d->flushInterval), 
-            [d] { return d->terminate.load(); }
-        );
-        
-        if(d->terminate) break;;
-
-        if(d->logFile.is_open()) {
-            d->logFile.flush();
-        }
-    }
-    return;
+    d->sink.update(message);
 }
 
-void LogFileWriter::update(const std::string& message)
+void LogFileWriter::updateBatch(const std::string_view* messages, std::size_t count)
 {
-    std::unique_lock<std::mutex> lock(d->mtx);
-    if (!d->logFile.is_open()) {
-        d->logFile.open(d->logFileName, std::ios::out | std::ios::app);
-        if(!d->logFile.is_open()) {
-            std::cerr << "Log file is not open: " + d->logFileName.string();
-            return;
-        }
-    }
+    d->sink.updateBatch(messages, count);
+}
 
-    d->logFile << message << "\r\n";
+void LogFileWriter::changeLogFileName(const std::string& newLogFileName)
+{
+#ifdef USE_MAPPED_LOG
+    std::cerr << "Mapped log segments keep their name: " + d->logFileName.string();
+#else
+    // The new file is opened in the background, lines go to the old one until it is ready
+    d->sink.reopen(newLogFileName);
+    d->logFileName = newLogFileName;
+#endif
 }
@@ -21,25 +21,24 @@
 
 #include <LogFileWriterConfig.h>
 #include <filesystem>
-#include <fstream>
 #include <string>
-#include <StreamObserver.hpp>
+#include <string_view>
+#include <LineObserver.hpp>
 
 namespace fs = std::filesystem;
 
-class LogFileWriter : public StreamObserver {
+class LogFileWriter : public LineObserver {
 public:
     LogFileWriter(const fs::path& logFileName);
     ~LogFileWriter();
 
-    void update(const std::string& message) override;
+    void update(std::string_view message) override;
+    void updateBatch(const std::string_view* messages, std::size_t count) override;
     void changeLogFileName(const std::string& newLogFileName);
 
 private:
     struct LogFileWriterPimpl;
     struct LogFileWriterPimpl *d;
-    
-    static void flushLogfile(LogFileWriterPimpl* d);
 };
 
 #endif // LOG_FILE_WRITER_HPP
\ No newline at end of file
@@ -20,12 +20,216 @@
 #include <LogFileWriterConfig.h>
 #include "Logging.hpp"
 
-/**
- * @brief Set the current logging level.
- * @param newLevel The new logging level to set.
- * @return The previous logging level.
- */
-LogLevel basic_logging::_curLogLevel = MIN_LEVEL;
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+std::atomic<LogLevel> basic_logging::_curLogLevel{MIN_LEVEL};
+
+namespace {
+    /**
+     * @brief Number of loggers a thread keeps a buffer for before it reuses the idle ones.
+     */
+    constexpr std::size_t kPendingLimit = 16;
+
+    /**
+     * @brief Registered modules, a fixed table of atomic pointers so that it can be searched from a signal handler.
+     */
+    std::atomic<LogModule*> modules[LogModule::kMaxModules];
+
+    std::string_view trim(std::string_view text) {
+        while(!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+            text.remove_prefix(1);
+        }
+        while(!text.empty() && (text.back() == ' ' || text.back() == '\t')) {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    /**
+     * @brief Splits a message into its lines, without the newline that ends it.
+     */
+    void splitLines(std::string_view text, std::vector<std::string_view>& lines) {
+        if(!text.empty() && text.back() == '\n') {
+            text.remove_suffix(1);
+        }
+        for(std::size_t end; (end = text.find('\n')) != std::string_view::npos; text.remove_prefix(end + 1)) {
+            lines.push_back(text.substr(0, end));
+        }
+        lines.push_back(text);
+    }
+}
+
+LogLevel basic_logging::setLogLevel(LogLevel newLevel) {
+    const LogLevel previous = _curLogLevel.exchange(newLevel, std::memory_order_relaxed);
+    for(const auto& slot : modules) {
+        LogModule* module = slot.load(std::memory_order_acquire);
+        if(module && module->_inherits.load(std::memory_order_relaxed)) {
+            module->_threshold.store(newLevel, std::memory_order_relaxed);
+        }
+    }
+    return previous;
+}
+
+bool basic_logging::parseLevel(std::string_view name, LogLevel& level) {
+    static constexpr struct {
+        std::string_view name;
+        LogLevel level;
+    } names[] = {
+        { "debug", LogLevel::Debug }, { "info", LogLevel::Info }, { "audit", LogLevel::Audit },
+        { "warn", LogLevel::Warning }, { "warning", LogLevel::Warning }, { "error", LogLevel::Error },
+        { "crit", LogLevel::Critical }, { "critical", LogLevel::Critical },
+    };
+    for(const auto& entry : names) {
+        if(entry.name == name) {
+            level = entry.level;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool basic_logging::configure(std::string_view levels) {
+    bool understood = true;
+    while(!levels.empty()) {
+        const std::size_t comma = levels.find(',');
+        const std::string_view entry = trim(levels.substr(0, comma));
+        levels = comma == std::string_view::npos ? std::string_view() : levels.substr(comma + 1);
+        if(entry.empty()) {
+            continue;
+        }
+
+        const std::size_t equals = entry.find('=');
+        const std::string_view value = trim(equals == std::string_view::npos ? entry : entry.substr(equals + 1));
+        LogLevel level;
+        if(equals == std::string_view::npos) {
+            if(parseLevel(value, level)) {
+                setLogLevel(level);
+            } else {
+                understood = false;
+            }
+            continue;
+        }
+
+        LogModule* module = LogModule::find(trim(entry.substr(0, equals)));
+        if(module && value == "default") {
+            module->resetLevel();
+        } else if(module && parseLevel(value, level)) {
+            module->setLevel(level);
+        } else {
+            understood = false;
+        }
+    }
+    return understood;
+}
+
+LogModule::LogModule(std::string_view name) :
+    _nameLength(std::min(name.size(), kMaxName)),
+    _threshold(basic_logging::logLevel()),
+    _inherits(true),
+    _slot(kMaxModules) {
+    std::memcpy(_name, name.data(), _nameLength);
+    if(find(this->name())) {
+        return;
+    }
+    for(std::size_t i = 0; i < kMaxModules; ++i) {
+        LogModule* expected = nullptr;
+        if(modules[i].compare_exchange_strong(expected, this, std::memory_order_acq_rel)) {
+            _slot = i;
+            break;
+        }
+    }
+    // A global level set while registering may have been missed
+    if(_inherits.load(std::memory_order_relaxed)) {
+        _threshold.store(basic_logging::logLevel(), std::memory_order_relaxed);
+    }
+}
+
+LogModule::~LogModule() {
+    if(_slot < kMaxModules) {
+        modules[_slot].store(nullptr, std::memory_order_release);
+    }
+}
+
+LogModule* LogModule::find(std::string_view name) {
+    for(const auto& slot : modules) {
+        LogModule* module = slot.load(std::memory_order_acquire);
+        if(module && module->name() == name) {
+            return module;
+        }
+    }
+    return nullptr;
+}
+
+basic_logging::Pending& basic_logging::pending(const void* owner, LogLevel level, std::uint32_t destinations) {
+    thread_local std::vector<std::unique_ptr<Pending>> messages;
+    thread_local Pending* last = nullptr;
+    if(last && last->owner == owner && last->level == level) {
+        return *last;
+    }
+
+    Pending* idle = nullptr;
+    for(const auto& message : messages) {
+        if(message->owner == owner && message->level == level) {
+            return *(last = message.get());
+        }
+        if(!idle && !message->started && message->buffer.text.empty()) {
+            idle = message.get();
+        }
+    }
+    if(idle && messages.size() >= kPendingLimit) {
+        static const std::ostream defaults(nullptr);
+        idle->owner = owner;
+        idle->level = level;
+        idle->destinations = destinations;
+        idle->stream.copyfmt(defaults);
+        return *(last = idle);
+    }
+    messages.push_back(std::make_unique<Pending>(owner, level, destinations));
+    return *(last = messages.back().get());
+}
+
+MessageRouter& basic_logging::router() {
+    static MessageRouter instance;
+    return instance;
+}
+
+bool basic_logging::emit(std::string_view text, LogLevel level, std::uint32_t destinations, bool complete) {
+    const unsigned index = static_cast<unsigned>(level);
+    std::uint32_t routed = router().coverage(index) & destinations;
+    if(routed) {
+        if(!complete) {
+            return false;
+        }
+        bool delivered;
+        const std::string_view line = text.substr(0, text.find('\n'));
+        if(line.size() + 1 >= text.size()) {
+            delivered = router().publish(line, index, routed);
+        } else {
+            std::vector<std::string_view> lines;
+            splitLines(text, lines);
+            delivered = router().publish(lines.data(), lines.size(), index, routed);
+        }
+        // The last observer detached since the coverage was read
+        routed = delivered ? routed : 0;
+    }
+    write(text, destinations & ~routed);
+    return true;
+}
+
+void basic_logging::write(std::string_view text, std::uint32_t destinations) {
+    const std::streamsize size = static_cast<std::streamsize>(text.size());
+    if(destinations & destinationMask(LogDestination::Error)) {
+        std::cerr.write(text.data(), size).flush();
+    }
+    if(destinations & destinationMask(LogDestination::Log)) {
+        std::clog.write(text.data(), size).flush();
+    }
+    if(destinations & destinationMask(LogDestination::Console)) {
+        std::cout.write(text.data(), size).flush();
+    }
+}
 
 /**
  * @brief Logging instances for different log levels.
@@ -46,3 +250,275 @@ logging<LogLevel::Warning>  warn;
 logging<LogLevel::Error>    err;
 logging<LogLevel::Critical> crit;
 logging<LogLevel::Audit>    audit;
+
+/**
+ * @struct DeferredLog::Consumer
+ * @brief Background thread of DeferredLog and the rings it drains.
+ *
+ * `mtx` only guards the list of rings, the flush tickets and the counters. The rings are
+ * drained and their records formatted without it, so attach(), flush() and stats() never
+ * wait for the formatting.
+ *
+ * @details
+ * - `buffers`: Rings of the threads that have logged, removed once a retired ring is drained.
+ * - `rings`, `retired`: The rings of the current drain, and those of them to remove after it.
+ * - `text`, `messages`: Messages formatted by the last drain, delivered without holding `mtx`.
+ * - `requested`, `done`: Flush tickets handed out by flush() and the last one completed.
+ * - `totalDropped`: Dropped messages since the start, for stats().
+ * - `sleeping`: Set while the thread waits for a record, cleared by the producer that wakes it.
+ */
+struct DeferredLog::Consumer {
+    /**
+     * @brief A formatted message, the range of `text` it occupies including its newline.
+     */
+    struct Message {
+        std::size_t begin;
+        std::size_t end;
+        LogLevel level;
+        std::uint32_t destinations;
+    };
+
+    Consumer() : requested(0), done(0), totalDropped(0), sleeping(false), stopping(false) {
+        // The router must outlive the thread publishing to it
+        basic_logging::router();
+        thread = std::thread(&Consumer::run, this);
+    }
+
+    ~Consumer() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        thread.join();
+    }
+
+    static Consumer& instance() {
+        static Consumer consumer;
+        return consumer;
+    }
+
+    /**
+     * @brief Formats the records of a ring into `text` and `messages`.
+     * @return The number of messages dropped from the ring since the last drain.
+     */
+    std::uint64_t drain(Buffer& buffer) {
+        std::uint64_t tail = buffer.tail.load(std::memory_order_relaxed);
+        const std::uint64_t head = buffer.head.load(std::memory_order_acquire);
+        while(tail < head) {
+            const char* record = buffer.data + (tail & (Buffer::kSize - 1));
+            std::uint32_t size;
+            std::memcpy(&size, record, sizeof(size));
+            if(size == kWrap) {
+                tail += Buffer::kSize - (tail & (Buffer::kSize - 1));
+                continue;
+            }
+
+            Header header;
+            std::memcpy(&header, record, sizeof(header));
+            const std::size_t begin = text.size();
+            text += header.site->prefix;
+            header.site->decode(*header.site, record + sizeof(header), text);
+            text += '\n';
+            messages.push_back(Message{ begin, text.size(), header.site->level, header.site->destinations });
+            tail += size;
+        }
+        buffer.tail.store(tail, std::memory_order_release);
+        return buffer.dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Appends a formatted message to the streams of the destinations in the mask.
+     */
+    void append(const Message& message, std::uint32_t destinations) {
+        const std::string_view line(text.data() + message.begin, message.end - message.begin);
+        for(unsigned destination = 0; destination < kDestinations; ++destination) {
+            if(destinations & (1u << destination)) {
+                streams[destination].append(line);
+            }
+        }
+    }
+
+    /**
+     * @brief Returns true if a ring holds records that were not drained, called with `mtx` held.
+     */
+    bool pending() const {
+        for(const auto& buffer : buffers) {
+            if(buffer->head.load(std::memory_order_relaxed) != buffer->tail.load(std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Publishes runs of messages with the same level and subscribed destinations as one
+     * batch, and writes what nobody subscribed to with one write per stream.
+     */
+    void deliver() {
+        MessageRouter& router = basic_logging::router();
+        std::uint32_t coverage[static_cast<unsigned>(LogLevel::Critical) + 1];
+        for(unsigned level = 0; level <= static_cast<unsigned>(LogLevel::Critical); ++level) {
+            coverage[level] = router.coverage(level);
+        }
+
+        unsigned runLevel = 0;
+        std::uint32_t runDestinations = 0;
+        std::size_t runBegin = 0;
+        auto publish = [&](std::size_t runEnd) {
+            if(!router.publish(lines.data(), lines.size(), runLevel, runDestinations)) {
+                // The last observer detached since the coverage was read, like emit() write the run instead
+                for(std::size_t i = runBegin; i < runEnd; ++i) {
+                    append(messages[i], runDestinations);
+                }
+            }
+            lines.clear();
+        };
+        for(std::size_t i = 0; i < messages.size(); ++i) {
+            const Message& message = messages[i];
+            const unsigned level = static_cast<unsigned>(message.level);
+            const std::uint32_t routed = coverage[level] & message.destinations;
+            if(!lines.empty() && (level != runLevel || routed != runDestinations)) {
+                publish(i);
+            }
+            if(routed) {
+                if(lines.empty()) {
+                    runBegin = i;
+                }
+                splitLines(std::string_view(text.data() + message.begin, message.end - message.begin), lines);
+                runLevel = level;
+                runDestinations = routed;
+            }
+            append(message, message.destinations & ~routed);
+        }
+        if(!lines.empty()) {
+            publish(messages.size());
+        }
+
+        // Same order as the stream front end
+        for(LogDestination destination : { LogDestination::Error, LogDestination::Log, LogDestination::Console }) {
+            std::string& stream = streams[static_cast<unsigned>(destination)];
+            if(!stream.empty()) {
+                basic_logging::write(stream, destinationMask(destination));
+                stream.clear();
+            }
+        }
+        text.clear();
+        messages.clear();
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mtx);
+
+        for(;;) {
+            const std::uint64_t ticket = requested;
+            const bool stop = stopping;
+            // Only this thread removes rings, the ones listed stay valid while the lock is released
+            rings.clear();
+            for(const auto& buffer : buffers) {
+                rings.push_back(buffer.get());
+            }
+            lock.unlock();
+
+            std::uint64_t dropped = 0;
+            retired.clear();
+            for(Buffer* ring : rings) {
+                // Read the flag first, a ring retired after the drain is drained again next time
+                if(ring->retired.load(std::memory_order_acquire)) {
+                    retired.push_back(ring);
+                }
+                dropped += drain(*ring);
+            }
+            if(dropped > 0) {
+                const std::size_t begin = text.size();
+                text += "[warn] " + std::to_string(dropped) + " deferred log messages dropped\n";
+                messages.push_back(Message{ begin, text.size(), LogLevel::Warning, logging<LogLevel::Warning>::destinations() });
+            }
+            deliver();
+
+            lock.lock();
+            totalDropped += dropped;
+            buffers.erase(std::remove_if(buffers.begin(), buffers.end(), [this](const std::unique_ptr<Buffer>& buffer) {
+                return std::find(retired.begin(), retired.end(), buffer.get()) != retired.end();
+            }), buffers.end());
+            done = ticket;
+            flushed.notify_all();
+            if(stop) {
+                break;
+            }
+            if(requested != done || stopping) {
+                continue;
+            }
+
+            // Pairs with the fence of record(), so that either a producer sees this thread
+            // asleep or this sees its record
+            sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(!pending()) {
+                wakeup.wait(lock, [this] {
+                    return !sleeping.load(std::memory_order_relaxed) || requested != done || stopping;
+                });
+            }
+            sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    static constexpr unsigned kDestinations = static_cast<unsigned>(LogDestination::Error) + 1;
+
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    std::vector<Buffer*> rings;
+    std::vector<Buffer*> retired;
+    std::string text;
+    std::vector<Message> messages;
+    std::vector<std::string_view> lines;
+    std::string streams[kDestinations];
+    std::uint64_t requested;
+    std::uint64_t done;
+    std::uint64_t totalDropped;
+    std::atomic<bool> sleeping;
+    bool stopping;
+    std::mutex mtx;
+    std::condition_variable wakeup;
+    std::condition_variable flushed;
+    std::thread thread;
+};
+
+/**
+ * @brief Creates the ring of the calling thread and hands it to the background thread.
+ * @return The ring, used by the thread until it exits.
+ */
+DeferredLog::Buffer* DeferredLog::attach() {
+    Consumer& consumer = Consumer::instance();
+    auto buffer = std::make_unique<Buffer>();
+    current.buffer = buffer.get();
+
+    std::lock_guard<std::mutex> lock(consumer.mtx);
+    consumer.buffers.push_back(std::move(buffer));
+    return current.buffer;
+}
+
+void DeferredLog::wake() {
+    Consumer& consumer = Consumer::instance();
+    if(consumer.sleeping.load(std::memory_order_relaxed) && consumer.sleeping.exchange(false, std::memory_order_relaxed)) {
+        // Taking the lock orders the notification after the thread checked its predicate
+        { std::lock_guard<std::mutex> lock(consumer.mtx); }
+        consumer.wakeup.notify_one();
+    }
+}
+
+void DeferredLog::flush() {
+    Consumer& consumer = Consumer::instance();
+    std::unique_lock<std::mutex> lock(consumer.mtx);
+    const std::uint64_t ticket = ++consumer.requested;
+    consumer.wakeup.notify_one();
+    consumer.flushed.wait(lock, [&] { return consumer.done >= ticket; });
+}
+
+DeferredLogStats DeferredLog::stats() {
+    Consumer& consumer = Consumer::instance();
+    std::lock_guard<std::mutex> lock(consumer.mtx);
+    DeferredLogStats stats;
+    stats.dropped = consumer.totalDropped;
+    stats.buffers = consumer.buffers.size();
+    return stats;
+}
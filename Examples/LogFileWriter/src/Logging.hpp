@@ -19,13 +19,23 @@
 #ifndef LOGGING_HPP
 #define LOGGING_HPP
 #include <LogFileWriterConfig.h>
+#include <MessageRouter.hpp>
+#include <algorithm>
 #include <atomic>
+#include <charconv>
 #include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 /**
  * @enum LogLevel
@@ -42,6 +52,25 @@ enum class LogLevel {
 
 #define MIN_LEVEL LogLevel::Debug
 
+/**
+ * @enum LogDestination
+ * @brief Outputs a message can be routed to, numbered as MessageRouter destinations.
+ */
+enum class LogDestination {
+    Console,    /**< Standard output. */
+    Log,        /**< The log file, std::clog when nothing subscribed to it. */
+    Error       /**< Standard error, for critical messages. */
+};
+
+/**
+ * @brief Returns the MessageRouter destination mask of a LogDestination.
+ */
+constexpr std::uint32_t destinationMask(LogDestination destination) {
+    return 1u << static_cast<unsigned>(destination);
+}
+
+static_assert(std::atomic<LogLevel>::is_always_lock_free, "log levels must be changeable from a signal handler");
+
 /**
  * @class basic_logging
  * @brief Base class for logging functionality.
@@ -49,11 +78,65 @@ enum class LogLevel {
 class basic_logging
 {
 public:
-    static LogLevel setLogLevel(LogLevel newLevel){
-        LogLevel tll = _curLogLevel;
-        _curLogLevel = newLevel;
-        return tll;
-    };
+    /**
+     * @brief Sets the level of the global loggers and of the modules without a level of their own.
+     *
+     * Lock free and async-signal-safe, so it may be called from a signal handler.
+     * @param newLevel The new logging level to set.
+     * @return The previous logging level.
+     */
+    static LogLevel setLogLevel(LogLevel newLevel);
+
+    /**
+     * @brief Returns the level of the global loggers.
+     */
+    static LogLevel logLevel() {
+        return _curLogLevel.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Applies a comma separated list of levels, for example "info,network=debug,storage=error".
+     *
+     * A level alone sets the global level, name=level sets the level of a module and
+     * name=default makes the module follow the global level again. It neither locks nor
+     * allocates, so it may also be called from a signal handler.
+     * @param levels The list of levels.
+     * @return false if an entry names an unknown module or level, the other entries are applied.
+     */
+    static bool configure(std::string_view levels);
+
+    /**
+     * @brief Parses a level name such as "debug" or "warn".
+     * @return false if the name is not a level.
+     */
+    static bool parseLevel(std::string_view name, LogLevel& level);
+
+    /**
+     * @brief Router every message is published to once, tagged with its level and destinations.
+     *
+     * Observers subscribe by LogLevel and LogDestination. Destinations nobody subscribed to
+     * are written to their standard stream instead.
+     */
+    static MessageRouter& router();
+
+    /**
+     * @brief Publishes a message to the router and writes it to the streams of the destinations nobody subscribed to.
+     *
+     * Observers receive whole lines, so an incomplete message for a subscribed destination is
+     * not handed over and false is returned, the caller keeps it until it is completed.
+     *
+     * @param text The message, ending with a newline when complete.
+     * @param level Level of the message.
+     * @param destinations Mask of the destinations of the message.
+     * @param complete Whether the message is finished.
+     * @return true if the message was handed over.
+     */
+    static bool emit(std::string_view text, LogLevel level, std::uint32_t destinations, bool complete);
+
+    /**
+     * @brief Writes text to the standard stream of every destination in the mask, one write each.
+     */
+    static void write(std::string_view text, std::uint32_t destinations);
 
 protected:
     /**
@@ -66,8 +149,618 @@ protected:
      */
     ~basic_logging() {};
 
+    struct Pending;
+
+    /**
+     * @brief Returns the message the calling thread is formatting for a logger, created on first use.
+     *
+     * Every logger has a buffer of its own in every thread that logs through it, so the
+     * messages of a module logger and of a global logger of the same level never mix. Once
+     * a thread has used many loggers, the buffer of one without a message in progress is
+     * handed to the next new logger, so short lived loggers do not pile up buffers. A logger
+     * must not be destroyed while a thread has a message in progress through it.
+     * @param owner The logger.
+     * @param level Level the messages of the logger are published with.
+     * @param destinations Mask of the destinations of the messages of the logger.
+     */
+    static Pending& pending(const void* owner, LogLevel level, std::uint32_t destinations);
+
 protected:
-    static LogLevel _curLogLevel; /**< Current logging level. */
+    static std::atomic<LogLevel> _curLogLevel; /**< Current logging level, only ever read with relaxed loads. */
+
+    /**
+     * @brief Number of messages the calling thread has begun and not finished, over all loggers.
+     *
+     * Constant initialised, so reading it costs no more than a plain load.
+     */
+    static inline thread_local unsigned _openMessages = 0;
+};
+
+/**
+ * @class LogModule
+ * @brief A named subsystem with a logging level of its own.
+ *
+ * Loggers constructed with a module filter on its level instead of the global one, so one
+ * subsystem can be raised to debug without flooding the log with everything else. A module
+ * follows the global level until it is given a level of its own. Modules are registered
+ * by name in a fixed table that is searched without a lock, so levels can be changed from
+ * a signal handler or an admin command while the application logs.
+ *
+ * @code
+ * LogModule network("network");
+ * logging<LogLevel::Debug> netDebug(network);
+ * netDebug << "connected to " << host << std::endl;
+ * @endcode
+ */
+class LogModule {
+public:
+    static constexpr std::size_t kMaxModules = 64;  /**< Number of modules that can be registered at once. */
+    static constexpr std::size_t kMaxName = 32;     /**< Longest module name, longer names are truncated. */
+
+    /**
+     * @brief Registers the module, it starts at the global level.
+     *
+     * A module that cannot be registered, because the table is full or the name is taken,
+     * still filters but can only be changed through the object itself.
+     * @param name Name the module is found by.
+     */
+    explicit LogModule(std::string_view name);
+
+    /**
+     * @brief Unregisters the module, the loggers using it must not log any more.
+     */
+    ~LogModule();
+
+    std::string_view name() const {
+        return std::string_view(_name, _nameLength);
+    }
+
+    /**
+     * @brief Returns the level the module filters on.
+     */
+    LogLevel level() const {
+        return _threshold.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Gives the module a level of its own, async-signal-safe.
+     * @return The previous level.
+     */
+    LogLevel setLevel(LogLevel level) {
+        _inherits.store(false, std::memory_order_relaxed);
+        return _threshold.exchange(level, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Makes the module follow the global level again, async-signal-safe.
+     */
+    void resetLevel() {
+        _inherits.store(true, std::memory_order_relaxed);
+        _threshold.store(basic_logging::logLevel(), std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Returns the level loggers of this module compare against.
+     */
+    const std::atomic<LogLevel>& threshold() const {
+        return _threshold;
+    }
+
+    /**
+     * @brief Finds a registered module by name, async-signal-safe.
+     * @return The module, or nullptr if there is none by that name.
+     */
+    static LogModule* find(std::string_view name);
+
+private:
+    friend class basic_logging;
+
+    LogModule(const LogModule&) = delete;
+    LogModule& operator=(const LogModule&) = delete;
+
+    char _name[kMaxName];
+    std::size_t _nameLength;
+    std::atomic<LogLevel> _threshold;   /**< Effective level, the only thing a logger reads. */
+    std::atomic<bool> _inherits;        /**< Whether setLogLevel() changes the level. */
+    std::size_t _slot;                  /**< Index in the registry, kMaxModules if not registered. */
+};
+
+/**
+ * @class LogFormat
+ * @brief Format strings parsed at compile time, shared by LOG_FORMAT and LOG_DEFERRED.
+ *
+ * In a format string each {} is replaced by the next argument, {{ and }} stand for { and }.
+ * Every call site parses its format string at compile time into literal segments and
+ * placeholders, and checks its arguments against them: an unmatched brace, a missing or
+ * extra argument, or an argument that cannot be formatted is a compile error. Formatting
+ * then appends the segments and the arguments without scanning the format string, into a
+ * buffer reserved from the size of the segments.
+ */
+class LogFormat {
+    template<typename T, typename = void>
+    struct Streamable : std::false_type {};
+
+    template<typename T>
+    struct Streamable<T, std::void_t<decltype(std::declval<std::ostream&>() << std::declval<const T&>())>> : std::true_type {};
+
+public:
+    /**
+     * @brief A literal segment of a format string, or a placeholder.
+     */
+    struct Piece {
+        std::size_t offset = 0;     /**< Start of the segment in the format string. */
+        std::size_t length = 0;     /**< Length of the segment. */
+        bool argument = false;      /**< Whether this is a placeholder rather than a segment. */
+    };
+
+    /**
+     * @brief A format string parsed into its pieces.
+     * @tparam N Capacity, pieces past it are counted but not stored so that a first pass
+     *           gives the exact number of pieces to size the array with.
+     */
+    template<std::size_t N>
+    struct Layout {
+        Piece pieces[N] = {};
+        std::size_t count = 0;          /**< Number of pieces, including those past the capacity. */
+        std::size_t arguments = 0;      /**< Number of placeholders. */
+        std::size_t literalSize = 0;    /**< Total length of the literal segments. */
+        bool valid = true;              /**< False if a brace is neither a placeholder nor escaped. */
+
+        constexpr explicit Layout(const char* format) {
+            std::size_t start = 0;
+            std::size_t i = 0;
+            while(format[i]) {
+                if(format[i] == '{' && format[i + 1] == '}') {
+                    literal(start, i);
+                    add(Piece{ i, 0, true });
+                    ++arguments;
+                    i += 2;
+                    start = i;
+                } else if((format[i] == '{' && format[i + 1] == '{') || (format[i] == '}' && format[i + 1] == '}')) {
+                    // Keep the first brace of the pair
+                    literal(start, i + 1);
+                    i += 2;
+                    start = i;
+                } else {
+                    valid = valid && format[i] != '{' && format[i] != '}';
+                    ++i;
+                }
+            }
+            literal(start, i);
+        }
+
+        constexpr void literal(std::size_t begin, std::size_t end) {
+            if(end > begin) {
+                add(Piece{ begin, end - begin, false });
+                literalSize += end - begin;
+            }
+        }
+
+        constexpr void add(const Piece& piece) {
+            if(count < N) {
+                pieces[count] = piece;
+            }
+            ++count;
+        }
+    };
+
+    /**
+     * @brief True if an argument of type T can be formatted, in binary form or with its operator<<.
+     */
+    template<typename T>
+    static constexpr bool formattable = std::is_arithmetic_v<std::decay_t<T>> || std::is_pointer_v<std::decay_t<T>> ||
+                                        std::is_same_v<std::decay_t<T>, std::string> ||
+                                        std::is_same_v<std::decay_t<T>, std::string_view> || Streamable<T>::value;
+
+    /**
+     * @brief Parses the format string returned by a call site and checks the arguments against it.
+     * @tparam Args The types of the arguments of the log statement.
+     * @param site Captureless lambda returning the format string literal.
+     */
+    template<typename... Args, typename Site>
+    static constexpr auto parse(Site site) {
+        // A format string without pieces still needs an array of one
+        constexpr std::size_t count = Layout<1>(site()).count;
+        constexpr Layout<count ? count : 1> layout(site());
+        static_assert(layout.valid, "log format string has a { or } that is not part of {}, {{ or }}");
+        static_assert(layout.arguments == sizeof...(Args), "log statement needs exactly one argument per {} in its format string");
+        static_assert((formattable<Args> && ...), "log argument has no operator<<");
+        return layout;
+    }
+
+    /**
+     * @brief Formats a message from its parsed format string and the arguments, appending it to out.
+     * @param pieces The pieces of the format string, with one placeholder per value.
+     * @param count Number of pieces.
+     * @param format The format string.
+     * @param out String the message is appended to.
+     * @param values Arguments, of the types appendValue() takes.
+     */
+    template<typename... Values>
+    static void format(const Piece* pieces, std::size_t count, const char* format, std::string& out, const Values&... values) {
+        std::size_t piece = 0;
+        ((piece = appendLiterals(pieces, count, piece, format, out), appendValue(values, out)), ...);
+        appendLiterals(pieces, count, piece, format, out);
+    }
+
+    /**
+     * @brief Returns how many characters a value is likely to take once formatted.
+     */
+    template<typename T>
+    static constexpr std::size_t sizeHint(const T& value) {
+        if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) {
+            return value.size();
+        } else if constexpr (std::is_same_v<T, char> || std::is_same_v<T, signed char> ||
+                             std::is_same_v<T, unsigned char> || std::is_same_v<T, bool>) {
+            return 1;
+        } else if constexpr (std::is_arithmetic_v<T> || std::is_same_v<T, const void*>) {
+            return 24;
+        } else {
+            return 0;
+        }
+    }
+
+    /**
+     * @brief Appends a value formatted as operator<< would with the default flags.
+     */
+    template<typename T>
+    static void appendValue(const T& value, std::string& out) {
+        char text[64];
+        int length = 0;
+        if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) {
+            out.append(value.data(), value.size());
+        } else if constexpr (std::is_same_v<T, const char*>) {
+            out.append(value ? value : "");
+        } else if constexpr (std::is_same_v<T, char> || std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>) {
+            out += static_cast<char>(value);
+        } else if constexpr (std::is_same_v<T, bool>) {
+            out += value ? '1' : '0';
+        } else if constexpr (std::is_integral_v<T>) {
+            length = static_cast<int>(std::to_chars(text, text + sizeof(text), value).ptr - text);
+        } else if constexpr (std::is_same_v<T, long double>) {
+            length = std::snprintf(text, sizeof(text), "%Lg", value);
+        } else if constexpr (std::is_floating_point_v<T>) {
+            length = std::snprintf(text, sizeof(text), "%g", static_cast<double>(value));
+        } else {
+            length = std::snprintf(text, sizeof(text), "%p", value);
+        }
+        out.append(text, static_cast<std::size_t>(std::max(length, 0)));
+    }
+
+private:
+    /**
+     * @brief Appends the segments up to the next placeholder, returns the index of the piece after it.
+     */
+    static std::size_t appendLiterals(const Piece* pieces, std::size_t count, std::size_t piece, const char* format, std::string& out) {
+        for(; piece < count && !pieces[piece].argument; ++piece) {
+            out.append(format + pieces[piece].offset, pieces[piece].length);
+        }
+        return piece + 1;
+    }
+};
+
+/**
+ * @struct DeferredSite
+ * @brief Static description of one deferred log statement, its address identifies the call site.
+ */
+struct DeferredSite {
+    const char* prefix;     /**< Level tag written before the message. */
+    const char* format;     /**< Format string, each {} is replaced by the next argument. */
+    const LogFormat::Piece* pieces; /**< The format string parsed at compile time. */
+    std::size_t pieceCount; /**< Number of pieces. */
+    LogLevel level;         /**< Level the message is published with. */
+    std::uint32_t destinations; /**< Mask of the destinations of the message. */
+
+    /**
+     * @brief Appends the message, formatted from the recorded arguments, to out.
+     */
+    void (*decode)(const DeferredSite& site, const char* args, std::string& out);
+};
+
+/**
+ * @struct DeferredLogStats
+ * @brief Counters of DeferredLog.
+ */
+struct DeferredLogStats {
+    std::uint64_t dropped = 0;  /**< Messages dropped because the ring of their thread was full. */
+    std::size_t buffers = 0;    /**< Rings of running threads, and of exited ones not drained yet. */
+};
+
+/**
+ * @class DeferredLog
+ * @brief Records log statements in binary form and formats them on a background thread.
+ *
+ * The calling thread only copies the raw arguments and the address of the static
+ * DeferredSite into a ring of its own, which takes a few tens of nanoseconds and never
+ * takes a lock. A background thread sleeps until a ring it has drained receives a record,
+ * then formats the messages and publishes them through basic_logging::router() in batches,
+ * writing the destinations nobody subscribed to with one write per stream, like the stream
+ * front end. Only the record that finds its ring drained looks at whether the thread sleeps.
+ *
+ * Arithmetic values, pointers and strings are copied as they are, other types are
+ * formatted with their operator<< at the call. The size of a record is known at compile
+ * time apart from the length of its strings. A message that does not fit in the ring is
+ * dropped and counted, the count is logged as a warning.
+ */
+class DeferredLog {
+public:
+    /**
+     * @brief Type an argument is recorded as.
+     */
+    template<typename T>
+    struct StoredType {
+        using D = std::decay_t<T>;
+        using type = std::conditional_t<std::is_arithmetic_v<D> || std::is_same_v<D, std::string> ||
+                                            std::is_same_v<D, std::string_view>, D,
+                     std::conditional_t<std::is_same_v<D, char*> || std::is_same_v<D, const char*>, const char*,
+                     std::conditional_t<std::is_pointer_v<D>, const void*, std::string>>>;
+    };
+
+    template<typename T>
+    using Stored = typename StoredType<T>::type;
+
+    /**
+     * @brief Converts an argument to the type it is recorded as, formatting it if it has no binary form.
+     */
+    template<typename T>
+    static decltype(auto) store(const T& value) {
+        using S = Stored<T>;
+        if constexpr (std::is_same_v<S, std::string> && !std::is_same_v<std::decay_t<T>, std::string>) {
+            std::ostringstream text;
+            text << value;
+            return text.str();
+        } else if constexpr (std::is_same_v<S, const char*> || std::is_same_v<S, const void*>) {
+            return static_cast<S>(value);
+        } else {
+            return value;
+        }
+    }
+
+    /**
+     * @brief Copies a log statement into the ring of the calling thread.
+     *
+     * @param site Static description of the call site.
+     * @param args Arguments, of the types given by Stored.
+     */
+    template<typename... Args>
+    static void record(const DeferredSite& site, const Args&... args) {
+        Buffer* buffer = current.buffer ? current.buffer : attach();
+        const std::uint64_t previous = buffer->head.load(std::memory_order_relaxed);
+        constexpr std::size_t fixed = sizeof(Header) + (std::size_t(0) + ... + fixedSize<Args>());
+        const std::size_t size = (fixed + (std::size_t(0) + ... + variableSize(args)) + 7) & ~std::size_t(7);
+
+        std::uint64_t start;
+        char* p = reserve(*buffer, size, start);
+        if(!p) {
+            return;
+        }
+        const Header header{ static_cast<std::uint32_t>(size), &site };
+        std::memcpy(p, &header, sizeof(header));
+        p += sizeof(header);
+        (encode(p, args), ...);
+        buffer->head.store(start + size, std::memory_order_release);
+
+        // Pairs with the fence of the background thread before it sleeps, so that either it
+        // sees the record or this sees its drained tail
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(buffer->tail.load(std::memory_order_relaxed) == previous) {
+            wake();
+        }
+    }
+
+    /**
+     * @brief Formats a recorded message, instantiated for the argument types of each call site.
+     */
+    template<typename... Args>
+    static void decode(const DeferredSite& site, [[maybe_unused]] const char* args, std::string& out) {
+        // A braced list reads the arguments in order
+        const std::tuple<Decoded<Args>...> values{ load<Args>(args)... };
+        std::apply([&](const auto&... value) {
+            LogFormat::format(site.pieces, site.pieceCount, site.format, out, value...);
+        }, values);
+    }
+
+    /**
+     * @brief Waits until everything recorded before the call has been written to the streams.
+     */
+    static void flush();
+
+    /**
+     * @brief Returns the counters, drops are counted once the background thread has drained their ring.
+     */
+    static DeferredLogStats stats();
+
+    /**
+     * @brief Ring of one thread, written by that thread and drained by the background thread.
+     */
+    struct Buffer {
+        static constexpr std::size_t kSize = 1 << 16;
+        alignas(64) std::atomic<std::uint64_t> head{0};
+        alignas(64) std::atomic<std::uint64_t> tail{0};
+        std::atomic<std::uint64_t> dropped{0};
+        std::atomic<bool> retired{false};
+        char data[kSize];
+    };
+
+private:
+    /**
+     * @brief Start of every record, a size of kWrap marks the unused end of the ring.
+     */
+    struct Header {
+        std::uint32_t size;
+        const DeferredSite* site;
+    };
+    static constexpr std::uint32_t kWrap = 0xffffffffu;
+
+    /**
+     * @brief Retires the ring of a thread when the thread exits.
+     */
+    struct ThreadBuffer {
+        Buffer* buffer = nullptr;
+        ~ThreadBuffer() {
+            if(buffer) {
+                buffer->retired.store(true, std::memory_order_release);
+            }
+        }
+    };
+    static thread_local ThreadBuffer current;
+
+    struct Consumer;
+    static Buffer* attach();
+
+    /**
+     * @brief Wakes the background thread if it sleeps, called when a ring goes from drained to not.
+     */
+    static void wake();
+
+    /**
+     * @brief Reserves size contiguous bytes, skipping the end of the ring if they do not fit there.
+     */
+    static char* reserve(Buffer& buffer, std::size_t size, std::uint64_t& start) {
+        std::uint64_t head = buffer.head.load(std::memory_order_relaxed);
+        const std::uint64_t tail = buffer.tail.load(std::memory_order_acquire);
+        const std::size_t offset = static_cast<std::size_t>(head & (Buffer::kSize - 1));
+        const std::size_t skip = offset + size > Buffer::kSize ? Buffer::kSize - offset : 0;
+        if(head + skip + size - tail > Buffer::kSize) {
+            buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        if(skip) {
+            std::memcpy(buffer.data + offset, &kWrap, sizeof(kWrap));
+            head += skip;
+        }
+        start = head;
+        return buffer.data + (head & (Buffer::kSize - 1));
+    }
+
+    template<typename T>
+    static constexpr std::size_t fixedSize() {
+        if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) {
+            return sizeof(std::uint32_t);
+        } else {
+            return sizeof(T);
+        }
+    }
+
+    template<typename T>
+    static std::size_t variableSize(const T& value) {
+        if constexpr (std::is_same_v<T, const char*>) {
+            return value ? std::strlen(value) : 0;
+        } else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) {
+            return value.size();
+        } else {
+            return 0;
+        }
+    }
+
+    template<typename T>
+    static void encode(char*& p, const T& value) {
+        if constexpr (std::is_same_v<T, const char*>) {
+            encode(p, std::string_view(value ? value : ""));
+        } else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) {
+            const std::uint32_t length = static_cast<std::uint32_t>(value.size());
+            std::memcpy(p, &length, sizeof(length));
+            std::memcpy(p + sizeof(length), value.data(), length);
+            p += sizeof(length) + length;
+        } else {
+            std::memcpy(p, &value, sizeof(T));
+            p += sizeof(T);
+        }
+    }
+
+    /**
+     * @brief Type a recorded argument is read back as, strings are viewed in the ring.
+     */
+    template<typename T>
+    using Decoded = std::conditional_t<std::is_same_v<T, const char*> || std::is_same_v<T, std::string>, std::string_view, T>;
+
+    template<typename T>
+    static Decoded<T> load(const char*& args) {
+        if constexpr (std::is_same_v<Decoded<T>, std::string_view>) {
+            std::uint32_t length;
+            std::memcpy(&length, args, sizeof(length));
+            const std::string_view value(args + sizeof(length), length);
+            args += sizeof(length) + length;
+            return value;
+        } else {
+            T value;
+            std::memcpy(&value, args, sizeof(T));
+            args += sizeof(T);
+            return value;
+        }
+    }
+};
+
+inline thread_local DeferredLog::ThreadBuffer DeferredLog::current;
+
+/**
+ * @brief Formats and logs a message at once, for example LOG_FORMAT(info, "read {} bytes from {}", n, path).
+ *
+ * The format string is parsed and checked against the arguments at compile time, see LogFormat.
+ */
+#define LOG_FORMAT(logger, ...) \
+    (logger).format([] { return LOG_FORMAT_STRING_(__VA_ARGS__, 0); }, __VA_ARGS__)
+
+/**
+ * @brief Logs a message through DeferredLog, for example LOG_DEFERRED(info, "read {} bytes from {}", n, path).
+ *
+ * The lambda gives every call site a type of its own and with it a static DeferredSite.
+ */
+#define LOG_DEFERRED(logger, ...) \
+    (logger).deferred([] { return LOG_FORMAT_STRING_(__VA_ARGS__, 0); }, __VA_ARGS__)
+#define LOG_FORMAT_STRING_(format, ...) format
+
+/**
+ * @class LogBuffer
+ * @brief Stream buffer that appends to a string, reused for every message of a thread.
+ */
+class LogBuffer : public std::streambuf {
+public:
+    std::string text; /**< The message formatted so far. */
+
+protected:
+    int_type overflow(int_type ch) override {
+        if(!traits_type::eq_int_type(ch, traits_type::eof())) {
+            text += traits_type::to_char_type(ch);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char_type* s, std::streamsize count) override {
+        text.append(s, static_cast<std::size_t>(count));
+        return count;
+    }
+};
+
+/**
+ * @struct basic_logging::Pending
+ * @brief Message being formatted by one thread for one logger, the buffer keeps its capacity between messages.
+ */
+struct basic_logging::Pending {
+    Pending(const void* owner, LogLevel level, std::uint32_t destinations) :
+        owner(owner), level(level), destinations(destinations), stream(&buffer) {}
+
+    ~Pending() {
+        // Hand over what a thread left unfinished when it exits
+        publish(true);
+    }
+
+    /**
+     * @brief Publishes the message once to the router and the streams of its destinations.
+     * @param complete Whether the message is finished, an unfinished one may be kept.
+     */
+    void publish(bool complete) {
+        if(!buffer.text.empty() && basic_logging::emit(buffer.text, level, destinations, complete)) {
+            buffer.text.clear();
+        }
+    }
+
+    const void* owner;                  /**< The logger the message is formatted for. */
+    LogLevel level;
+    std::uint32_t destinations;
+    LogBuffer buffer;
+    std::ostream stream;
+    bool started = false;               /**< Whether the level tag of the current message was written. */
 };
 
 /**
@@ -82,30 +775,22 @@ public:
     /**
      * @brief Constructor for logging.
      */
-    logging() : basic_logging() {
-        //if constexpr (_level >= MIN_LEVEL) {
-        //    terminate = false;
-        //    flush_thread = new std::thread([this]()
-        //    {
-        //        std::unique_lock<std::mutex> lock(mtx);
-        //        while (!terminate) {
-        //            cv.wait_for(lock, std::chrono::seconds(1));
-        //            if (terminate) break;
-        //            this->flush();
-        //        }
-        //    });
-        //}
-    };
+    logging() : basic_logging(), _threshold(&_curLogLevel) {};
+
+    /**
+     * @brief Constructor for a logger that filters on the level of a module.
+     * @param module The module, it must outlive the logger.
+     */
+    explicit logging(const LogModule& module) : basic_logging(), _threshold(&module.threshold()) {};
     
-    ~logging() {
-        //if constexpr (_level >= MIN_LEVEL)
-        //{
-        //    terminate = true;
-        //    cv.notify_all();
-        //    if(flush_thread->joinable())
-        //        flush_thread->join();
-        //}
-    };
+    ~logging() {};
+
+    /**
+     * @brief Returns true if messages of this level are logged, a single relaxed load and compare.
+     */
+    bool enabled() const {
+        return _level >= _threshold->load(std::memory_order_relaxed);
+    }
 
     constexpr const char * level() const {
         switch(_level)
@@ -120,8 +805,24 @@ public:
         return "[info] ";
     };
 
+    /**
+     * @brief Returns the destinations of the messages of this level.
+     *
+     * Every message goes to the log file and the console, critical ones also to std::cerr.
+     */
+    static constexpr std::uint32_t destinations() {
+        return destinationMask(LogDestination::Console) | destinationMask(LogDestination::Log) |
+               (_level == LogLevel::Critical ? destinationMask(LogDestination::Error) : 0);
+    }
+
     /**
      * @brief Overloaded stream insertion operator for logging messages.
+     *
+     * The message is formatted into a buffer of the calling thread and logger, so threads
+     * never wait for each other and their messages never interleave. The level is checked
+     * first: while it is disabled and the thread has no message in progress, an insertion
+     * costs a relaxed load and a thread local read and never looks up the buffer. A message
+     * that began while its level was enabled is logged whole, a level change cannot cut it.
      * @tparam T The type of the message to log.
      * @param msg The message to log.
      * @return Reference to the logging object.
@@ -131,13 +832,11 @@ public:
     logging& operator<<(const T& msg) {
         // used to compile out excess logging message when not wanted
         if constexpr (_level >= MIN_LEVEL) {
-            if(_level >= _curLogLevel) {
-                std::lock_guard<std::mutex> lock(mtx);
-                if(!level_printed) {
-                    ss << level();
-                    level_printed = true;
+            if(enabled() || _openMessages != 0) {
+                Pending& message = pendingMessage();
+                if(begin(message)) {
+                    message.stream << msg;
                 }
-                ss << msg;
             }
         }
         return *this;
@@ -145,6 +844,10 @@ public:
 
     /**
      * @brief Overloaded stream insertion operator for manipulators (e.g., std::endl).
+     *
+     * std::endl completes the message of the calling thread and publishes it once. std::flush
+     * hands over what it has so far when only streams receive it. Other manipulators only
+     * change the formatting of the thread's messages.
      * @param manip The manipulator to apply.
      * @return Reference to the logging object.
      */
@@ -152,54 +855,133 @@ public:
     logging& operator<<(std::ostream& (*manip)(std::ostream&)) {
         // used to compile out excess logging message when not wanted
         if constexpr (_level >= MIN_LEVEL) {
-            if(_level >= _curLogLevel) 
-            {
-                std::lock_guard<std::mutex> lock(mtx);
-
-                // Send messages to either clog or cerr based on level
-                // routing is deteremined at compile time
-                if constexpr (_level == LogLevel::Critical)
-                    std::cerr << ss.str() << manip;
-                
-                // All messages are printed to the log file
-                std::clog << ss.str() << manip;
-
-                // Send info message to the console
-                //if constexpr (_level == LogLevel::Info)
-                    std::cout << ss.str() << manip;
-                
-                ss.str("");
-                level_printed = false;
+            if(!enabled() && _openMessages == 0) {
+                return *this;
+            }
+            Pending& message = pendingMessage();
+            if(manip == static_cast<std::ostream& (*)(std::ostream&)>(std::endl)) {
+                // A message that was started is finished even if its level was disabled since
+                if(message.started || enabled()) {
+                    message.buffer.text += '\n';
+                    message.publish(true);
+                }
+                end(message);
+            } else if(manip == static_cast<std::ostream& (*)(std::ostream&)>(std::flush)) {
+                if(message.started) {
+                    message.publish(false);
+                }
+            } else if(begin(message)) {
+                message.stream << manip;
             }
         }
         return *this;
     };
 
-    void flush() {
+    /**
+     * @brief Records a message to be formatted later by DeferredLog, use it through LOG_DEFERRED.
+     * @tparam Site Unique type of the call site, returning the format string.
+     * @tparam Args The types of the arguments.
+     * @param site Returns the format string.
+     * @param args Arguments, one per {} in the format string.
+     */
+    template<typename Site, typename... Args>
+    inline
+    void deferred(Site site, const char* format, const Args&... args) {
+        static constexpr auto layout = LogFormat::parse<Args...>(site);
+        // used to compile out excess logging message when not wanted
         if constexpr (_level >= MIN_LEVEL) {
-            if(_level >= _curLogLevel) 
-            {
-                std::lock_guard<std::mutex> lock(mtx);
-                
-                if constexpr (_level == LogLevel::Critical)
-                    std::cerr << ss.str();
-
-                std::clog << ss.str();
+            if(enabled()) {
+                static const DeferredSite description{ level(), format, layout.pieces, layout.count, _level, destinations(),
+                                                       &DeferredLog::decode<DeferredLog::Stored<Args>...> };
+                DeferredLog::record(description, DeferredLog::store(args)...);
+            }
+        }
+    }
 
-                std::cout << ss.str();
+    /**
+     * @brief Formats a message into the buffer of the calling thread and publishes it, use it through LOG_FORMAT.
+     *
+     * The buffer is grown once, by the size of the literal text and of the arguments.
+     * @tparam Site Unique type of the call site, returning the format string.
+     * @tparam Args The types of the arguments.
+     * @param site Returns the format string.
+     * @param format The format string.
+     * @param args Arguments, one per {} in the format string.
+     */
+    template<typename Site, typename... Args>
+    inline
+    void format(Site site, const char* format, const Args&... args) {
+        static constexpr auto layout = LogFormat::parse<Args...>(site);
+        // used to compile out excess logging message when not wanted
+        if constexpr (_level >= MIN_LEVEL) {
+            if(enabled() || _openMessages != 0) {
+                // The formatted message finishes the one the thread has in progress
+                Pending& message = pendingMessage();
+                if(begin(message)) {
+                    formatMessage(message, layout, format, DeferredLog::store(args)...);
+                }
+                end(message);
+            }
+        }
+    }
 
-                ss.str("");
+    /**
+     * @brief Hands over the unfinished message of the calling thread.
+     */
+    void flush() {
+        if constexpr (_level >= MIN_LEVEL) {
+            if(_openMessages != 0) {
+                Pending& message = pendingMessage();
+                if(message.started) {
+                    message.publish(false);
+                }
             }
         }
     }
 
 private:
-    std::stringstream ss;
-    std::thread* flush_thread;
-    std::condition_variable cv;
-    std::atomic<bool> terminate;
-    std::atomic<bool> level_printed;
-    std::mutex mtx;
+    /**
+     * @brief Returns the message the calling thread is formatting through this logger.
+     */
+    Pending& pendingMessage() const {
+        return basic_logging::pending(this, _level, destinations());
+    }
+
+    /**
+     * @brief Decides whether the message of the calling thread is logged when it begins, returns that decision.
+     */
+    bool begin(Pending& message) const {
+        if(!message.started && enabled()) {
+            message.buffer.text += level();
+            message.started = true;
+            ++_openMessages;
+        }
+        return message.started;
+    }
+
+    /**
+     * @brief Ends the message of the calling thread, the next insertion begins a new one.
+     */
+    static void end(Pending& message) {
+        if(message.started) {
+            message.started = false;
+            --_openMessages;
+        }
+    }
+
+    /**
+     * @brief Appends a message formatted from a parsed format string to a thread's buffer and publishes it.
+     */
+    template<typename Layout, typename... Values>
+    static void formatMessage(Pending& message, const Layout& layout, const char* format, const Values&... values) {
+        std::string& text = message.buffer.text;
+        text.reserve(text.size() + layout.literalSize + (std::size_t(0) + ... + LogFormat::sizeHint(values)) + 1);
+        LogFormat::format(layout.pieces, layout.count, format, text, values...);
+        text += '\n';
+        message.publish(true);
+    }
+
+    const std::atomic<LogLevel>* _threshold; /**< Global or module level this logger filters on. */
 };
 
 /**
@@ -0,0 +1,348 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#include <LogFileWriterConfig.h>
+#include <ProcessCapture.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+/**
+ * @file ProcessCapture.cpp
+ * @brief Implementation of the ProcessCapture class.
+ *
+ * Every pipe is registered with one epoll instance, level triggered, with its Source as
+ * the event data. The poll thread reads at most one chunk per ready pipe and per wakeup,
+ * so a child that writes without pause cannot starve the others. An eventfd, registered
+ * with null event data, stops the thread.
+ *
+ * The parent ends of the pipes are close-on-exec, so a child only inherits its own write
+ * ends and a pipe reaches end of file as soon as its child, and whatever the child started,
+ * has exited.
+ */
+
+namespace {
+    constexpr std::size_t kReadSize = 65536;
+    constexpr int kMaxEvents = 64;
+
+    void closeFd(int& fd) {
+        if(fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+}
+
+/**
+ * @struct ProcessCapture::ProcessCapturePimpl
+ * @brief Private implementation (Pimpl) for the ProcessCapture class.
+ *
+ * @details
+ * - `Source`: One captured pipe, owned by the poll thread once registered.
+ * - `children`: State of every child spawned, kept once it has been reaped so that waiting
+ *   again returns the same status, protected by `mtx`.
+ * - `text`, `ends`, `lines`: Tagged lines of the chunk being delivered, reused between reads.
+ */
+struct HIDDEN ProcessCapture::ProcessCapturePimpl {
+    struct Source {
+        pid_t pid;
+        int fd;
+        std::string tag;        // "[pid stream] "
+        std::string partial;    // last line of the previous chunk, not terminated yet
+    };
+
+    struct Child {
+        int open = 0;           // pipes not at end of file yet
+        bool reaping = false;   // a wait() is in waitpid() for it
+        bool reaped = false;
+        int status = -1;        // wait status once reaped
+    };
+
+    void collect(Source& source, const char* data, std::size_t size);
+    void deliver();
+
+    int epollFd = -1;
+    int wakeFd = -1;
+    std::thread pollThread;
+
+    std::mutex mtx;
+    std::condition_variable closed;
+    std::map<pid_t, Child> children;
+
+    std::mutex observerMtx;
+    std::vector<LineObserver*> observers;
+
+    std::string text;
+    std::vector<std::size_t> ends;
+    std::vector<std::string_view> lines;
+};
+
+/**
+ * @brief Appends the complete lines of a chunk, tagged, to `text`.
+ *
+ * Whatever follows the last newline is kept in the source for the next chunk.
+ */
+void ProcessCapture::ProcessCapturePimpl::collect(Source& source, const char* data, std::size_t size)
+{
+    const char* end = data + size;
+    for(const char* newline; (newline = std::find(data, end, '\n')) != end; data = newline + 1) {
+        text += source.tag;
+        text += source.partial;
+        text.append(data, newline);
+        ends.push_back(text.size());
+        source.partial.clear();
+    }
+    source.partial.append(data, end);
+}
+
+/**
+ * @brief Passes the collected lines to the observers as one batch.
+ */
+void ProcessCapture::ProcessCapturePimpl::deliver()
+{
+    std::size_t begin = 0;
+    for(std::size_t end : ends) {
+        lines.emplace_back(text.data() + begin, end - begin);
+        begin = end;
+    }
+
+    if(!lines.empty()) {
+        std::lock_guard<std::mutex> lock(observerMtx);
+        for(LineObserver* observer : observers) {
+            observer->updateBatch(lines.data(), lines.size());
+        }
+    }
+
+    text.clear();
+    ends.clear();
+    lines.clear();
+}
+
+ProcessCapture::ProcessCapture()
+{
+    d = new ProcessCapturePimpl();
+
+    d->epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    d->wakeFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if(d->epollFd < 0 || d->wakeFd < 0 || ::epoll_ctl(d->epollFd, EPOLL_CTL_ADD, d->wakeFd, &event) != 0) {
+        closeFd(d->epollFd);
+        closeFd(d->wakeFd);
+        return;
+    }
+
+    d->pollThread = std::thread(&ProcessCapture::poll, this);
+}
+
+ProcessCapture::~ProcessCapture()
+{
+    std::vector<pid_t> children;
+    {
+        std::lock_guard<std::mutex> lock(d->mtx);
+        for(const auto& child : d->children) {
+            if(!child.second.reaped) {
+                children.push_back(child.first);
+            }
+        }
+    }
+    for(pid_t pid : children) {
+        wait(pid);
+    }
+
+    if(d->pollThread.joinable()) {
+        const std::uint64_t stop = 1;
+        while(::write(d->wakeFd, &stop, sizeof(stop)) < 0 && errno == EINTR) {}
+        d->pollThread.join();
+    }
+    closeFd(d->epollFd);
+    closeFd(d->wakeFd);
+    delete d;
+}
+
+void ProcessCapture::attach(LineObserver* observer)
+{
+    std::lock_guard<std::mutex> lock(d->observerMtx);
+    if(std::find(d->observers.begin(), d->observers.end(), observer) == d->observers.end()) {
+        d->observers.push_back(observer);
+    }
+}
+
+void ProcessCapture::detach(LineObserver* observer)
+{
+    std::lock_guard<std::mutex> lock(d->observerMtx);
+    d->observers.erase(std::remove(d->observers.begin(), d->observers.end(), observer), d->observers.end());
+}
+
+pid_t ProcessCapture::spawn(const std::vector<std::string>& argv)
+{
+    if(argv.empty() || !d->pollThread.joinable()) {
+        return -1;
+    }
+
+    int out[2] = { -1, -1 };
+    int err[2] = { -1, -1 };
+    if(::pipe2(out, O_CLOEXEC) != 0 || ::pipe2(err, O_CLOEXEC) != 0) {
+        for(int* fd : { &out[0], &out[1], &err[0], &err[1] }) {
+            closeFd(*fd);
+        }
+        return -1;
+    }
+
+    std::vector<char*> args;
+    for(const std::string& arg : argv) {
+        args.push_back(const_cast<char*>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+
+    // dup2 clears close-on-exec on the child's copies only
+    posix_spawn_file_actions_t actions;
+    ::posix_spawn_file_actions_init(&actions);
+    ::posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+    ::posix_spawn_file_actions_adddup2(&actions, err[1], STDERR_FILENO);
+
+    pid_t pid = -1;
+    int result = ::posix_spawnp(&pid, args[0], &actions, nullptr, args.data(), environ);
+    ::posix_spawn_file_actions_destroy(&actions);
+    closeFd(out[1]);
+    closeFd(err[1]);
+    if(result != 0) {
+        closeFd(out[0]);
+        closeFd(err[0]);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(d->mtx);
+    // A pid is only reused once the previous child was reaped
+    ProcessCapturePimpl::Child& child = d->children[pid];
+    child = ProcessCapturePimpl::Child();
+    int& open = child.open;
+    const char* names[] = { "stdout", "stderr" };
+    int fds[] = { out[0], err[0] };
+    for(int i = 0; i < 2; ++i) {
+        auto* source = new ProcessCapturePimpl::Source{ pid, fds[i], "[" + std::to_string(pid) + " " + names[i] + "] ", {} };
+        ::fcntl(source->fd, F_SETFL, ::fcntl(source->fd, F_GETFL) | O_NONBLOCK);
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = source;
+        if(::epoll_ctl(d->epollFd, EPOLL_CTL_ADD, source->fd, &event) != 0) {
+            // The output of this stream is lost, but the child can still be waited for
+            closeFd(source->fd);
+            delete source;
+            continue;
+        }
+        ++open;
+    }
+    return pid;
+}
+
+int ProcessCapture::wait(pid_t pid)
+{
+    std::unique_lock<std::mutex> lock(d->mtx);
+    auto it = d->children.find(pid);
+    if(it == d->children.end()) {
+        return -1;
+    }
+    ProcessCapturePimpl::Child& child = it->second;
+    d->closed.wait(lock, [&child] { return child.open == 0 && !child.reaping; });
+    if(child.reaped) {
+        return child.status;
+    }
+
+    // Reap without holding the mutex, callers waiting for the same child get the cached status
+    child.reaping = true;
+    lock.unlock();
+    int status = 0;
+    int result;
+    while((result = ::waitpid(pid, &status, 0)) < 0 && errno == EINTR) {}
+    lock.lock();
+
+    child.reaping = false;
+    child.reaped = true;
+    child.status = result < 0 ? -1 : status;
+    d->closed.notify_all();
+    return child.status;
+}
+
+/**
+ * @brief Poll thread loop, reads the pipes of all children until stopped.
+ */
+void HIDDEN ProcessCapture::poll()
+{
+    std::vector<char> buffer(kReadSize);
+    epoll_event events[kMaxEvents];
+
+    for(;;) {
+        int count = ::epoll_wait(d->epollFd, events, kMaxEvents, -1);
+        if(count < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+
+        for(int i = 0; i < count; ++i) {
+            auto* source = static_cast<ProcessCapturePimpl::Source*>(events[i].data.ptr);
+            if(source == nullptr) {
+                return;
+            }
+
+            ssize_t size = ::read(source->fd, buffer.data(), buffer.size());
+            if(size > 0) {
+                d->collect(*source, buffer.data(), static_cast<std::size_t>(size));
+                d->deliver();
+                continue;
+            }
+            if(size < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+
+            // End of file, or the pipe broke: pass on the unterminated last line and drop the pipe
+            if(!source->partial.empty()) {
+                d->collect(*source, "\n", 1);
+                d->deliver();
+            }
+            ::epoll_ctl(d->epollFd, EPOLL_CTL_DEL, source->fd, nullptr);
+            closeFd(source->fd);
+            pid_t pid = source->pid;
+            delete source;
+
+            std::lock_guard<std::mutex> lock(d->mtx);
+            if(--d->children[pid].open == 0) {
+                d->closed.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,81 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#ifndef PROCESS_CAPTURE_HPP
+#define PROCESS_CAPTURE_HPP
+
+#include <LogFileWriterConfig.h>
+#include <LineObserver.hpp>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * @class ProcessCapture
+ * @brief Runs child processes and captures their stdout and stderr into line observers.
+ *
+ * Children are started with posix_spawnp, without a shell, with both output streams
+ * connected to pipes. A single epoll thread reads the pipes of every child, however many
+ * there are, and delivers each complete line to the attached observers tagged with the
+ * pid and stream it came from, as in "[1234 stdout] text".
+ *
+ * Attach the observers before spawning. Observers are called from the epoll thread.
+ */
+class ProcessCapture {
+public:
+    /**
+     * @brief Starts the epoll thread.
+     */
+    ProcessCapture();
+
+    /**
+     * @brief Waits for every child that was not waited for, then stops the epoll thread.
+     */
+    ~ProcessCapture();
+
+    void attach(LineObserver* observer);
+    void detach(LineObserver* observer);
+
+    /**
+     * @brief Starts a program, searched for in PATH, with its stdout and stderr captured.
+     *
+     * @param argv Program name followed by its arguments.
+     * @return The pid of the child, or -1 if it could not be started.
+     */
+    pid_t spawn(const std::vector<std::string>& argv);
+
+    /**
+     * @brief Waits until a child has exited and all of its output has been delivered.
+     *
+     * The child is reaped once, waiting for it again returns the same status.
+     * @param pid Pid returned by spawn().
+     * @return The wait status of the child, as reported by waitpid(), or -1 on error.
+     */
+    int wait(pid_t pid);
+
+private:
+    ProcessCapture(const ProcessCapture&) = delete;
+    ProcessCapture& operator=(const ProcessCapture&) = delete;
+
+    void poll();
+
+    struct ProcessCapturePimpl;
+    struct ProcessCapturePimpl *d;
+};
+
+#endif // PROCESS_CAPTURE_HPP
@@ -20,9 +20,18 @@
 #include <LogFileWriterConfig.h>
 #include <CRedirect.h>
 #include <LogFileWriter.hpp>
+#include <Logging.hpp>
+#include <cstdlib>
 #include <iostream>
 #include <string>
 
+#ifdef USE_PROCESS_CAPTURE
+#include <ProcessCapture.hpp>
+#include <algorithm>
+#include <vector>
+#include <sys/wait.h>
+#endif
+
 int main(int argc, char* argv[]) {
 #ifdef USE_CLOG_REDIRECT
     // Attach the ClogRedirect to redirect std::clog
@@ -40,12 +49,23 @@ int main(int argc, char* argv[]) {
      */
     LogFileWriter logFileWriter("logfile.txt");
 
+    /**
+     * @brief Apply the logging levels given in LOG_LEVELS, for example "warn,network=debug".
+     * Levels can be changed the same way at runtime, basic_logging::configure() is safe to
+     * call from a signal handler.
+     */
+    if (const char* levels = std::getenv("LOG_LEVELS")) {
+        if (!basic_logging::configure(levels)) {
+            std::cerr << "Ignoring unknown entries in LOG_LEVELS: " << levels << std::endl;
+        }
+    }
+
     /**
      * @brief Check if the program name is provided as an argument.
      * If no program name is provided, display usage information and exit.
      */
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <program> [args...]" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " [--instances N] <program> [args...]" << std::endl;
         return 1;
     }
 
@@ -55,14 +75,74 @@ int main(int argc, char* argv[]) {
      */
     for (int i = 1; i < argc; ++i) {
         if (std::string(argv[i]) == "--help") {
-            std::cout << "Usage: " << argv[0] << " <program> [args...]\n"
+            std::cout << "Usage: " << argv[0] << " [--instances N] <program> [args...]\n"
                       << "Runs the specified program with optional arguments, redirecting logs to logfile.txt.\n"
                       << "Options:\n"
-                      << "  --help    Show this help message\n";
+                      << "  --help           Show this help message\n"
+                      << "  --instances N    Run N copies of the program (Linux only)\n";
             return 0;
         }
     }
 
+    /**
+     * @brief --instances needs a count and a program after it.
+     */
+    if (std::string(argv[1]) == "--instances" && argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " [--instances N] <program> [args...]" << std::endl;
+        return 1;
+    }
+
+#ifdef USE_PROCESS_CAPTURE
+    /**
+     * @brief Run the program directly, without a shell, and capture its output.
+     * The program is started with posix_spawnp and every line it writes to stdout or stderr
+     * is logged, tagged with its pid and stream. With --instances N, N copies are started
+     * and a single epoll thread captures all of them.
+     */
+    int first = 1;
+    int instances = 1;
+    if (std::string(argv[1]) == "--instances") {
+        instances = std::max(1, std::atoi(argv[2]));
+        first = 3;
+    }
+    std::vector<std::string> args(argv + first, argv + argc);
+
+    ProcessCapture capture;
+    capture.attach(&logFileWriter);
+
+    std::vector<pid_t> children;
+    for (int i = 0; i < instances; ++i) {
+        pid_t pid = capture.spawn(args);
+        if (pid < 0) {
+            std::cerr << "Unable to start " << args[0] << std::endl;
+            continue;
+        }
+        children.push_back(pid);
+        LOG_FORMAT(info, "started {} (pid {})", args[0], pid);
+    }
+
+    /**
+     * @brief Wait for every child and return the first failure, like a shell would.
+     */
+    int ret = children.empty() ? 127 : 0;
+    for (pid_t pid : children) {
+        int status = capture.wait(pid);
+        int code = status < 0 ? 127 : WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        LOG_DEFERRED(info, "{} (pid {}) exited with {}", args[0], pid, code);
+        if (ret == 0) {
+            ret = code;
+        }
+    }
+
+    // Write the deferred messages before the log file is closed
+    DeferredLog::flush();
+    return ret;
+#else
+    if (std::string(argv[1]) == "--instances") {
+        std::cerr << "--instances is only supported on Linux" << std::endl;
+        return 1;
+    }
+
     /**
      * @brief Construct the command to run the specified program with its arguments.
      * This command is built by concatenating the program name and its arguments,
@@ -81,7 +161,12 @@ int main(int argc, char* argv[]) {
      * The return value of std::system is checked to determine if the command was executed successfully.
      * If the command fails to execute, an error message is printed to std::cerr.
      */
+    LOG_FORMAT(debug, "running {}", command);
     int ret = std::system(command.c_str());
+    LOG_DEFERRED(info, "{} exited with {}", argv[1], ret);
 
+    // Write the deferred messages before the log file is closed
+    DeferredLog::flush();
     return ret;
+#endif
 }
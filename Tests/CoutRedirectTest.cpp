@@ -18,8 +18,31 @@
  */
 
 #include <CRedirect.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <iterator>
+#include <mutex>
+#include <set>
 #include <sstream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef LIB_CREDIRECT_ENABLE_FD
+#include <unistd.h>
+#endif
+
+#ifdef LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 static std::stringstream testBuffer;
 
@@ -43,7 +66,51 @@ public:
         testBuffer << output;
     }
 };
-    
+
+class LineCollector : public StreamObserver {
+public:
+    void update(const std::string& output) override {
+        std::lock_guard<std::mutex> lock(mtx);
+        lines.push_back(output);
+    }
+
+    std::mutex mtx;
+    std::vector<std::string> lines;
+};
+
+/**
+ * @brief Writes `count` numbered lines per thread to std::cout from `threads` threads.
+ * Each line is written with a single call so that the stream buffer sees whole lines.
+ */
+static void writeLines(int threads, int count) {
+    std::vector<std::thread> writers;
+    for(int t = 0; t < threads; ++t) {
+        writers.emplace_back([t, count] {
+            for(int i = 0; i < count; ++i) {
+                std::string line = std::to_string(t) + ":" + std::to_string(i) + "\n";
+                std::cout.write(line.data(), line.size());
+            }
+        });
+    }
+    for(auto& w : writers) {
+        w.join();
+    }
+    std::cout.flush();
+}
+
+/**
+ * @brief Checks that every line written by writeLines() was received exactly once.
+ */
+static int checkLines(const std::vector<std::string>& lines, int threads, int count) {
+    std::set<std::string> expected;
+    for(int t = 0; t < threads; ++t) {
+        for(int i = 0; i < count; ++i) {
+            expected.insert(std::to_string(t) + ":" + std::to_string(i));
+        }
+    }
+    std::set<std::string> actual(lines.begin(), lines.end());
+    return (lines.size() == expected.size() && actual == expected) ? 0 : 1;
+}
     
 /**
  * @brief Test function for CoutRedirect
@@ -62,7 +129,7 @@ int test001() {
     std::string expectedOutput = testString;
     std::string actualOutput = testBuffer.str();
     
-    return expectedOutput == actualOutput;
+    return expectedOutput == actualOutput ? 0 : 1;
 }
 
 /**
@@ -82,7 +149,7 @@ int test002() {
     std::string expectedOutput = testString;
     std::string actualOutput = testBuffer.str();
     
-    return expectedOutput == actualOutput;
+    return expectedOutput == actualOutput ? 0 : 1;
 }
 
 /**
@@ -102,7 +169,1722 @@ int test003() {
     std::string expectedOutput = testString;
     std::string actualOutput = testBuffer.str();
     
-    return expectedOutput == actualOutput;
+    return expectedOutput == actualOutput ? 0 : 1;
+}
+
+/**
+ * @brief Test function for the LockFree buffer engine
+ * 
+ * A deliberately small ring forces records to wrap and producers to wait for space.
+ */
+int test004() {
+    const int threads = 4;
+    const int count = 500;
+    LineCollector observer;
+
+    {
+        RedirectOptions options;
+        options.engine = BufferEngine::LockFree;
+        options.ringBufferSize = 1024;
+
+        CoutRedirect redirect(options);
+        CoutRedirect::attach(&observer);
+
+        writeLines(threads, count);
+    }
+
+    return checkLines(observer.lines, threads, count);
+}
+
+/**
+ * @brief Test function for the circular buffer of the Mutex engine
+ * 
+ * The observer stalls on the first line so the writer wraps around and grows the buffer
+ * while the reader still holds data from the old one. Lines must arrive complete and in order.
+ */
+int test005() {
+    class SlowObserver : public LineCollector {
+    public:
+        void update(const std::string& output) override {
+            if(lines.empty()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+            LineCollector::update(output);
+        }
+    };
+
+    const int count = 5000;
+    SlowObserver observer;
+
+    {
+        RedirectOptions options;
+        options.engine = BufferEngine::Mutex;
+        options.initialBufferSize = 64;
+
+        CoutRedirect redirect(options);
+        CoutRedirect::attach(&observer);
+
+        for(int i = 0; i < count; ++i) {
+            std::cout << "line " << i << std::string(i % 37, '.') << std::endl;
+        }
+    }
+
+    if(observer.lines.size() != count) {
+        return 1;
+    }
+    for(int i = 0; i < count; ++i) {
+        if(observer.lines[i] != "line " + std::to_string(i) + std::string(i % 37, '.')) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Test function for bulk writes larger than the buffer
+ * 
+ * Multi-kilobyte lines must arrive intact with both buffer engines.
+ */
+int test006() {
+    std::vector<std::string> blobs;
+    for(int i = 0; i < 3; ++i) {
+        std::string blob = "{\"id\":" + std::to_string(i) + ",\"data\":\"";
+        for(int j = 0; j < 20000; ++j) {
+            blob += static_cast<char>('a' + (i + j) % 26);
+        }
+        blobs.push_back(blob + "\"}");
+    }
+
+    for(BufferEngine engine : { BufferEngine::Mutex, BufferEngine::LockFree }) {
+        LineCollector observer;
+        {
+            RedirectOptions options;
+            options.engine = engine;
+            options.initialBufferSize = 64;
+            options.ringBufferSize = 4096;
+
+            CoutRedirect redirect(options);
+            CoutRedirect::attach(&observer);
+
+            for(const auto& blob : blobs) {
+                std::cout << blob << std::endl;
+            }
+        }
+
+        if(observer.lines != blobs) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Test function for the wakeup policies
+ * 
+ * A line written in flushed pieces must reach the observer while the redirect is still
+ * running, whether it wakes the monitor thread or is picked up after the coalescing delay.
+ */
+int test007() {
+    for(BufferEngine engine : { BufferEngine::Mutex, BufferEngine::LockFree }) {
+        for(WakeupPolicy wakeup : { WakeupPolicy::EveryWrite, WakeupPolicy::Newline, WakeupPolicy::Coalesce }) {
+            LineCollector observer;
+            RedirectOptions options;
+            options.engine = engine;
+            options.wakeup = wakeup;
+            options.wakeupDelay = std::chrono::milliseconds(5);
+
+            CoutRedirect redirect(options);
+            CoutRedirect::attach(&observer);
+
+            std::cout << "partial " << std::flush;
+            std::cout << "line" << std::endl;
+
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+            bool delivered = false;
+            while(!delivered && std::chrono::steady_clock::now() < deadline) {
+                {
+                    std::lock_guard<std::mutex> lock(observer.mtx);
+                    delivered = !observer.lines.empty();
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+
+            CoutRedirect::detach(&observer);
+            if(!delivered || observer.lines[0] != "partial line") {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Test function for zero-copy LineObserver delivery
+ * 
+ * Lines arrive in batches next to a StreamObserver that goes through the adapter,
+ * and a trailing line without a newline is delivered when the redirect stops.
+ */
+int test008() {
+    class BatchCollector : public LineObserver {
+    public:
+        void update(std::string_view line) override {
+            lines.emplace_back(line);
+        }
+
+        void updateBatch(const std::string_view* lines, std::size_t count) override {
+            std::lock_guard<std::mutex> lock(mtx);
+            ++batches;
+            LineObserver::updateBatch(lines, count);
+        }
+
+        std::mutex mtx;
+        std::size_t batches = 0;
+        std::vector<std::string> lines;
+    };
+
+    const int count = 1000;
+
+    for(BufferEngine engine : { BufferEngine::Mutex, BufferEngine::LockFree }) {
+        // The put area of the Mutex engine is not shared between concurrent writers
+        const int threads = engine == BufferEngine::LockFree ? 2 : 1;
+        BatchCollector batchObserver;
+        LineCollector lineObserver;
+        {
+            RedirectOptions options;
+            options.engine = engine;
+            options.initialBufferSize = 64;
+            options.ringBufferSize = 1024;
+
+            CoutRedirect redirect(options);
+            CoutRedirect::attach(&batchObserver);
+            CoutRedirect::attach(&lineObserver);
+
+            writeLines(threads, count);
+            std::cout << "unterminated" << std::flush;
+        }
+
+        if(batchObserver.lines.empty() || batchObserver.lines.back() != "unterminated") {
+            return 1;
+        }
+        batchObserver.lines.pop_back();
+        lineObserver.lines.pop_back();
+        if(batchObserver.lines != lineObserver.lines ||
+           batchObserver.batches > batchObserver.lines.size() + 1 ||
+           checkLines(batchObserver.lines, threads, count) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Test function for the line splitter
+ * 
+ * Empty lines and lines of every length around the 16 and 32 byte blocks of the
+ * vectorized search must be split exactly, with both buffer engines.
+ */
+int test009() {
+    std::vector<std::string> expected;
+    for(int i = 0; i < 300; ++i) {
+        expected.push_back(std::string(i % 67, static_cast<char>('a' + i % 26)));
+    }
+
+    for(BufferEngine engine : { BufferEngine::Mutex, BufferEngine::LockFree }) {
+        LineCollector observer;
+        {
+            RedirectOptions options;
+            options.engine = engine;
+            options.wakeup = WakeupPolicy::Coalesce;
+
+            CoutRedirect redirect(options);
+            CoutRedirect::attach(&observer);
+
+            for(const auto& line : expected) {
+                std::cout << line << '\n';
+            }
+            std::cout.flush();
+        }
+
+        if(observer.lines != expected) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Test function for the copy-on-write observer list
+ * 
+ * Attaching must not wait for an observer that is blocked in a notification, and
+ * observers attached and detached while lines are written must not disturb the others.
+ */
+int test010() {
+    class BlockingObserver : public LineObserver {
+    public:
+        void update(std::string_view) override {
+            entered = true;
+            while(!released) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        std::atomic<bool> entered{false};
+        std::atomic<bool> released{false};
+    };
+
+    const int count = 2000;
+    BlockingObserver blocking;
+    LineCollector observer;
+
+    {
+        CoutRedirect redirect;
+        CoutRedirect::attach(&blocking);
+
+        std::cout << "block" << std::endl;
+        while(!blocking.entered) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        auto attached = std::async(std::launch::async, [&observer] { CoutRedirect::attach(&observer); });
+        bool waited = attached.wait_for(std::chrono::seconds(1)) != std::future_status::ready;
+        blocking.released = true;
+        attached.wait();
+        CoutRedirect::detach(&blocking);
+        if(waited) {
+            return 1;
+        }
+
+        std::atomic<bool> writing{true};
+        std::thread churn([&writing] {
+            while(writing) {
+                LineCollector transient;
+                CoutRedirect::attach(&transient);
+                CoutRedirect::detach(&transient);
+            }
+        });
+
+        writeLines(1, count);
+        writing = false;
+        churn.join();
+    }
+
+    return checkLines(observer.lines, 1, count);
+}
+
+/**
+ * @brief Test function for asynchronous observers
+ * 
+ * A stalled sink behind a small DropNewest queue must neither hold back a fast observer
+ * nor lose count of its lines, and a Block queue must deliver every line in order.
+ */
+int test011() {
+    class StalledObserver : public LineObserver {
+    public:
+        void update(std::string_view) override {
+            while(!released) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            ++received;
+        }
+
+        std::atomic<bool> released{false};
+        std::atomic<int> received{0};
+    };
+
+    class OrderedCollector : public LineObserver {
+    public:
+        void update(std::string_view line) override {
+            lines.emplace_back(line);
+        }
+
+        std::vector<std::string> lines;
+    };
+
+    const int count = 1000;
+    StalledObserver stalled;
+    OrderedCollector ordered;
+    LineCollector fast;
+    AsyncObserverStats stats;
+
+    {
+        AsyncObserver dropping(&stalled, 8, OverflowPolicy::DropNewest);
+        AsyncObserver blocking(&ordered, 4, OverflowPolicy::Block);
+        {
+            CoutRedirect redirect;
+            CoutRedirect::attach(&dropping);
+            CoutRedirect::attach(&blocking);
+            CoutRedirect::attach(&fast);
+
+            writeLines(1, count);
+
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while(std::chrono::steady_clock::now() < deadline) {
+                {
+                    std::lock_guard<std::mutex> lock(fast.mtx);
+                    if(fast.lines.size() == count) {
+                        break;
+                    }
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if(checkLines(fast.lines, 1, count) != 0) {
+                stalled.released = true;
+                return 1;
+            }
+
+            stalled.released = true;
+            CoutRedirect::detach(&dropping);
+            CoutRedirect::detach(&blocking);
+        }
+        stats = dropping.stats();
+    }
+
+    if(stats.dropped == 0 || stats.enqueued + stats.dropped != count ||
+       stalled.received != static_cast<int>(stats.enqueued) || stats.maxPending > 16) {
+        return 1;
+    }
+
+    std::vector<std::string> expected;
+    for(int i = 0; i < count; ++i) {
+        expected.push_back("0:" + std::to_string(i));
+    }
+    return ordered.lines == expected ? 0 : 1;
+}
+
+/**
+ * @brief Test function for the shared dispatcher pool
+ * 
+ * std::cout, std::cerr and std::clog are serviced by one pool of two threads. Lines that
+ * only reach the pool through the coalescing timer must arrive while the redirects run,
+ * and every stream must keep its own order.
+ */
+int test012() {
+    const int count = 3000;
+    LineCollector coutLines;
+    LineCollector cerrLines;
+    LineCollector clogLines;
+
+    auto waitFor = [count](LineCollector& observer) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while(std::chrono::steady_clock::now() < deadline) {
+            {
+                std::lock_guard<std::mutex> lock(observer.mtx);
+                if(observer.lines.size() == count) {
+                    return true;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return false;
+    };
+
+    auto expected = [count](const char* stream) {
+        std::vector<std::string> lines;
+        for(int i = 0; i < count; ++i) {
+            lines.push_back(std::string(stream) + " " + std::to_string(i));
+        }
+        return lines;
+    };
+
+    {
+        RedirectOptions options;
+        options.dispatch = DispatchMode::Shared;
+        options.dispatcherThreads = 2;
+        options.wakeup = WakeupPolicy::Coalesce;
+        options.wakeupDelay = std::chrono::milliseconds(2);
+
+        // std::cerr flushes std::cout, whose put area only the LockFree engine may share between threads
+        options.engine = BufferEngine::LockFree;
+        CoutRedirect coutRedirect(options);
+        options.wakeup = WakeupPolicy::Newline;
+        CerrRedirect cerrRedirect(options);
+        options.engine = BufferEngine::Mutex;
+        ClogRedirect clogRedirect(options);
+
+        CoutRedirect::attach(&coutLines);
+        CerrRedirect::attach(&cerrLines);
+        ClogRedirect::attach(&clogLines);
+
+        std::vector<std::thread> writers;
+        writers.emplace_back([count] { for(int i = 0; i < count; ++i) std::cout << "cout " << i << '\n'; std::cout.flush(); });
+        writers.emplace_back([count] { for(int i = 0; i < count; ++i) std::cerr << "cerr " << i << '\n'; });
+        writers.emplace_back([count] { for(int i = 0; i < count; ++i) std::clog << "clog " << i << std::endl; });
+        for(auto& w : writers) {
+            w.join();
+        }
+
+        if(!waitFor(coutLines) || !waitFor(cerrLines) || !waitFor(clogLines)) {
+            return 1;
+        }
+    }
+
+    return (coutLines.lines == expected("cout") &&
+            cerrLines.lines == expected("cerr") &&
+            clogLines.lines == expected("clog")) ? 0 : 1;
+}
+
+/**
+ * @brief Test function for Inline dispatch mode
+ * 
+ * Lines must be delivered before the write returns, on the writing thread, with writes made
+ * by an observer deferred until it returns and partial lines kept apart per thread. The partial
+ * line of a thread must be delivered when the thread exits.
+ */
+int test013() {
+    class EchoObserver : public LineCollector {
+    public:
+        void update(const std::string& output) override {
+            LineCollector::update(output);
+            if(output.rfind("echo ", 0) == 0) {
+                std::cout << "reply " << output.substr(5) << std::endl;
+            }
+        }
+    };
+
+    const int threads = 4;
+    const int count = 500;
+    EchoObserver observer;
+
+    {
+        CoutRedirect redirect(DispatchMode::Inline);
+        CoutRedirect::attach(&observer);
+
+        std::cout << "echo hello" << std::endl;
+        {
+            std::lock_guard<std::mutex> lock(observer.mtx);
+            if(observer.lines != std::vector<std::string>{ "echo hello", "reply hello" }) {
+                return 1;
+            }
+            observer.lines.clear();
+        }
+
+        std::vector<std::thread> writers;
+        for(int t = 0; t < threads; ++t) {
+            writers.emplace_back([t, count] {
+                for(int i = 0; i < count; ++i) {
+                    std::cout << t << ":" << i << '\n';
+                }
+            });
+        }
+        for(auto& w : writers) {
+            w.join();
+        }
+        if(checkLines(observer.lines, threads, count) != 0) {
+            return 1;
+        }
+        observer.lines.clear();
+
+        // Short lived threads, each leaving a partial line behind
+        for(int t = 0; t < 100; ++t) {
+            std::thread([t] { std::cout << "exited " << t; }).join();
+            std::lock_guard<std::mutex> lock(observer.mtx);
+            if(observer.lines.size() != 1 || observer.lines.back() != "exited " + std::to_string(t)) {
+                return 1;
+            }
+            observer.lines.clear();
+        }
+
+        std::cout << "unterminated";
+    }
+
+    return observer.lines == std::vector<std::string>{ "unterminated" } ? 0 : 1;
+}
+
+/**
+ * @brief Test function for thread staging
+ * 
+ * Lines written piecewise by several threads at once must arrive whole with either engine,
+ * and a flushed partial line must wait for its newline, the exit of its thread or the end
+ * of the redirection.
+ */
+int test014() {
+    const int threads = 4;
+    const int count = 1000;
+
+    for(BufferEngine engine : { BufferEngine::Mutex, BufferEngine::LockFree }) {
+        LineCollector observer;
+        {
+            RedirectOptions options;
+            options.engine = engine;
+            options.threadStaging = true;
+            options.initialBufferSize = 64;
+            options.ringBufferSize = 1024;
+
+            CoutRedirect redirect(options);
+            CoutRedirect::attach(&observer);
+
+            std::vector<std::thread> writers;
+            for(int t = 0; t < threads; ++t) {
+                writers.emplace_back([t, count] {
+                    for(int i = 0; i < count; ++i) {
+                        std::cout << t << ":" << i << '\n';
+                    }
+                    std::cout << "partial " << t << std::flush;
+                });
+            }
+            for(auto& w : writers) {
+                w.join();
+            }
+
+            // The writers have exited, their partial lines are committed without waiting for the end
+            auto partials = [&observer] {
+                std::lock_guard<std::mutex> lock(observer.mtx);
+                return std::count_if(observer.lines.begin(), observer.lines.end(),
+                    [](const std::string& line) { return line.rfind("partial ", 0) == 0; });
+            };
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while(partials() < threads && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if(partials() != threads) {
+                return 1;
+            }
+            std::cout << "unterminated";
+        }
+
+        std::vector<std::string> lines;
+        std::set<std::string> partial;
+        for(const std::string& line : observer.lines) {
+            if(line.rfind("partial ", 0) == 0 || line == "unterminated") {
+                partial.insert(line);
+            } else {
+                lines.push_back(line);
+            }
+        }
+        if(checkLines(lines, threads, count) != 0 || partial.size() != threads + 1) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Test function for bounded buffers and their overflow policies
+ * 
+ * With the observer stalled the buffer must stay within its limit. Whatever a policy drops
+ * must be counted, and every line that is delivered must arrive whole and in order. After
+ * a burst the Mutex engine buffer must shrink back to its initial size.
+ */
+int test015() {
+    class GatedCollector : public LineCollector {
+    public:
+        void update(const std::string& output) override {
+            gate.wait();
+            LineCollector::update(output);
+        }
+
+        std::promise<void> open;
+        std::shared_future<void> gate = open.get_future().share();
+    };
+
+    auto line = [](int i) {
+        return "line " + std::to_string(i) + " " + std::string(40, '.');
+    };
+
+    auto write = [&line](int count) {
+        for(int i = 0; i < count; ++i) {
+            std::string text = line(i) + "\n";
+            std::cout.write(text.data(), text.size());
+        }
+    };
+
+    // Delivered lines must be a subsequence of what was written, and account for everything with the drops
+    auto check = [&line](const std::vector<std::string>& lines, int count, const RedirectStats& stats) {
+        int next = 0;
+        for(const std::string& delivered : lines) {
+            while(next < count && line(next) != delivered) {
+                ++next;
+            }
+            if(next++ == count) {
+                return false;
+            }
+        }
+        return lines.size() + stats.droppedLines == static_cast<std::size_t>(count);
+    };
+
+    struct Case {
+        BufferEngine engine;
+        OverflowPolicy overflow;
+        std::chrono::milliseconds timeout;
+        int count;
+        bool stall;
+    };
+    const Case cases[] = {
+        { BufferEngine::Mutex, OverflowPolicy::DropNewest, std::chrono::milliseconds(0), 2000, true },
+        { BufferEngine::Mutex, OverflowPolicy::DropOldest, std::chrono::milliseconds(0), 2000, true },
+        { BufferEngine::Mutex, OverflowPolicy::Block, std::chrono::milliseconds(1), 400, true },
+        { BufferEngine::Mutex, OverflowPolicy::Block, std::chrono::milliseconds(0), 2000, false },
+        { BufferEngine::LockFree, OverflowPolicy::DropNewest, std::chrono::milliseconds(0), 2000, true },
+    };
+
+    for(const Case& c : cases) {
+        GatedCollector observer;
+        RedirectStats stats;
+        {
+            RedirectOptions options;
+            options.engine = c.engine;
+            options.initialBufferSize = 64;
+            options.maxBufferSize = 8192;
+            options.ringBufferSize = 4096;
+            options.overflow = c.overflow;
+            options.blockTimeout = c.timeout;
+
+            CoutRedirect redirect(options);
+            CoutRedirect::attach(&observer);
+
+            std::thread opener;
+            if(!c.stall) {
+                opener = std::thread([&observer] {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                    observer.open.set_value();
+                });
+            }
+            write(c.count);
+            stats = CoutRedirect::stats();
+            if(c.stall) {
+                observer.open.set_value();
+            } else {
+                opener.join();
+            }
+        }
+
+        if(stats.bufferSize > 8192 ||
+           (c.stall && stats.droppedLines == 0) ||
+           (!c.stall && stats.droppedLines != 0) ||
+           !check(observer.lines, c.count, stats)) {
+            return 1;
+        }
+        if(c.overflow == OverflowPolicy::DropOldest && observer.lines.back() != line(c.count - 1)) {
+            return 1;
+        }
+    }
+
+    GatedCollector observer;
+    {
+        RedirectOptions options;
+        options.engine = BufferEngine::Mutex;
+        options.initialBufferSize = 64;
+
+        CoutRedirect redirect(options);
+        CoutRedirect::attach(&observer);
+        const std::size_t initial = CoutRedirect::stats().bufferSize;
+
+        write(2000);
+        if(CoutRedirect::stats().bufferSize <= initial) {
+            return 1;
+        }
+        observer.open.set_value();
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        for(int i = 0; CoutRedirect::stats().bufferSize != initial; ++i) {
+            if(std::chrono::steady_clock::now() > deadline) {
+                return 1;
+            }
+            std::cout << "after " << i << std::endl;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Test function for FdRedirect
+ * 
+ * Output written to file descriptor 1 by printf, write(2) and a child process must reach
+ * the observers and, byte for byte, the file sink, whether the pump thread delivers the
+ * lines itself or through the dispatcher pool. A line longer than a read must stay whole.
+ */
+int test016() {
+#ifdef LIB_CREDIRECT_ENABLE_FD
+    const std::string longLine(200000, 'l');
+    for(DispatchMode dispatch : { DispatchMode::Thread, DispatchMode::Shared }) {
+        LineCollector observer;
+        std::FILE* file = std::tmpfile();
+        if(!file) {
+            return 1;
+        }
+
+        {
+            RedirectOptions options;
+            options.dispatch = dispatch;
+            FdRedirect redirect(STDOUT_FILENO, options, fileno(file));
+            if(!redirect.active()) {
+                return 1;
+            }
+            redirect.attach(&observer);
+
+            std::printf("printf line\n");
+            std::fflush(stdout);
+            if(::write(STDOUT_FILENO, "write line\n", 11) != 11) {
+                return 1;
+            }
+            if(std::system("echo child line") != 0) {
+                return 1;
+            }
+            std::printf("%s\n", longLine.c_str());
+            std::printf("unterminated");
+        }
+
+        const std::vector<std::string> expected{ "printf line", "write line", "child line", longLine, "unterminated" };
+        if(observer.lines != expected) {
+            return 1;
+        }
+
+        std::string content(longLine.size() + 64, '\0');
+        std::rewind(file);
+        content.resize(std::fread(&content[0], 1, content.size(), file));
+        std::fclose(file);
+        if(content != "printf line\nwrite line\nchild line\n" + longLine + "\nunterminated") {
+            return 1;
+        }
+    }
+    return 0;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Test function for FileSink
+ * 
+ * Lines of concurrent producers must be written whole and in order per producer, in several
+ * batches with the counters matching the file. Lines beyond maxPending must be dropped and
+ * counted, and the destructor must write what is left with the configured line ending.
+ */
+int test017() {
+#ifdef LIB_CREDIRECT_ENABLE_FILE_SINK
+    const char* path = "CRedirectTest_FileSink.log";
+    auto readFile = [path] {
+        std::ifstream file(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    };
+
+    // Lines of concurrent producers are written whole, in order per producer, in several batches
+    std::remove(path);
+    {
+        FileSinkOptions options;
+        options.batchSize = 4096;
+        options.sync = SyncPolicy::EveryBatch;
+        FileSink sink(path, options);
+        if(!sink.active()) {
+            return 1;
+        }
+
+        std::vector<std::thread> threads;
+        for(int t = 0; t < 4; ++t) {
+            threads.emplace_back([&sink, t] {
+                for(int i = 0; i < 1000; ++i) {
+                    sink.update("thread " + std::to_string(t) + " line " + std::to_string(i));
+                    if(i == 500) {
+                        sink.flush();
+                    }
+                }
+            });
+        }
+        for(auto& thread : threads) {
+            thread.join();
+        }
+        sink.flush();
+
+        std::string content = readFile();
+        FileSinkStats stats = sink.stats();
+        if(stats.bytesWritten != content.size() || stats.batches < 2 || stats.syncs < 1 || stats.pending != 0) {
+            return 1;
+        }
+
+        int next[4] = { 0, 0, 0, 0 };
+        std::istringstream lines(content);
+        for(std::string line; std::getline(lines, line); ) {
+            int t = line[7] - '0';
+            if(t < 0 || t > 3 || line != "thread " + std::to_string(t) + " line " + std::to_string(next[t]++)) {
+                return 1;
+            }
+        }
+        if(next[0] != 1000 || next[1] != 1000 || next[2] != 1000 || next[3] != 1000) {
+            return 1;
+        }
+    }
+
+    // Lines beyond maxPending are dropped, the destructor writes what is left
+    std::remove(path);
+    {
+        FileSinkOptions options;
+        options.flushInterval = std::chrono::hours(1);
+        options.maxPending = 10;
+        options.lineEnding = "\r\n";
+        FileSink sink(path, options);
+        sink.update("1234567");
+        sink.update("abc");
+        if(sink.stats().droppedLines != 1 || sink.stats().pending != 9) {
+            return 1;
+        }
+    }
+    bool written = readFile() == "1234567\r\n";
+    std::remove(path);
+    return written ? 0 : 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Test function for FileSink rotation
+ * 
+ * Size based rotation must neither lose nor split a line across its segments, requested
+ * rotations must keep only maxSegments closed segments, and reopen() must switch files
+ * once the new one is open without losing a line.
+ */
+int test018() {
+#ifdef LIB_CREDIRECT_ENABLE_FILE_SINK
+    auto readFile = [](const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    };
+    auto waitRotations = [](FileSink& sink, std::uint64_t count) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while(sink.stats().rotations < count && std::chrono::steady_clock::now() < deadline) {
+            sink.flush();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return sink.stats().rotations == count;
+    };
+
+    std::mutex mtx;
+    std::vector<std::string> segments;
+    FileSinkOptions options;
+    options.flushInterval = std::chrono::milliseconds(1);
+    options.onSegment = [&mtx, &segments](const std::string& segment) {
+        std::lock_guard<std::mutex> lock(mtx);
+        segments.push_back(segment);
+    };
+
+    // Size based rotation loses and splits no line
+    const std::string path = "CRedirectTest_Rotate.log";
+    std::remove(path.c_str());
+    std::string expected;
+    {
+        FileSinkOptions sized = options;
+        sized.rotateSize = 1000;
+        sized.preallocate = true;
+        FileSink sink(path, sized);
+        for(int i = 0; i < 400; ++i) {
+            std::string line = "line " + std::to_string(i) + std::string(40, '.');
+            expected += line + "\n";
+            sink.update(line);
+            if(i % 10 == 9) {
+                sink.flush();
+            }
+        }
+        sink.flush();
+        if(sink.stats().rotations < 2) {
+            return 1;
+        }
+    }
+    std::string content;
+    for(const std::string& segment : segments) {
+        content += readFile(segment);
+        std::remove(segment.c_str());
+    }
+    content += readFile(path);
+    if(content != expected) {
+        return 1;
+    }
+
+    // Requested rotations keep maxSegments segments
+    std::remove(path.c_str());
+    segments.clear();
+    {
+        FileSinkOptions pruned = options;
+        pruned.maxSegments = 1;
+        FileSink sink(path, pruned);
+        for(std::uint64_t i = 1; i <= 2; ++i) {
+            sink.update("segment " + std::to_string(i));
+            sink.flush();
+            sink.rotate();
+            if(!waitRotations(sink, i)) {
+                return 1;
+            }
+        }
+        sink.update("current");
+    }
+    bool pruned = segments.size() == 2 && readFile(segments[0]).empty() && readFile(segments[1]) == "segment 2\n"
+        && readFile(path) == "current\n";
+    std::remove(segments.back().c_str());
+    std::remove(path.c_str());
+    if(!pruned) {
+        return 1;
+    }
+
+    // Reopening switches files once the new one is open
+    const std::string other = "CRedirectTest_Reopen.log";
+    std::remove(other.c_str());
+    {
+        FileSink sink(path, options);
+        sink.update("first");
+        sink.flush();
+        sink.reopen(other);
+        if(!waitRotations(sink, 1)) {
+            return 1;
+        }
+        sink.update("second");
+    }
+    bool reopened = readFile(path) == "first\n" && readFile(other) == "second\n";
+    std::remove(path.c_str());
+    std::remove(other.c_str());
+    return reopened ? 0 : 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Test function for MappedSegmentSink
+ * 
+ * Concurrent batches must roll over small segments without losing or splitting lines, in
+ * order per producer, with the committed byte count matching the segments. A line larger
+ * than a segment must be dropped and counted.
+ */
+int test019() {
+#ifdef LIB_CREDIRECT_ENABLE_FILE_SINK
+    const std::string path = "CRedirectTest_Mapped.log";
+    auto segment = [&path](int index) {
+        char suffix[16];
+        std::snprintf(suffix, sizeof(suffix), ".%06d", index);
+        return path + suffix;
+    };
+    for(int i = 1; i <= 100; ++i) {
+        std::remove(segment(i).c_str());
+    }
+
+    // Concurrent batches roll over small segments without losing or splitting lines
+    MappedSegmentStats stats;
+    {
+        MappedSegmentOptions options;
+        options.segmentSize = 4096;
+        MappedSegmentSink sink(path, options);
+        if(!sink.active()) {
+            return 1;
+        }
+
+        std::vector<std::thread> threads;
+        for(int t = 0; t < 4; ++t) {
+            threads.emplace_back([&sink, t] {
+                for(int i = 0; i < 500; i += 2) {
+                    std::string first = "thread " + std::to_string(t) + " line " + std::to_string(i);
+                    std::string second = "thread " + std::to_string(t) + " line " + std::to_string(i + 1);
+                    const std::string_view batch[] = { first, second };
+                    sink.updateBatch(batch, 2);
+                }
+            });
+        }
+        for(auto& thread : threads) {
+            thread.join();
+        }
+
+        sink.update(std::string(5000, 'x'));
+        stats = sink.stats();
+    }
+    if(stats.segments < 2 || stats.droppedLines != 1) {
+        return 1;
+    }
+
+    std::string content;
+    for(int i = 1; i <= 100; ++i) {
+        std::ifstream file(segment(i), std::ios::binary);
+        content.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        std::remove(segment(i).c_str());
+    }
+    if(content.size() != stats.bytesCommitted) {
+        return 1;
+    }
+
+    int next[4] = { 0, 0, 0, 0 };
+    std::istringstream lines(content);
+    for(std::string line; std::getline(lines, line); ) {
+        int t = line[7] - '0';
+        if(t < 0 || t > 3 || line != "thread " + std::to_string(t) + " line " + std::to_string(next[t]++)) {
+            return 1;
+        }
+    }
+    return next[0] == 500 && next[1] == 500 && next[2] == 500 && next[3] == 500 ? 0 : 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Test function for the capture time and sequence number of lines
+ * 
+ * The monitor thread is held up by a slow observer while lines are written. Their capture
+ * time must still be when they were written, their queueing delay must show the stall,
+ * and their sequence numbers must count the lines of the stream, for both buffer engines
+ * and in Inline dispatch mode.
+ */
+int test020() {
+    using Clock = std::chrono::steady_clock;
+
+    class SlowObserver : public LineObserver {
+    public:
+        void update(std::string_view line) override {
+            if(line == "stall") {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+        }
+    };
+
+    class MetadataCollector : public MetadataObserver {
+    public:
+        void updateBatch(const std::string_view* lines, const LineMetadata* metadata, std::size_t count) override {
+            std::lock_guard<std::mutex> lock(mtx);
+            for(std::size_t i = 0; i < count; ++i) {
+                this->lines.emplace_back(lines[i]);
+                this->metadata.push_back(metadata[i]);
+                received.push_back(Clock::now());
+            }
+        }
+
+        std::mutex mtx;
+        std::vector<std::string> lines;
+        std::vector<LineMetadata> metadata;
+        std::vector<Clock::time_point> received;
+    };
+
+    const int count = 10;
+    const auto tolerance = std::chrono::milliseconds(2);
+    for(int run = 0; run < 3; ++run) {
+        RedirectOptions options;
+        options.engine = run == 1 ? BufferEngine::LockFree : BufferEngine::Mutex;
+        options.dispatch = run == 2 ? DispatchMode::Inline : DispatchMode::Thread;
+
+        SlowObserver slow;
+        MetadataCollector collector;
+        std::vector<Clock::time_point> before, after;
+        {
+            CoutRedirect redirect(options);
+            CoutRedirect::attach(&slow);
+            CoutRedirect::attach(&collector);
+
+            if(options.dispatch == DispatchMode::Thread) {
+                std::cout << "stall" << std::endl;
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            for(int i = 0; i < count; ++i) {
+                before.push_back(Clock::now());
+                std::cout << "line " << i << std::endl;
+                after.push_back(Clock::now());
+            }
+
+            auto deadline = Clock::now() + std::chrono::seconds(5);
+            while(Clock::now() < deadline) {
+                {
+                    std::lock_guard<std::mutex> lock(collector.mtx);
+                    if(collector.lines.size() >= static_cast<std::size_t>(count)) {
+                        break;
+                    }
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            CoutRedirect::detach(&collector);
+            CoutRedirect::detach(&slow);
+        }
+
+        const std::size_t first = options.dispatch == DispatchMode::Thread ? 1 : 0;
+        if(collector.lines.size() != first + count) {
+            return 1;
+        }
+        for(std::size_t i = 0; i < collector.lines.size(); ++i) {
+            if(collector.metadata[i].sequence != i) {
+                return 1;
+            }
+        }
+        for(int i = 0; i < count; ++i) {
+            const LineMetadata& metadata = collector.metadata[first + i];
+            if(collector.lines[first + i] != "line " + std::to_string(i) ||
+               metadata.captured < before[i] - tolerance || metadata.captured > after[i] + tolerance) {
+                return 1;
+            }
+        }
+        if(first == 1 && collector.received[1] - collector.metadata[1].captured < std::chrono::milliseconds(20)) {
+            // The first line was written while the monitor thread was stalled
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Test function for StreamMerger
+ * 
+ * Lines written to cout, cerr and clog must come out of the merger in the order they were
+ * published, and a gap left by a stream that is not merged must only delay the next line.
+ * No line may be held much longer than the window because lines ordered before it arrived
+ * later.
+ */
+int test021() {
+    using Clock = std::chrono::steady_clock;
+
+    class MergedCollector : public MergedObserver {
+    public:
+        void updateBatch(const MergedLine* lines, std::size_t count) override {
+            std::lock_guard<std::mutex> lock(mtx);
+            for(std::size_t i = 0; i < count; ++i) {
+                sources.emplace_back(lines[i].source);
+                this->lines.emplace_back(lines[i].text);
+                metadata.push_back(lines[i].metadata);
+            }
+        }
+
+        bool waitFor(std::size_t count) {
+            auto deadline = Clock::now() + std::chrono::seconds(5);
+            while(Clock::now() < deadline) {
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    if(lines.size() >= count) {
+                        return true;
+                    }
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return false;
+        }
+
+        std::mutex mtx;
+        std::vector<std::string> sources;
+        std::vector<std::string> lines;
+        std::vector<LineMetadata> metadata;
+    };
+
+    const char* names[] = {"cout", "cerr", "clog"};
+
+    // One writer alternating between the streams, the timeline is the order of the writes
+    {
+        const int count = 300;
+        MergedCollector collector;
+        StreamMergerStats stats;
+        {
+            StreamMerger merger(&collector, std::chrono::seconds(1));
+            CoutRedirect cout;
+            CerrRedirect cerr;
+            ClogRedirect clog;
+            MetadataObserver* inputs[] = {merger.input("cout"), merger.input("cerr"), merger.input("clog")};
+            CoutRedirect::attach(inputs[0]);
+            CerrRedirect::attach(inputs[1]);
+            ClogRedirect::attach(inputs[2]);
+
+            for(int i = 0; i < count; ++i) {
+                switch(i % 3) {
+                    case 0: std::cout << "line " << i << std::endl; break;
+                    case 1: std::cerr << "line " << i << "\n"; break;
+                    default: std::clog << "line " << i << std::endl; break;
+                }
+            }
+            if(!collector.waitFor(count)) {
+                return 1;
+            }
+
+            CoutRedirect::detach(inputs[0]);
+            CerrRedirect::detach(inputs[1]);
+            ClogRedirect::detach(inputs[2]);
+
+            // The counters are updated once the observer returns
+            auto deadline = Clock::now() + std::chrono::seconds(5);
+            do {
+                stats = merger.stats();
+            } while(stats.pending != 0 && Clock::now() < deadline);
+        }
+
+        if(collector.lines.size() != static_cast<std::size_t>(count) || stats.merged != static_cast<std::uint64_t>(count) ||
+           stats.late != 0 || stats.forced != 0 || stats.pending != 0) {
+            return 1;
+        }
+        for(int i = 0; i < count; ++i) {
+            if(collector.lines[i] != "line " + std::to_string(i) || collector.sources[i] != names[i % 3] ||
+               collector.metadata[i].sequence != static_cast<std::uint64_t>(i / 3)) {
+                return 1;
+            }
+        }
+    }
+
+    // One writer per stream, the timeline keeps the global order and each stream's own order
+    {
+        const int count = 200;
+        MergedCollector collector;
+        {
+            StreamMerger merger(&collector, std::chrono::seconds(1));
+            CoutRedirect cout;
+            CerrRedirect cerr;
+            ClogRedirect clog;
+            MetadataObserver* inputs[] = {merger.input("cout"), merger.input("cerr"), merger.input("clog")};
+            CoutRedirect::attach(inputs[0]);
+            CerrRedirect::attach(inputs[1]);
+            ClogRedirect::attach(inputs[2]);
+
+            std::vector<std::thread> writers;
+            writers.emplace_back([&] { for(int i = 0; i < count; ++i) std::cout << i << std::endl; });
+            writers.emplace_back([&] { for(int i = 0; i < count; ++i) std::cerr << i << "\n"; });
+            writers.emplace_back([&] { for(int i = 0; i < count; ++i) std::clog << i << std::endl; });
+            for(auto& writer : writers) {
+                writer.join();
+            }
+            if(!collector.waitFor(3 * count)) {
+                return 1;
+            }
+
+            CoutRedirect::detach(inputs[0]);
+            CerrRedirect::detach(inputs[1]);
+            ClogRedirect::detach(inputs[2]);
+        }
+
+        if(collector.lines.size() != static_cast<std::size_t>(3 * count)) {
+            return 1;
+        }
+        int next[3] = {0, 0, 0};
+        for(std::size_t i = 0; i < collector.lines.size(); ++i) {
+            if(i > 0 && collector.metadata[i].globalSequence <= collector.metadata[i - 1].globalSequence) {
+                return 1;
+            }
+            const int source = static_cast<int>(std::find(names, names + 3, collector.sources[i]) - names);
+            if(source == 3 || collector.lines[i] != std::to_string(next[source]++)) {
+                return 1;
+            }
+        }
+    }
+
+    // A line published to a stream that is not merged leaves a gap, the next line waits out the window
+    {
+        const auto window = std::chrono::milliseconds(20);
+        MergedCollector collector;
+        StreamMergerStats stats;
+        Clock::time_point written;
+        {
+            StreamMerger merger(&collector, window);
+            CoutRedirect cout;
+            ClogRedirect clog;
+            MetadataObserver* input = merger.input("cout");
+            CoutRedirect::attach(input);
+
+            std::clog << "unmerged" << std::endl;
+            written = Clock::now();
+            std::cout << "merged" << std::endl;
+            if(!collector.waitFor(1)) {
+                return 1;
+            }
+            if(Clock::now() - written < window) {
+                return 1;
+            }
+
+            CoutRedirect::detach(input);
+            stats = merger.stats();
+        }
+
+        if(collector.lines.size() != 1 || collector.lines[0] != "merged" || stats.late != 0) {
+            return 1;
+        }
+    }
+
+    // A line that arrived first but is ordered after a later arrival is released when its own window ends
+    {
+        const auto window = std::chrono::milliseconds(200);
+        MergedCollector collector;
+        Clock::time_point first;
+        {
+            StreamMerger merger(&collector, window);
+            MetadataObserver* input = merger.input("direct");
+            // Far beyond anything published so far, so neither line continues the sequence
+            const std::uint64_t base = std::uint64_t(1) << 40;
+
+            auto publish = [input](const char* text, std::uint64_t globalSequence) {
+                std::string_view line(text);
+                LineMetadata metadata;
+                metadata.globalSequence = globalSequence;
+                metadata.captured = Clock::now();
+                input->updateBatch(&line, &metadata, 1);
+            };
+
+            first = Clock::now();
+            publish("early", base + 10);
+            std::this_thread::sleep_for(window * 4 / 5);
+            publish("gap", base + 5);
+            if(!collector.waitFor(2)) {
+                return 1;
+            }
+            if(Clock::now() - first > window * 3 / 2) {
+                return 1;
+            }
+        }
+
+        if(collector.lines != std::vector<std::string>{ "gap", "early" }) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Test function for FlightRecorder
+ * 
+ * The ring of a redirected stream must hold its most recent lines, and a crash must dump
+ * them exactly once without changing how the process dies, also when the stack of a
+ * library thread overflows.
+ */
+int test022() {
+#ifdef LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+    using Clock = std::chrono::steady_clock;
+
+    auto contents = [](std::FILE* file) {
+        std::fflush(file);
+        std::string text;
+        char chunk[4096];
+        lseek(fileno(file), 0, SEEK_SET);
+        for(ssize_t n; (n = read(fileno(file), chunk, sizeof(chunk))) > 0;) {
+            text.append(chunk, static_cast<std::size_t>(n));
+        }
+        return text;
+    };
+
+    // The ring of a redirected stream keeps the most recent complete lines
+    {
+        class LineCounter : public LineObserver {
+        public:
+            void update(std::string_view) override { ++count; }
+            std::atomic<int> count{0};
+        };
+
+        RedirectOptions options;
+        options.flightRecorderSize = 256;
+        LineCounter counter;
+        std::FILE* file = std::tmpfile();
+        {
+            CoutRedirect redirect(options);
+            CoutRedirect::attach(&counter);
+            for(int i = 0; i < 100; ++i) {
+                std::cout << "line " << i << std::endl;
+            }
+            auto deadline = Clock::now() + std::chrono::seconds(5);
+            while(counter.count < 100 && Clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            FlightRecorder::dump(fileno(file));
+            CoutRedirect::detach(&counter);
+        }
+
+        const std::string text = contents(file);
+        std::fclose(file);
+        const std::string header = "--- cout ---\n";
+        if(text.compare(0, header.size(), header) != 0 || text.size() > header.size() + 256 ||
+           text.size() < header.size() + 200) {
+            return 1;
+        }
+        std::istringstream lines(text.substr(header.size()));
+        std::string line;
+        int expected = -1;
+        while(std::getline(lines, line)) {
+            if(expected < 0) {
+                expected = std::stoi(line.substr(5));
+            }
+            if(line != "line " + std::to_string(expected++)) {
+                return 1;
+            }
+        }
+        if(expected != 100) {
+            return 1;
+        }
+    }
+
+    // Recorders come and go while another thread dumps them
+    {
+        std::FILE* file = std::fopen("/dev/null", "w");
+        std::atomic<bool> done{false};
+        std::thread dumper([&] {
+            while(!done) {
+                FlightRecorder::dump(fileno(file));
+            }
+        });
+        for(int i = 0; i < 200; ++i) {
+            FlightRecorder recorder("transient", 4096);
+            recorder.update("line " + std::to_string(i));
+        }
+        done = true;
+        dumper.join();
+        std::fclose(file);
+    }
+
+    // A crash dumps the recorders once to the installed descriptor, then dies of the same signal
+    for(int crash = 0; crash < 2; ++crash) {
+        std::FILE* file = std::tmpfile();
+        std::fflush(nullptr);
+        pid_t child = fork();
+        if(child < 0) {
+            return 1;
+        }
+        if(child == 0) {
+            FlightRecorder recorder("crash", 1024);
+            FlightRecorder::install(fileno(file));
+            for(int i = 0; i < 10; ++i) {
+                recorder.update("before crash " + std::to_string(i));
+            }
+            if(crash == 0) {
+                std::abort();
+            }
+            std::terminate();
+        }
+
+        int status = 0;
+        waitpid(child, &status, 0);
+        const std::string text = contents(file);
+        std::fclose(file);
+        if(!WIFSIGNALED(status) || WTERMSIG(status) != SIGABRT) {
+            return 1;
+        }
+        const std::string::size_type header = text.find("--- crash ---\n");
+        if(header == std::string::npos || text.find("--- crash ---\n", header + 1) != std::string::npos ||
+           text.find("before crash 0\n") == std::string::npos || text.find("before crash 9\n") == std::string::npos) {
+            return 1;
+        }
+    }
+
+#if !defined(__SANITIZE_THREAD__) && !defined(__SANITIZE_ADDRESS__)
+    // A stack overflow on the monitor thread is dumped from the alternate stack of that thread,
+    // sanitizers handle SIGSEGV themselves
+    {
+        class Overflow : public LineObserver {
+        public:
+            void update(std::string_view line) override {
+                if(line == "overflow") {
+                    recurse(0);
+                }
+            }
+
+            static int recurse(int depth) {
+                volatile char frame[1024];
+                frame[0] = static_cast<char>(depth);
+                return recurse(depth + 1) + frame[0];
+            }
+        };
+
+        std::FILE* file = std::tmpfile();
+        std::fflush(nullptr);
+        pid_t child = fork();
+        if(child < 0) {
+            return 1;
+        }
+        if(child == 0) {
+            RedirectOptions options;
+            options.flightRecorderSize = 1024;
+            Overflow overflow;
+            CoutRedirect redirect(options);
+            CoutRedirect::attach(&overflow);
+            FlightRecorder::install(fileno(file));
+            std::cout << "before overflow" << std::endl;
+            std::cout << "overflow" << std::endl;
+            std::this_thread::sleep_for(std::chrono::seconds(5));
+            std::_Exit(0);
+        }
+
+        int status = 0;
+        waitpid(child, &status, 0);
+        const std::string text = contents(file);
+        std::fclose(file);
+        if(!WIFSIGNALED(status) || WTERMSIG(status) != SIGSEGV ||
+           text.find("--- cout ---\nbefore overflow\noverflow\n") == std::string::npos) {
+            return 1;
+        }
+    }
+#endif
+#endif
+    return 0;
+}
+
+/**
+ * @brief Test function for MessageRouter
+ * 
+ * A message must reach the observers subscribed to its level and to one of its
+ * destinations, and only those. A destination must not appear in the coverage before
+ * a publish to it reaches its new observer.
+ */
+int test023() {
+    class Collector : public LineObserver {
+    public:
+        void update(std::string_view line) override {
+            std::lock_guard<std::mutex> lock(mtx);
+            lines.emplace_back(line);
+        }
+
+        std::mutex mtx;
+        std::vector<std::string> lines;
+    };
+
+    enum { Console = 1u << 0, File = 1u << 1, Error = 1u << 2 };
+    enum { Debug = 0, Info = 1, Critical = 2 };
+
+    MessageRouter router;
+    Collector everything;
+    Collector file;
+    Collector critical;
+
+    if(router.coverage(Info) != 0 || router.publish("nobody", Info, File)) {
+        return 1;
+    }
+
+    router.attach(&everything);
+    router.attach(&file, MessageRouter::kAll, File);
+    router.attach(&critical, 1u << Critical);
+    if(router.coverage(Debug) != MessageRouter::kAll || router.coverage(40) != 0) {
+        return 1;
+    }
+
+    router.publish("console", Info, Console);
+    router.publish("to file", Debug, File | Console);
+    std::string_view batch[] = {"fatal 1", "fatal 2"};
+    router.publish(batch, 2, Critical, Error);
+
+    if(everything.lines != std::vector<std::string>{"console", "to file", "fatal 1", "fatal 2"} ||
+       file.lines != std::vector<std::string>{"to file"} ||
+       critical.lines != std::vector<std::string>{"fatal 1", "fatal 2"}) {
+        return 1;
+    }
+
+    // Attaching again replaces the masks, detaching stops the delivery
+    router.detach(&everything);
+    router.attach(&file, 1u << Info, Console);
+    if(router.coverage(Debug) != 0 || router.coverage(Info) != Console || router.coverage(Critical) != MessageRouter::kAll) {
+        return 1;
+    }
+    if(router.publish("debug", Debug, Console) || !router.publish("info", Info, Console | File)) {
+        return 1;
+    }
+    if(everything.lines.size() != 4 || file.lines.back() != "info" || critical.lines.size() != 2) {
+        return 1;
+    }
+
+    // Concurrent publishes while the subscriptions change
+    {
+        const int count = 2000;
+        std::atomic<bool> done(false);
+        std::thread publisher([&] {
+            for(int i = 0; i < count; ++i) {
+                router.publish("concurrent", Critical, Error);
+            }
+            done = true;
+        });
+        while(!done) {
+            router.attach(&everything, 1u << Critical, Error);
+            router.detach(&everything);
+        }
+        publisher.join();
+        if(critical.lines.size() != 2 + count) {
+            return 1;
+        }
+    }
+
+    // A destination is covered only once an observer receives it
+    for(int round = 0; round < 100; ++round) {
+        MessageRouter growing;
+        Collector observers[32];
+        std::atomic<bool> missed(false);
+        std::thread publisher([&] {
+            std::uint32_t covered = 0;
+            while(covered != MessageRouter::kAll) {
+                covered = growing.coverage(Critical);
+                for(unsigned destination = 0; destination < 32; ++destination) {
+                    if((covered & (1u << destination)) && !growing.publish("covered", Critical, 1u << destination)) {
+                        missed = true;
+                    }
+                }
+            }
+        });
+        for(unsigned destination = 0; destination < 32; ++destination) {
+            growing.attach(&observers[destination], 1u << Critical, 1u << destination);
+        }
+        publisher.join();
+        if(missed) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Test function for writes that fill the Mutex engine buffer exactly
+ * 
+ * A line as large as the buffer grows to leaves no put area once it is published. Writing
+ * it again after the reader drained the buffer must rebuild the put area and not hang.
+ */
+int test024() {
+    for(std::size_t size = 4096; size <= 65536; size *= 2) {
+        for(std::size_t length : { size - 1, size, size + 1 }) {
+            const std::string line = std::string(length - 1, 'x') + "\n";
+            LineCollector observer;
+            {
+                RedirectOptions options;
+                options.engine = BufferEngine::Mutex;
+
+                CoutRedirect redirect(options);
+                CoutRedirect::attach(&observer);
+                for(int i = 0; i < 4; ++i) {
+                    std::cout << line;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                }
+            }
+            if(observer.lines != std::vector<std::string>(4, line.substr(0, length - 1))) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Test function for nested notifications in Inline dispatch mode
+ * 
+ * An observer of std::cout that writes several lines to std::cerr notifies the observers
+ * of std::cerr on the same thread before it returns. The metadata of the std::cout line
+ * must be left untouched for the observer and for the observers called after it.
+ */
+int test025() {
+    class MetadataCollector : public MetadataObserver {
+    public:
+        void updateBatch(const std::string_view* lines, const LineMetadata* metadata, std::size_t count) override {
+            for(std::size_t i = 0; i < count; ++i) {
+                sequences.push_back(metadata[i].globalSequence);
+            }
+        }
+
+        std::vector<std::uint64_t> sequences;
+    };
+
+    class Forwarder : public MetadataCollector {
+    public:
+        void updateBatch(const std::string_view* lines, const LineMetadata* metadata, std::size_t count) override {
+            const std::uint64_t before = metadata[0].globalSequence;
+            std::cerr << std::string(64, 'x') << "\n" << std::string(64, 'y') << "\n" << std::string(64, 'z') << std::endl;
+            nestedIntact = metadata[0].globalSequence == before;
+            MetadataCollector::updateBatch(lines, metadata, count);
+        }
+
+        bool nestedIntact = false;
+    };
+
+    Forwarder forwarder;
+    MetadataCollector after, nested;
+    {
+        CoutRedirect coutRedirect(DispatchMode::Inline);
+        CerrRedirect cerrRedirect(DispatchMode::Inline);
+        CoutRedirect::attach(&forwarder);
+        CoutRedirect::attach(&after);
+        CerrRedirect::attach(&nested);
+
+        std::cout << "forward" << std::endl;
+
+        CerrRedirect::detach(&nested);
+        CoutRedirect::detach(&after);
+        CoutRedirect::detach(&forwarder);
+    }
+
+    return forwarder.nestedIntact && nested.sequences.size() == 3 &&
+           forwarder.sequences.size() == 1 && forwarder.sequences == after.sequences ? 0 : 1;
 }
 
 int parseArguments(int argc, char** argv) {
@@ -129,6 +1911,50 @@ int main(int argc, char** argv) {
             return test002();
         case 3:
             return test003();
+        case 4:
+            return test004();
+        case 5:
+            return test005();
+        case 6:
+            return test006();
+        case 7:
+            return test007();
+        case 8:
+            return test008();
+        case 9:
+            return test009();
+        case 10:
+            return test010();
+        case 11:
+            return test011();
+        case 12:
+            return test012();
+        case 13:
+            return test013();
+        case 14:
+            return test014();
+        case 15:
+            return test015();
+        case 16:
+            return test016();
+        case 17:
+            return test017();
+        case 18:
+            return test018();
+        case 19:
+            return test019();
+        case 20:
+            return test020();
+        case 21:
+            return test021();
+        case 22:
+            return test022();
+        case 23:
+            return test023();
+        case 24:
+            return test024();
+        case 25:
+            return test025();
 
         default:
             std::cerr << "Unknown test number: " << testNumber << std::endl;
@@ -0,0 +1,180 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#include <CRedirect_config.h>
+#include <AsyncObserver.hpp>
+#include <FlightRecorder.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+/**
+ * @file AsyncObserver.cpp
+ * @brief Implementation of the AsyncObserver class.
+ *
+ * The queue is a ring of std::string slots. The worker swaps the whole ring with a
+ * second one of the same size and delivers from that copy without holding the lock,
+ * so the strings keep their capacity and steady state queuing does not allocate.
+ */
+
+/**
+ * @struct AsyncObserver::AsyncObserverPimpl
+ * @brief Private implementation (Pimpl) for the AsyncObserver class.
+ *
+ * @details
+ * - `observer`: The wrapped observer, only called from `worker`.
+ * - `queue`: Ring of queued lines, `count` lines starting at slot `start`.
+ * - `batch`: Ring being delivered by the worker, swapped with `queue`.
+ * - `inFlight`: Number of lines in `batch` that are being delivered.
+ * - `stopping`: Set by the destructor, the worker exits once the queue is empty.
+ */
+struct HIDDEN AsyncObserver::AsyncObserverPimpl {
+    AsyncObserverPimpl(LineObserver* observer, std::size_t capacity, OverflowPolicy overflow) :
+        observer(observer),
+        capacity(std::max<std::size_t>(capacity, 1)),
+        overflow(overflow),
+        queue(this->capacity),
+        batch(this->capacity),
+        start(0),
+        count(0),
+        inFlight(0),
+        stopping(false) {}
+
+    LineObserver* observer;
+    const std::size_t capacity;
+    const OverflowPolicy overflow;
+    std::vector<std::string> queue;
+    std::vector<std::string> batch;
+    std::size_t start;
+    std::size_t count;
+    std::size_t inFlight;
+    bool stopping;
+    AsyncObserverStats stats;
+    mutable std::mutex mtx;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::thread worker;
+};
+
+AsyncObserver::AsyncObserver(LineObserver* observer, std::size_t capacity, OverflowPolicy overflow)
+{
+    d = new AsyncObserverPimpl(observer, capacity, overflow);
+    d->worker = std::thread(&AsyncObserver::deliver, this);
+}
+
+AsyncObserver::~AsyncObserver()
+{
+    {
+        std::lock_guard<std::mutex> lock(d->mtx);
+        d->stopping = true;
+    }
+    d->notEmpty.notify_all();
+    d->notFull.notify_all();
+    if(d->worker.joinable()) {
+        d->worker.join();
+    }
+    delete d;
+}
+
+void AsyncObserver::update(std::string_view line)
+{
+    updateBatch(&line, 1);
+}
+
+void AsyncObserver::updateBatch(const std::string_view* lines, std::size_t count)
+{
+    std::unique_lock<std::mutex> lock(d->mtx);
+    for(std::size_t i = 0; i < count; ++i) {
+        if(d->count == d->capacity) {
+            if(d->overflow == OverflowPolicy::Block) {
+                // The worker may be asleep with a full queue, wake it before waiting for room
+                d->notEmpty.notify_one();
+                d->notFull.wait(lock, [this] { return d->count < d->capacity || d->stopping; });
+            } else if(d->overflow == OverflowPolicy::DropOldest) {
+                d->start = (d->start + 1) % d->capacity;
+                --d->count;
+                ++d->stats.dropped;
+            }
+
+            if(d->count == d->capacity) {
+                ++d->stats.dropped;
+                continue;
+            }
+        }
+
+        d->queue[(d->start + d->count) % d->capacity].assign(lines[i].data(), lines[i].size());
+        ++d->count;
+        ++d->stats.enqueued;
+        d->stats.maxPending = std::max(d->stats.maxPending, d->count + d->inFlight);
+    }
+    lock.unlock();
+    d->notEmpty.notify_one();
+}
+
+AsyncObserverStats AsyncObserver::stats() const
+{
+    std::lock_guard<std::mutex> lock(d->mtx);
+    AsyncObserverStats result = d->stats;
+    result.pending = d->count + d->inFlight;
+    return result;
+}
+
+/**
+ * @brief Worker loop, delivers the queued lines in batches until stopped and drained.
+ */
+void HIDDEN AsyncObserver::deliver()
+{
+#ifdef LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+    FlightRecorder::installAlternateStack();
+#endif
+    std::vector<std::string_view> views;
+    std::unique_lock<std::mutex> lock(d->mtx);
+
+    for(;;) {
+        d->notEmpty.wait(lock, [this] { return d->count > 0 || d->stopping; });
+        if(d->count == 0) {
+            break;
+        }
+
+        std::swap(d->queue, d->batch);
+        const std::size_t start = d->start;
+        const std::size_t count = d->count;
+        d->start = 0;
+        d->count = 0;
+        d->inFlight = count;
+        lock.unlock();
+        d->notFull.notify_all();
+
+        views.clear();
+        for(std::size_t i = 0; i < count; ++i) {
+            views.emplace_back(d->batch[(start + i) % d->capacity]);
+        }
+        d->observer->updateBatch(views.data(), views.size());
+
+        lock.lock();
+        d->inFlight = 0;
+        d->stats.delivered += count;
+    }
+}
+
+LIB_CREDIRECT_NAMESPACE_END
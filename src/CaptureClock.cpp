@@ -0,0 +1,174 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#include <CRedirect_config.h>
+#include <CaptureClock.hpp>
+
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+#if defined(LIB_CREDIRECT_CAPTURE_TSC) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# include <cpuid.h>
+# include <x86intrin.h>
+# define LIB_CREDIRECT_HAVE_TSC
+#endif
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+/**
+ * @file CaptureClock.cpp
+ * @brief Implementation of the CaptureClock class.
+ *
+ * The rate of the time stamp counter is measured against steady_clock over the time
+ * elapsed since the library was loaded. Every conversion snapshot older than a second
+ * is replaced by a fresh measurement, anchored at its own sample, so the error of a
+ * converted time shrinks as the process runs and never accumulates from an old anchor.
+ */
+
+namespace {
+    constexpr std::int64_t kMinimumWindow = 1000000;        // 1 ms before the first rate is trusted
+    constexpr std::int64_t kRefreshInterval = 1000000000;   // 1 s between measurements
+
+    std::int64_t steadyNanoseconds() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief Returns true if the time stamp counter ticks at a constant rate in every power state.
+     */
+    bool invariantTsc() {
+#ifdef LIB_CREDIRECT_HAVE_TSC
+        unsigned eax, ebx, ecx, edx;
+        if(__get_cpuid(0x80000000u, &eax, &ebx, &ecx, &edx) && eax >= 0x80000007u &&
+           __get_cpuid(0x80000007u, &eax, &ebx, &ecx, &edx)) {
+            return (edx & (1u << 8)) != 0;
+        }
+#endif
+        return false;
+    }
+
+    /**
+     * @brief Calibration shared by every thread, the origin is taken when the library is loaded.
+     */
+    struct Calibration {
+        Calibration() : tsc(invariantTsc()) {
+            sample(originTicks, originNanoseconds);
+        }
+
+        /**
+         * @brief Reads both clocks, the counter on either side of steady_clock to pair them closely.
+         */
+        void sample(std::uint64_t& ticks, std::int64_t& nanoseconds) const {
+#ifdef LIB_CREDIRECT_HAVE_TSC
+            if(tsc) {
+                std::uint64_t before = __rdtsc();
+                nanoseconds = steadyNanoseconds();
+                ticks = before + (__rdtsc() - before) / 2;
+                return;
+            }
+#endif
+            nanoseconds = steadyNanoseconds();
+            ticks = static_cast<std::uint64_t>(nanoseconds);
+        }
+
+        const bool tsc;
+        std::uint64_t originTicks = 0;
+        std::int64_t originNanoseconds = 0;
+        std::mutex mtx;
+        bool measured = false;
+        std::int64_t measuredAt = 0;
+        CaptureClock::Conversion current;
+    };
+
+    Calibration& calibration() {
+        static Calibration instance;
+        return instance;
+    }
+
+    // Take the origin at load time so that the first conversion rarely has to wait
+    const bool originTaken = (calibration(), true);
+
+    // Shared by every stream, on a cache line of its own since all writers touch it
+    alignas(64) std::atomic<std::uint64_t> globalSequence{0};
+}
+
+std::uint64_t CaptureClock::now()
+{
+#ifdef LIB_CREDIRECT_HAVE_TSC
+    static const bool tsc = calibration().tsc;
+    if(tsc) {
+        return __rdtsc();
+    }
+#endif
+    return static_cast<std::uint64_t>(steadyNanoseconds());
+}
+
+std::uint64_t CaptureClock::nextSequence()
+{
+    return globalSequence.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+std::uint64_t CaptureClock::lastSequence()
+{
+    return globalSequence.load(std::memory_order_relaxed);
+}
+
+CaptureClock::Conversion CaptureClock::conversion()
+{
+    Calibration& state = calibration();
+    if(!state.tsc) {
+        // Ticks already are steady_clock nanoseconds
+        return Conversion();
+    }
+
+    std::lock_guard<std::mutex> lock(state.mtx);
+    std::int64_t now = steadyNanoseconds();
+    if(state.measured && now - state.measuredAt < kRefreshInterval) {
+        return state.current;
+    }
+
+    while(now - state.originNanoseconds < kMinimumWindow) {
+        std::this_thread::yield();
+        now = steadyNanoseconds();
+    }
+
+    std::uint64_t ticks;
+    std::int64_t nanoseconds;
+    state.sample(ticks, nanoseconds);
+    state.current.anchorTicks = ticks;
+    state.current.anchorNanoseconds = nanoseconds;
+    state.current.nanosecondsPerTick = static_cast<double>(nanoseconds - state.originNanoseconds) /
+                                       static_cast<double>(ticks - state.originTicks);
+    state.measured = true;
+    state.measuredAt = nanoseconds;
+    return state.current;
+}
+
+std::chrono::steady_clock::time_point CaptureClock::Conversion::toTimePoint(std::uint64_t ticks) const
+{
+    // Signed, a reading taken before the anchor converts to an earlier time
+    const std::int64_t delta = static_cast<std::int64_t>(ticks - anchorTicks);
+    const std::int64_t nanoseconds = anchorNanoseconds +
+        static_cast<std::int64_t>(std::llround(static_cast<double>(delta) * nanosecondsPerTick));
+    return std::chrono::steady_clock::time_point(
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(nanoseconds)));
+}
+
+LIB_CREDIRECT_NAMESPACE_END
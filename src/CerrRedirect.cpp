@@ -56,13 +56,40 @@ LIB_CREDIRECT_NAMESPACE_BEGIN
  * 
  * This constructor initializes the CerrRedirect instance, setting up the custom stream buffer
  * and redirecting std::cerr to it. It also starts a monitoring thread to process output from the stream.
+ * 
+ * The redirection uses defaultOptions().
+ */
+CerrRedirect::CerrRedirect() : CerrRedirect(defaultOptions()) {
+}
+
+/**
+ * @brief Constructor for the CerrRedirect class with a dispatch mode.
+ * 
+ * The redirection uses defaultOptions() with the dispatch mode replaced.
+ * 
+ * @param mode Dispatch mode used for the redirected stream.
+ */
+CerrRedirect::CerrRedirect(DispatchMode mode) : CerrRedirect([mode] {
+        RedirectOptions options = defaultOptions();
+        options.dispatch = mode;
+        return options;
+    }()) {
+}
+
+/**
+ * @brief Constructor for the CerrRedirect class with explicit redirect options.
+ * 
+ * The options are only used when this is the first instance, otherwise the
+ * already running redirection of std::cerr is shared.
+ * 
+ * @param options Buffer engine and sizes used for the redirected stream.
  */
-CerrRedirect::CerrRedirect() {
+CerrRedirect::CerrRedirect(const RedirectOptions& options) {
     static std::mutex initMutex;
     std::lock_guard<std::mutex> lock(initMutex);
     // Ensure that the static instance is created only once
     if(nullptr == streamRedirect) {
-        streamRedirect = new StreamRedirect(std::cerr);
+        streamRedirect = new StreamRedirect(std::cerr, options, "cerr");
     }
 }
 
@@ -78,6 +105,7 @@ CerrRedirect::~CerrRedirect() {
     // Ensure that the static instance is cleaned up only once
     if(streamRedirect) {
         delete streamRedirect;
+        streamRedirect = nullptr;
     }
 }
 
@@ -105,6 +133,63 @@ void CerrRedirect::detach(StreamObserver* observer) {
     streamRedirect->detach(observer);
 }
 
+/**
+ * @brief Attaches a zero-copy observer to the CerrRedirect instance.
+ * 
+ * @param observer Pointer to the LineObserver instance to attach.
+ */
+void CerrRedirect::attach(LineObserver* observer) {
+    streamRedirect->attach(observer);
+}
+
+/**
+ * @brief Detaches a zero-copy observer from the CerrRedirect instance.
+ * 
+ * @param observer Pointer to the LineObserver instance to detach.
+ */
+void CerrRedirect::detach(LineObserver* observer) {
+    streamRedirect->detach(observer);
+}
+
+/**
+ * @brief Attaches an observer that receives line metadata to the CerrRedirect instance.
+ * 
+ * @param observer Pointer to the MetadataObserver instance to attach.
+ */
+void CerrRedirect::attach(MetadataObserver* observer) {
+    streamRedirect->attach(observer);
+}
+
+/**
+ * @brief Detaches an observer that receives line metadata from the CerrRedirect instance.
+ * 
+ * @param observer Pointer to the MetadataObserver instance to detach.
+ */
+void CerrRedirect::detach(MetadataObserver* observer) {
+    streamRedirect->detach(observer);
+}
+
+/**
+ * @brief Returns the counters of the redirected std::cerr.
+ * 
+ * @return Data dropped by the overflow policy and the buffer size.
+ */
+RedirectStats CerrRedirect::stats() {
+    return streamRedirect->stats();
+}
+
+/**
+ * @brief Returns the options used by the default constructor.
+ * 
+ * std::cerr is unbuffered and used for output that should be seen immediately,
+ * so its monitor thread is woken on every write rather than on newlines only.
+ */
+RedirectOptions CerrRedirect::defaultOptions() {
+    RedirectOptions options;
+    options.wakeup = WakeupPolicy::EveryWrite;
+    return options;
+}
+
 #ifdef LIB_CREDIRECT_AUTOSTART_CERR
 /**
  * @brief Automatically starts the CerrRedirect instance if LIB_CREDIRECT_AUTOSTART_CERR is defined.
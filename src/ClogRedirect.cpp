@@ -56,13 +56,40 @@ StreamRedirect* ClogRedirect::streamRedirect = nullptr;
  * This constructor initializes the ClogRedirect instance by creating a new
  * ClogRedirectPimpl object, redirecting std::clog to a custom stream buffer,
  * and starting a monitoring thread to process output from the stream.
+ * 
+ * The redirection uses the default RedirectOptions.
  */
-ClogRedirect::ClogRedirect() { 
+ClogRedirect::ClogRedirect() : ClogRedirect(RedirectOptions()) {
+}
+
+/**
+ * @brief Constructor for the ClogRedirect class with a dispatch mode.
+ * 
+ * The redirection uses the default RedirectOptions with the dispatch mode replaced.
+ * 
+ * @param mode Dispatch mode used for the redirected stream.
+ */
+ClogRedirect::ClogRedirect(DispatchMode mode) : ClogRedirect([mode] {
+        RedirectOptions options = RedirectOptions();
+        options.dispatch = mode;
+        return options;
+    }()) {
+}
+
+/**
+ * @brief Constructor for the ClogRedirect class with explicit redirect options.
+ * 
+ * The options are only used when this is the first instance, otherwise the
+ * already running redirection of std::clog is shared.
+ * 
+ * @param options Buffer engine and sizes used for the redirected stream.
+ */
+ClogRedirect::ClogRedirect(const RedirectOptions& options) {
     static std::mutex initMutex;
     std::lock_guard<std::mutex> lock(initMutex);
     // Ensure that the ClogRedirectPimpl instance is created only once
     if(nullptr == streamRedirect) {
-        streamRedirect = new StreamRedirect(std::clog);
+        streamRedirect = new StreamRedirect(std::clog, options, "clog");
     }
 }
 
@@ -78,6 +105,7 @@ ClogRedirect::~ClogRedirect() {
     // Ensure that the ClogRedirectPimpl instance is deleted only once
     if(streamRedirect) {
         delete streamRedirect;
+        streamRedirect = nullptr;
     }
 }
 
@@ -105,6 +133,51 @@ void ClogRedirect::detach(StreamObserver* observer) {
     streamRedirect->detach(observer);
 }
 
+/**
+ * @brief Attaches a zero-copy observer to the ClogRedirect instance.
+ * 
+ * @param observer Pointer to the LineObserver instance to attach.
+ */
+void ClogRedirect::attach(LineObserver* observer) {
+    streamRedirect->attach(observer);
+}
+
+/**
+ * @brief Detaches a zero-copy observer from the ClogRedirect instance.
+ * 
+ * @param observer Pointer to the LineObserver instance to detach.
+ */
+void ClogRedirect::detach(LineObserver* observer) {
+    streamRedirect->detach(observer);
+}
+
+/**
+ * @brief Attaches an observer that receives line metadata to the ClogRedirect instance.
+ * 
+ * @param observer Pointer to the MetadataObserver instance to attach.
+ */
+void ClogRedirect::attach(MetadataObserver* observer) {
+    streamRedirect->attach(observer);
+}
+
+/**
+ * @brief Detaches an observer that receives line metadata from the ClogRedirect instance.
+ * 
+ * @param observer Pointer to the MetadataObserver instance to detach.
+ */
+void ClogRedirect::detach(MetadataObserver* observer) {
+    streamRedirect->detach(observer);
+}
+
+/**
+ * @brief Returns the counters of the redirected std::clog.
+ * 
+ * @return Data dropped by the overflow policy and the buffer size.
+ */
+RedirectStats ClogRedirect::stats() {
+    return streamRedirect->stats();
+}
+
 #ifdef LIB_CREDIRECT_AUTOSTART_CLOG
 /**
  * @brief Automatically starts the ClogRedirect instance if LIB_CREDIRECT_AUTOSTART_CLOG is defined.
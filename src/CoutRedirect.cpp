@@ -57,14 +57,41 @@ StreamRedirect* CoutRedirect::streamRedirect = nullptr;
  * This constructor initializes the CoutRedirect instance by creating a new
  * CoutRedirectPimpl object, redirecting std::cout to a custom stream buffer,
  * and starting a monitoring thread to process output from the stream.
+ * 
+ * The redirection uses the default RedirectOptions.
  */
-CoutRedirect::CoutRedirect() { 
+CoutRedirect::CoutRedirect() : CoutRedirect(RedirectOptions()) {
+}
+
+/**
+ * @brief Constructor for the CoutRedirect class with a dispatch mode.
+ * 
+ * The redirection uses the default RedirectOptions with the dispatch mode replaced.
+ * 
+ * @param mode Dispatch mode used for the redirected stream.
+ */
+CoutRedirect::CoutRedirect(DispatchMode mode) : CoutRedirect([mode] {
+        RedirectOptions options = RedirectOptions();
+        options.dispatch = mode;
+        return options;
+    }()) {
+}
+
+/**
+ * @brief Constructor for the CoutRedirect class with explicit redirect options.
+ * 
+ * The options are only used when this is the first instance, otherwise the
+ * already running redirection of std::cout is shared.
+ * 
+ * @param options Buffer engine and sizes used for the redirected stream.
+ */
+CoutRedirect::CoutRedirect(const RedirectOptions& options) {
     static std::mutex initMutex;
     std::lock_guard<std::mutex> lock(initMutex);
 
     // Ensure that the CoutRedirectPimpl instance is created only once
     if(nullptr == streamRedirect) {
-        streamRedirect = new StreamRedirect(std::cout);
+        streamRedirect = new StreamRedirect(std::cout, options, "cout");
     }
 }
 
@@ -81,6 +108,7 @@ CoutRedirect::~CoutRedirect() {
     // Ensure that the CoutRedirectPimpl instance is deleted only once
     if(streamRedirect) {
         delete streamRedirect;
+        streamRedirect = nullptr;
     }
 }
 
@@ -108,6 +136,51 @@ void CoutRedirect::detach(StreamObserver* observer) {
     streamRedirect->detach(observer);
 }
 
+/**
+ * @brief Attaches a zero-copy observer to the CoutRedirect instance.
+ * 
+ * @param observer Pointer to the LineObserver instance to attach.
+ */
+void CoutRedirect::attach(LineObserver* observer) {
+    streamRedirect->attach(observer);
+}
+
+/**
+ * @brief Detaches a zero-copy observer from the CoutRedirect instance.
+ * 
+ * @param observer Pointer to the LineObserver instance to detach.
+ */
+void CoutRedirect::detach(LineObserver* observer) {
+    streamRedirect->detach(observer);
+}
+
+/**
+ * @brief Attaches an observer that receives line metadata to the CoutRedirect instance.
+ * 
+ * @param observer Pointer to the MetadataObserver instance to attach.
+ */
+void CoutRedirect::attach(MetadataObserver* observer) {
+    streamRedirect->attach(observer);
+}
+
+/**
+ * @brief Detaches an observer that receives line metadata from the CoutRedirect instance.
+ * 
+ * @param observer Pointer to the MetadataObserver instance to detach.
+ */
+void CoutRedirect::detach(MetadataObserver* observer) {
+    streamRedirect->detach(observer);
+}
+
+/**
+ * @brief Returns the counters of the redirected std::cout.
+ * 
+ * @return Data dropped by the overflow policy and the buffer size.
+ */
+RedirectStats CoutRedirect::stats() {
+    return streamRedirect->stats();
+}
+
 #ifdef LIB_CREDIRECT_AUTOSTART_COUT
 /**
  * @brief Automatically starts the CoutRedirect instance if LIB_CREDIRECT_AUTOSTART_COUT is defined.
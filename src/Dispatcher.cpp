@@ -0,0 +1,210 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#include <CRedirect_config.h>
+#include <Dispatcher.hpp>
+#include <FlightRecorder.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+/**
+ * @file Dispatcher.cpp
+ * @brief Implementation of the Dispatcher class.
+ *
+ * `Task::scheduled` is set by whoever queues the task and cleared by the thread that takes
+ * it from the queue, before the task runs. A writer that publishes while the task runs
+ * therefore finds the flag clear and schedules it again, which sets `rerun` instead of
+ * queuing it a second time, so nothing published is left behind and the task never runs
+ * on two threads at once.
+ */
+
+/**
+ * @struct Dispatcher::DispatcherPimpl
+ * @brief Private implementation (Pimpl) for the Dispatcher class.
+ */
+struct HIDDEN Dispatcher::DispatcherPimpl {
+    struct Timer {
+        std::chrono::steady_clock::time_point deadline;
+        Task* task;
+    };
+
+    DispatcherPimpl() : stopping(false) {}
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::condition_variable finished;
+    std::deque<Task*> ready;
+    std::vector<Timer> timers;
+    std::vector<std::thread> threads;
+    bool stopping;
+};
+
+Dispatcher::Dispatcher(std::size_t threads)
+{
+    d = new DispatcherPimpl();
+    for(std::size_t i = 0; i < std::max<std::size_t>(threads, 1); ++i) {
+        d->threads.emplace_back(&Dispatcher::dispatch, this);
+    }
+}
+
+Dispatcher::~Dispatcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(d->mtx);
+        d->stopping = true;
+    }
+    d->cv.notify_all();
+    for(auto& thread : d->threads) {
+        thread.join();
+    }
+    delete d;
+}
+
+std::shared_ptr<Dispatcher> Dispatcher::shared(std::size_t threads)
+{
+    static std::mutex sharedMutex;
+    static std::weak_ptr<Dispatcher> instance;
+
+    std::lock_guard<std::mutex> lock(sharedMutex);
+    std::shared_ptr<Dispatcher> dispatcher = instance.lock();
+    if(!dispatcher) {
+        dispatcher = std::make_shared<Dispatcher>(threads);
+        instance = dispatcher;
+    }
+    return dispatcher;
+}
+
+void Dispatcher::schedule(Task* task)
+{
+    if(task->scheduled.exchange(true)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(d->mtx);
+    enqueue(task);
+}
+
+void Dispatcher::schedule(Task* task, std::chrono::microseconds delay)
+{
+    // Cheap checks first, this is called for every write that does not wake the reader
+    if(task->scheduled.load() || task->timed.exchange(true)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(d->mtx);
+    if(task->removed) {
+        return;
+    }
+    d->timers.push_back({ std::chrono::steady_clock::now() + delay, task });
+    d->cv.notify_one();
+}
+
+void Dispatcher::remove(Task* task)
+{
+    std::unique_lock<std::mutex> lock(d->mtx);
+    task->removed = true;
+    d->ready.erase(std::remove(d->ready.begin(), d->ready.end(), task), d->ready.end());
+    d->timers.erase(
+        std::remove_if(d->timers.begin(), d->timers.end(), [task](const DispatcherPimpl::Timer& timer) {
+            return timer.task == task;
+        }),
+        d->timers.end()
+    );
+    d->finished.wait(lock, [task] { return !task->running; });
+}
+
+/**
+ * @brief Queues a task whose `scheduled` flag was just set, called with `mtx` held.
+ */
+void HIDDEN Dispatcher::enqueue(Task* task)
+{
+    if(task->removed) {
+        return;
+    }
+    if(task->running) {
+        task->rerun = true;
+        return;
+    }
+    d->ready.push_back(task);
+    d->cv.notify_one();
+}
+
+/**
+ * @brief Thread loop, fires expired timers and runs ready tasks until stopped.
+ */
+void HIDDEN Dispatcher::dispatch()
+{
+#ifdef LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+    FlightRecorder::installAlternateStack();
+#endif
+    std::unique_lock<std::mutex> lock(d->mtx);
+
+    while(!d->stopping) {
+        auto now = std::chrono::steady_clock::now();
+        auto next = std::chrono::steady_clock::time_point::max();
+        for(auto it = d->timers.begin(); it != d->timers.end(); ) {
+            if(it->deadline <= now) {
+                Task* task = it->task;
+                it = d->timers.erase(it);
+                task->timed = false;
+                if(!task->scheduled.exchange(true)) {
+                    enqueue(task);
+                }
+            } else {
+                next = std::min(next, it->deadline);
+                ++it;
+            }
+        }
+
+        if(d->ready.empty()) {
+            if(next == std::chrono::steady_clock::time_point::max()) {
+                d->cv.wait(lock);
+            } else {
+                d->cv.wait_until(lock, next);
+            }
+            continue;
+        }
+
+        Task* task = d->ready.front();
+        d->ready.pop_front();
+        task->running = true;
+        task->scheduled = false;
+        lock.unlock();
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        task->run();
+
+        lock.lock();
+        task->running = false;
+        if(task->rerun) {
+            task->rerun = false;
+            if(!task->removed) {
+                d->ready.push_back(task);
+            }
+        }
+        d->finished.notify_all();
+    }
+}
+
+LIB_CREDIRECT_NAMESPACE_END
@@ -0,0 +1,338 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#include <CRedirect_config.h>
+#include <FdRedirect.hpp>
+
+#ifdef LIB_CREDIRECT_ENABLE_FD
+#include <StreamRedirect.hpp>
+#include <LineSplitter.hpp>
+#include <FlightRecorder.hpp>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+/**
+ * @file FdRedirect.cpp
+ * @brief Implementation of the FdRedirect class.
+ *
+ * The captured descriptor is replaced by the write end of a pipe. The pump thread waits
+ * for the read end with poll(2) and reads whatever is available in chunks of up to kReadSize
+ * bytes. In Thread and Inline dispatch mode it is the monitor thread of the redirect: the
+ * complete lines are handed to the observers of a StreamRedirect straight from the read
+ * buffer and only a trailing partial line is kept for the next read, so the StreamRedirect
+ * starts no thread and its stream buffer is never written. In Shared dispatch mode the
+ * chunks are written to a private std::ostream that the StreamRedirect has redirected, so
+ * that the dispatcher pool delivers them. A second pipe wakes the pump thread when the
+ * redirect is destroyed.
+ */
+
+namespace {
+    constexpr std::size_t kReadSize = 65536;
+    constexpr int kPipeSize = 1 << 20;
+
+    void closeFd(int& fd) {
+        if(fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    bool writeAll(int fd, const char* data, std::size_t size) {
+        while(size > 0) {
+            ssize_t written = ::write(fd, data, size);
+            if(written < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Options of the StreamRedirect, which needs no thread when the pump thread delivers the lines.
+     */
+    RedirectOptions streamOptions(const RedirectOptions& options) {
+        RedirectOptions inner = options;
+        if(inner.dispatch != DispatchMode::Shared) {
+            inner.dispatch = DispatchMode::Inline;
+        }
+        return inner;
+    }
+}
+
+/**
+ * @struct FdRedirect::FdRedirectPimpl
+ * @brief Private implementation (Pimpl) for the FdRedirect class.
+ *
+ * @details
+ * - `sink`: Stream the pump thread writes the captured bytes to in Shared dispatch mode, redirected by `redirect`.
+ * - `direct`: Whether the pump thread hands the lines to the observers of `redirect` itself.
+ * - `fd`, `saved`: The captured descriptor and a duplicate of what it referred to before.
+ * - `capture`: The pipe whose write end replaces `fd`, only its read end stays open here.
+ * - `wake`: Pipe written once by the destructor to stop the pump thread.
+ * - `fileSink`, `teePipe`: Optional file receiving a copy of the captured bytes, and the
+ *   pipe they are duplicated into with tee(2) before being spliced to it (Linux only).
+ */
+struct HIDDEN FdRedirect::FdRedirectPimpl {
+    FdRedirectPimpl(int fd, const RedirectOptions& options, int fileSink) :
+        sink(nullptr),
+        redirect(sink, streamOptions(options)),
+        direct(options.dispatch != DispatchMode::Shared),
+        fd(fd),
+        saved(-1),
+        fileSink(fileSink) {}
+
+    std::ostream sink;
+    StreamRedirect redirect;
+    const bool direct;
+    const int fd;
+    int saved;
+    int capture[2] = { -1, -1 };
+    int wake[2] = { -1, -1 };
+    const int fileSink;
+    int teePipe[2] = { -1, -1 };
+    std::thread pumpThread;
+};
+
+FdRedirect::FdRedirect(int fd, const RedirectOptions& options, int fileSink)
+{
+    d = new FdRedirectPimpl(fd, options, fileSink);
+
+    if(::pipe(d->capture) != 0 || ::pipe(d->wake) != 0) {
+        closeFd(d->capture[0]);
+        closeFd(d->capture[1]);
+        return;
+    }
+    for(int end : { d->capture[0], d->wake[0], d->wake[1] }) {
+        ::fcntl(end, F_SETFD, FD_CLOEXEC);
+    }
+    ::fcntl(d->capture[0], F_SETFL, ::fcntl(d->capture[0], F_GETFL) | O_NONBLOCK);
+#ifdef __linux__
+    // A larger pipe lets writers run ahead of the pump thread, best effort
+    ::fcntl(d->capture[0], F_SETPIPE_SZ, kPipeSize);
+    if(fileSink >= 0 && ::pipe2(d->teePipe, O_CLOEXEC) != 0) {
+        d->teePipe[0] = d->teePipe[1] = -1;
+    }
+#endif
+
+    std::fflush(nullptr);
+    d->saved = ::dup(fd);
+    if(d->saved < 0 || ::dup2(d->capture[1], fd) < 0) {
+        closeFd(d->saved);
+        closeFd(d->capture[0]);
+        closeFd(d->capture[1]);
+        return;
+    }
+    ::fcntl(d->saved, F_SETFD, FD_CLOEXEC);
+    // The captured descriptor is now the only write end
+    closeFd(d->capture[1]);
+
+    d->pumpThread = std::thread(&FdRedirect::pump, this);
+}
+
+FdRedirect::~FdRedirect()
+{
+    if(d->pumpThread.joinable()) {
+        // Push out what C stdio still buffers, then restore the descriptor and stop the pump
+        std::fflush(nullptr);
+        ::dup2(d->saved, d->fd);
+        const char stop = 0;
+        writeAll(d->wake[1], &stop, 1);
+        d->pumpThread.join();
+    }
+
+    for(int* fd : { &d->saved, &d->capture[0], &d->capture[1], &d->wake[0], &d->wake[1], &d->teePipe[0], &d->teePipe[1] }) {
+        closeFd(*fd);
+    }
+    delete d;
+}
+
+bool FdRedirect::active() const
+{
+    return d->pumpThread.joinable();
+}
+
+void FdRedirect::attach(StreamObserver* observer)
+{
+    d->redirect.attach(observer);
+}
+
+void FdRedirect::detach(StreamObserver* observer)
+{
+    d->redirect.detach(observer);
+}
+
+void FdRedirect::attach(LineObserver* observer)
+{
+    d->redirect.attach(observer);
+}
+
+void FdRedirect::detach(LineObserver* observer)
+{
+    d->redirect.detach(observer);
+}
+
+RedirectStats FdRedirect::stats() const
+{
+    return d->redirect.stats();
+}
+
+/**
+ * @brief Pump thread loop, moves captured bytes to the observers until stopped.
+ *
+ * Everything readable is drained on every wakeup, including the one that stops the
+ * thread, so nothing written before the descriptor was restored is lost. A trailing
+ * line without a newline is delivered last.
+ */
+void HIDDEN FdRedirect::pump()
+{
+#ifdef LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+    FlightRecorder::installAlternateStack();
+#endif
+    std::vector<char> buffer(kReadSize);
+    std::vector<std::string_view> lines;
+    std::size_t kept = 0;
+    pollfd fds[2] = { { d->capture[0], POLLIN, 0 }, { d->wake[0], POLLIN, 0 } };
+
+    for(;;) {
+        if(::poll(fds, 2, -1) < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        bool drained = false;
+        std::size_t size = 0;
+        for(;;) {
+            if(kept == buffer.size()) {
+                // The partial line fills the buffer, make room for the rest of it
+                buffer.resize(buffer.size() * 2);
+            }
+            if(!transfer(buffer.data() + kept, buffer.size() - kept, size)) {
+                break;
+            }
+            drained = true;
+            if(size == 0) {
+                continue;
+            }
+
+            if(!d->direct) {
+                d->sink.write(buffer.data(), static_cast<std::streamsize>(size));
+                continue;
+            }
+            const std::size_t end = kept + size;
+            lines.clear();
+            const std::size_t complete = LineSplitter::split(buffer.data(), end, kept, lines);
+            if(!lines.empty()) {
+                d->redirect.notify(lines.data(), lines.size());
+            }
+            std::memmove(buffer.data(), buffer.data() + complete, end - complete);
+            kept = end - complete;
+        }
+        if(!d->direct) {
+            d->sink.flush();
+        }
+
+        if(fds[1].revents != 0 || (!drained && (fds[0].revents & (POLLHUP | POLLERR)))) {
+            break;
+        }
+    }
+
+    if(kept > 0) {
+        std::string_view last(buffer.data(), kept);
+        d->redirect.notify(&last, 1);
+    }
+}
+
+/**
+ * @brief Reads one chunk from the capture pipe, copying it to the file sink.
+ *
+ * @param data Where the chunk is read to.
+ * @param capacity Largest chunk to read.
+ * @param size Set to the number of bytes read, 0 if the read has to be retried.
+ * @return false once nothing more is readable.
+ */
+bool HIDDEN FdRedirect::transfer(char* data, std::size_t capacity, std::size_t& size)
+{
+    ssize_t count;
+#ifdef __linux__
+    if(d->teePipe[1] >= 0) {
+        // Duplicate the pipe contents into the file pipe and splice them to the file, then read the same bytes
+        count = ::tee(d->capture[0], d->teePipe[1], capacity, SPLICE_F_NONBLOCK);
+        if(count > 0) {
+            ssize_t moved = 0;
+            while(moved < count) {
+                ssize_t spliced = ::splice(d->teePipe[0], nullptr, d->fileSink, nullptr,
+                                           static_cast<std::size_t>(count - moved), SPLICE_F_MOVE);
+                if(spliced <= 0) {
+                    break;
+                }
+                moved += spliced;
+            }
+            if(moved < count) {
+                // The file does not take spliced data, copy what is left and fall back to write(2)
+                ssize_t left = ::read(d->teePipe[0], data, static_cast<std::size_t>(count - moved));
+                if(left > 0) {
+                    writeAll(d->fileSink, data, static_cast<std::size_t>(left));
+                }
+                closeFd(d->teePipe[0]);
+                closeFd(d->teePipe[1]);
+            }
+            count = ::read(d->capture[0], data, static_cast<std::size_t>(count));
+        } else if(count < 0 && errno == EINVAL) {
+            closeFd(d->teePipe[0]);
+            closeFd(d->teePipe[1]);
+            size = 0;
+            return true;
+        }
+    } else
+#endif
+    {
+        count = ::read(d->capture[0], data, capacity);
+        if(count > 0 && d->fileSink >= 0) {
+            writeAll(d->fileSink, data, static_cast<std::size_t>(count));
+        }
+    }
+
+    if(count <= 0) {
+        size = 0;
+        return count < 0 && errno == EINTR;
+    }
+    size = static_cast<std::size_t>(count);
+    return true;
+}
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // LIB_CREDIRECT_ENABLE_FD
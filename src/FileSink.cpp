@@ -0,0 +1,584 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#include <CRedirect_config.h>
+#include <FileSink.hpp>
+#include <FlightRecorder.hpp>
+
+#ifdef LIB_CREDIRECT_ENABLE_FILE_SINK
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+/**
+ * @file FileSink.cpp
+ * @brief Implementation of the FileSink class.
+ *
+ * Pending data is a list of kBlockSize blocks, so appending never moves data already
+ * copied and the lock is only held for the copy of the new lines. The writer thread takes
+ * the whole list at once, which is the double buffering: producers fill a fresh list while
+ * the taken one is written with writev(2), in groups of at most IOV_MAX blocks.
+ *
+ * Rotation is split between two threads. The housekeeping thread opens the next file
+ * under a temporary name, "<path>.next", and closes the files the writer retires. The
+ * writer thread checks after every batch whether the file is due and, if the next file
+ * is ready, renames both files and swaps descriptors, which never waits for an open or
+ * a close. Neither thread holds `mtx` meanwhile, so producers are never held up.
+ */
+
+namespace {
+    constexpr std::size_t kBlockSize = 65536;
+
+#ifdef IOV_MAX
+    constexpr std::size_t kMaxIovecs = IOV_MAX;
+#else
+    constexpr std::size_t kMaxIovecs = 1024;
+#endif
+
+    int syncFile(int fd) {
+#ifdef __linux__
+        return ::fdatasync(fd);
+#else
+        return ::fsync(fd);
+#endif
+    }
+
+    std::uint64_t fileSize(int fd) {
+        struct stat status;
+        return ::fstat(fd, &status) == 0 ? static_cast<std::uint64_t>(status.st_size) : 0;
+    }
+}
+
+/**
+ * @struct FileSink::FileSinkPimpl
+ * @brief Private implementation (Pimpl) for the FileSink class.
+ *
+ * @details
+ * - `pending`: Blocks filled by the producers, `pendingBytes` bytes in total.
+ * - `spare`: Written blocks kept for reuse, at most enough for one batch.
+ * - `signalled`: The writer was woken for batchSize and has not taken the blocks yet.
+ * - `requested`, `completed`: Flush tickets handed out by flush() and written by the writer.
+ * - `fd`, `segmentBytes`, `segmentStart`, `sequence`: Current file, only used by the writer.
+ * - `path`: Name of the current file, changed by the writer with `fileMtx` held.
+ * - `wanted`: File the housekeeper is asked to open, `nextFd` the one it has opened.
+ *   A final file is switched to as soon as it is ready, a temporary one on rotation.
+ * - `retired`: Files handed to the housekeeper to close, with the segment name they were
+ *   renamed to, or the temporary name to delete.
+ */
+struct HIDDEN FileSink::FileSinkPimpl {
+    struct Block {
+        std::unique_ptr<char[]> data;
+        std::size_t size;
+    };
+
+    struct Retired {
+        int fd;
+        std::string segment;
+        std::string discard;
+    };
+
+    explicit FileSinkPimpl(const FileSinkOptions& options) :
+        options(options),
+        fd(-1),
+        pendingBytes(0),
+        signalled(false),
+        stopping(false),
+        requested(0),
+        completed(0),
+        segmentBytes(0),
+        sequence(0),
+        rotateRequested(false),
+        wantedFinal(false),
+        nextFd(-1),
+        nextFinal(false),
+        closing(false) {}
+
+    bool rotating() const {
+        return options.rotateSize != 0 || options.rotateInterval.count() != 0;
+    }
+
+    void append(const char* data, std::size_t size);
+    bool switchFile();
+    std::string segmentName();
+    void housekeep();
+    void retire(Retired& file);
+
+    const FileSinkOptions options;
+    int fd;
+    std::vector<Block> pending;
+    std::vector<Block> spare;
+    std::size_t pendingBytes;
+    bool signalled;
+    bool stopping;
+    std::uint64_t requested;
+    std::uint64_t completed;
+    FileSinkStats stats;
+    mutable std::mutex mtx;
+    std::condition_variable wake;
+    std::condition_variable written;
+    std::thread writer;
+
+    std::uint64_t segmentBytes;
+    std::chrono::steady_clock::time_point segmentStart;
+    std::uint64_t sequence;
+    std::atomic<bool> rotateRequested;
+
+    std::mutex fileMtx;
+    std::condition_variable fileCv;
+    std::string path;
+    std::string wanted;
+    bool wantedFinal;
+    int nextFd;
+    std::string nextPath;
+    bool nextFinal;
+    std::vector<Retired> retired;
+    bool closing;
+    std::deque<std::string> segments;
+    std::thread housekeeper;
+};
+
+/**
+ * @brief Copies data to the end of the pending blocks, called with `mtx` held.
+ */
+void FileSink::FileSinkPimpl::append(const char* data, std::size_t size)
+{
+    while(size > 0) {
+        if(pending.empty() || pending.back().size == kBlockSize) {
+            if(spare.empty()) {
+                pending.push_back({ std::unique_ptr<char[]>(new char[kBlockSize]), 0 });
+            } else {
+                pending.push_back(std::move(spare.back()));
+                spare.pop_back();
+            }
+        }
+
+        Block& block = pending.back();
+        std::size_t count = std::min(size, kBlockSize - block.size);
+        std::memcpy(block.data.get() + block.size, data, count);
+        block.size += count;
+        data += count;
+        size -= count;
+    }
+}
+
+/**
+ * @brief Switches to the prepared file if it is final or the current file is due for
+ * rotation, called by the writer thread after every batch.
+ *
+ * @return true if the writer now writes to another file.
+ */
+bool FileSink::FileSinkPimpl::switchFile()
+{
+    auto now = std::chrono::steady_clock::now();
+    bool due = rotateRequested.load()
+        || (options.rotateSize != 0 && segmentBytes >= options.rotateSize)
+        || (options.rotateInterval.count() != 0 && now - segmentStart >= options.rotateInterval);
+
+    std::lock_guard<std::mutex> lock(fileMtx);
+    if(!nextFinal && segmentBytes == 0) {
+        // An empty file is not rotated
+        rotateRequested = false;
+        return false;
+    }
+    if(nextFd < 0 || (!nextFinal && !due)) {
+        return false;
+    }
+
+    Retired old{ fd, {}, {} };
+    if(nextFinal) {
+        path = nextPath;
+    } else {
+        // The writer keeps the old descriptor under the segment name until the swap below
+        old.segment = segmentName();
+        if(::rename(path.c_str(), old.segment.c_str()) != 0) {
+            return false;
+        }
+        if(::rename(nextPath.c_str(), path.c_str()) != 0) {
+            ::rename(old.segment.c_str(), path.c_str());
+            return false;
+        }
+        rotateRequested = false;
+    }
+
+    retired.push_back(std::move(old));
+    fd = nextFd;
+    nextFd = -1;
+    segmentBytes = fileSize(fd);
+    segmentStart = now;
+    if(rotating()) {
+        wanted = path;
+        wantedFinal = false;
+    }
+    fileCv.notify_one();
+    return true;
+}
+
+/**
+ * @brief Returns the name a rotated file gets, called with `fileMtx` held.
+ */
+std::string FileSink::FileSinkPimpl::segmentName()
+{
+    std::time_t now = std::time(nullptr);
+    std::tm local{};
+    ::localtime_r(&now, &local);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    return path + "." + stamp + "." + std::to_string(++sequence);
+}
+
+/**
+ * @brief Housekeeping thread loop, opens the wanted file and closes retired ones until stopped.
+ */
+void FileSink::FileSinkPimpl::housekeep()
+{
+#ifdef LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+    FlightRecorder::installAlternateStack();
+#endif
+    std::unique_lock<std::mutex> lock(fileMtx);
+    for(;;) {
+        fileCv.wait(lock, [this] { return closing || !retired.empty() || (!wanted.empty() && nextFd < 0); });
+
+        if(!retired.empty()) {
+            std::vector<Retired> files;
+            files.swap(retired);
+            lock.unlock();
+            for(Retired& file : files) {
+                retire(file);
+            }
+            lock.lock();
+            continue;
+        }
+        if(closing) {
+            break;
+        }
+
+        std::string target = wanted;
+        bool final = wantedFinal;
+        lock.unlock();
+
+        std::string name = final ? target : target + ".next";
+        int next = ::open(name.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (final ? 0 : O_TRUNC), 0644);
+#ifdef __linux__
+        if(next >= 0 && options.preallocate && options.rotateSize != 0) {
+            // Reserve the blocks without changing the size, appends still start at the end
+            ::fallocate(next, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(options.rotateSize));
+        }
+#endif
+
+        lock.lock();
+        if(next < 0) {
+            // Keep to the current file, the next rotation asks again
+            wanted.clear();
+        } else if(wanted == target && wantedFinal == final) {
+            nextFd = next;
+            nextPath = name;
+            nextFinal = final;
+            wanted.clear();
+        } else {
+            retired.push_back({ next, {}, final ? std::string() : name });
+        }
+    }
+}
+
+/**
+ * @brief Closes a file the writer no longer uses, then reports and prunes segments.
+ */
+void FileSink::FileSinkPimpl::retire(Retired& file)
+{
+    if(!file.discard.empty()) {
+        ::unlink(file.discard.c_str());
+    } else if(options.sync != SyncPolicy::None) {
+        syncFile(file.fd);
+    }
+#ifdef __linux__
+    if(options.preallocate) {
+        // Give back the blocks reserved past the end
+        ::ftruncate(file.fd, static_cast<off_t>(fileSize(file.fd)));
+    }
+#endif
+    ::close(file.fd);
+
+    if(file.segment.empty()) {
+        return;
+    }
+    if(options.onSegment) {
+        options.onSegment(file.segment);
+    }
+    segments.push_back(std::move(file.segment));
+    while(options.maxSegments != 0 && segments.size() > options.maxSegments) {
+        ::unlink(segments.front().c_str());
+        segments.pop_front();
+    }
+}
+
+FileSink::FileSink(const std::string& path, const FileSinkOptions& options)
+{
+    d = new FileSinkPimpl(options);
+    d->fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(d->fd < 0) {
+        return;
+    }
+
+    d->path = path;
+    d->segmentBytes = fileSize(d->fd);
+    d->segmentStart = std::chrono::steady_clock::now();
+    if(d->rotating()) {
+        d->wanted = path;
+    }
+    d->housekeeper = std::thread(&FileSinkPimpl::housekeep, d);
+    d->writer = std::thread(&FileSink::write, this);
+}
+
+FileSink::~FileSink()
+{
+    {
+        std::lock_guard<std::mutex> lock(d->mtx);
+        d->stopping = true;
+    }
+    d->wake.notify_all();
+    if(d->writer.joinable()) {
+        d->writer.join();
+    }
+
+    if(d->housekeeper.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(d->fileMtx);
+            d->closing = true;
+            d->retired.push_back({ d->fd, {}, {} });
+            d->fd = -1;
+            if(d->nextFd >= 0) {
+                d->retired.push_back({ d->nextFd, {}, d->nextFinal ? std::string() : d->nextPath });
+                d->nextFd = -1;
+            }
+        }
+        d->fileCv.notify_all();
+        d->housekeeper.join();
+    }
+    if(d->fd >= 0) {
+        ::close(d->fd);
+    }
+    delete d;
+}
+
+bool FileSink::active() const
+{
+    return d->writer.joinable();
+}
+
+void FileSink::update(std::string_view line)
+{
+    updateBatch(&line, 1);
+}
+
+void FileSink::updateBatch(const std::string_view* lines, std::size_t count)
+{
+    if(!active()) {
+        return;
+    }
+
+    const std::string& ending = d->options.lineEnding;
+    std::lock_guard<std::mutex> lock(d->mtx);
+    for(std::size_t i = 0; i < count; ++i) {
+        std::size_t size = lines[i].size() + ending.size();
+        if(d->options.maxPending != 0 && d->pendingBytes + size > d->options.maxPending) {
+            ++d->stats.droppedLines;
+            continue;
+        }
+        d->append(lines[i].data(), lines[i].size());
+        d->append(ending.data(), ending.size());
+        d->pendingBytes += size;
+    }
+
+    if(d->pendingBytes >= d->options.batchSize && !d->signalled) {
+        d->signalled = true;
+        d->wake.notify_one();
+    }
+}
+
+void FileSink::flush()
+{
+    std::unique_lock<std::mutex> lock(d->mtx);
+    if(!d->writer.joinable()) {
+        return;
+    }
+    std::uint64_t ticket = ++d->requested;
+    d->wake.notify_one();
+    d->written.wait(lock, [this, ticket] { return d->completed >= ticket; });
+}
+
+void FileSink::rotate()
+{
+    if(!active()) {
+        return;
+    }
+
+    d->rotateRequested = true;
+    std::lock_guard<std::mutex> lock(d->fileMtx);
+    if(d->nextFd < 0 && d->wanted.empty()) {
+        d->wanted = d->path;
+        d->wantedFinal = false;
+        d->fileCv.notify_one();
+    }
+}
+
+void FileSink::reopen(const std::string& path)
+{
+    if(!active()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(d->fileMtx);
+    if(d->nextFd >= 0) {
+        d->retired.push_back({ d->nextFd, {}, d->nextFinal ? std::string() : d->nextPath });
+        d->nextFd = -1;
+    }
+    d->wanted = path;
+    d->wantedFinal = true;
+    d->fileCv.notify_one();
+}
+
+FileSinkStats FileSink::stats() const
+{
+    std::lock_guard<std::mutex> lock(d->mtx);
+    FileSinkStats result = d->stats;
+    result.pending = d->pendingBytes;
+    return result;
+}
+
+/**
+ * @brief Writer thread loop, writes the pending blocks until stopped.
+ *
+ * The blocks are written and synced without holding the lock. Whatever is pending when
+ * the destructor stops the thread is written before it exits.
+ */
+void HIDDEN FileSink::write()
+{
+#ifdef LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+    FlightRecorder::installAlternateStack();
+#endif
+    const FileSinkOptions& options = d->options;
+    std::vector<FileSinkPimpl::Block> batch;
+    std::vector<iovec> iov;
+    auto lastSync = std::chrono::steady_clock::now();
+    bool unsynced = false;
+
+    std::unique_lock<std::mutex> lock(d->mtx);
+    for(;;) {
+        d->wake.wait_for(lock, options.flushInterval, [this] {
+            return d->stopping || d->signalled || d->requested != d->completed;
+        });
+
+        batch.swap(d->pending);
+        std::size_t bytes = d->pendingBytes;
+        d->pendingBytes = 0;
+        d->signalled = false;
+        std::uint64_t ticket = d->requested;
+        bool stop = d->stopping;
+        lock.unlock();
+
+        bool complete = true;
+        if(bytes > 0) {
+            iov.clear();
+            for(const auto& block : batch) {
+                iov.push_back({ block.data.get(), block.size });
+            }
+            std::size_t first = 0;
+            while(first < iov.size()) {
+                ssize_t count = ::writev(d->fd, iov.data() + first,
+                                         static_cast<int>(std::min(iov.size() - first, kMaxIovecs)));
+                if(count < 0) {
+                    if(errno == EINTR) {
+                        continue;
+                    }
+                    complete = false;
+                    break;
+                }
+                // Skip what was written, a short write leaves the rest of a block
+                auto left = static_cast<std::size_t>(count);
+                while(first < iov.size() && left >= iov[first].iov_len) {
+                    left -= iov[first++].iov_len;
+                }
+                if(first < iov.size()) {
+                    iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + left;
+                    iov[first].iov_len -= left;
+                }
+            }
+            unsynced = true;
+            d->segmentBytes += bytes;
+        }
+
+        bool sync = false;
+        if(unsynced && options.sync != SyncPolicy::None) {
+            auto now = std::chrono::steady_clock::now();
+            sync = stop || options.sync == SyncPolicy::EveryBatch || now - lastSync >= options.syncInterval;
+            if(sync) {
+                syncFile(d->fd);
+                lastSync = now;
+                unsynced = false;
+            }
+        }
+
+        // The retired file is synced by the housekeeper
+        bool switched = !stop && d->switchFile();
+        unsynced = unsynced && !switched;
+
+        lock.lock();
+        std::size_t keep = std::max<std::size_t>(options.batchSize / kBlockSize, 1) + 1;
+        for(auto& block : batch) {
+            if(d->spare.size() >= keep) {
+                break;
+            }
+            block.size = 0;
+            d->spare.push_back(std::move(block));
+        }
+        batch.clear();
+
+        if(bytes > 0) {
+            ++d->stats.batches;
+            d->stats.bytesWritten += complete ? bytes : 0;
+            d->stats.errors += complete ? 0 : 1;
+        }
+        d->stats.syncs += sync ? 1 : 0;
+        d->stats.rotations += switched ? 1 : 0;
+        d->completed = ticket;
+        d->written.notify_all();
+
+        if(stop) {
+            break;
+        }
+    }
+}
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // LIB_CREDIRECT_ENABLE_FILE_SINK
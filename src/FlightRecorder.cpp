@@ -0,0 +1,388 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#include <CRedirect_config.h>
+#include <FlightRecorder.hpp>
+
+#ifdef LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include <signal.h>
+#include <unistd.h>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+/**
+ * @file FlightRecorder.cpp
+ * @brief Implementation of the FlightRecorder class.
+ *
+ * A ring is addressed by a byte position that only grows, a batch reserves its bytes with
+ * one fetch_add and copies them at the position modulo the capacity. The dump writes the
+ * last capacity bytes before the current position, starting after the first newline if
+ * the oldest line was partly overwritten. The registry is a fixed array of atomic pointers
+ * so that a signal handler can walk it without taking a lock or allocating. A dump counts
+ * itself in `dumping` while it walks the registry, a recorder being destroyed leaves the
+ * registry and then waits for that count to drop to zero before it frees its ring.
+ *
+ * Alternate signal stacks are per thread. Each one is allocated by the thread that uses it
+ * and released when the thread exits.
+ */
+
+namespace {
+    constexpr std::size_t kRegistrySize = 32;
+    constexpr std::size_t kNameSize = 64;
+    constexpr std::size_t kAlternateStackSize = 65536;
+    constexpr int kSignals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+    constexpr std::size_t kSignalCount = sizeof(kSignals) / sizeof(kSignals[0]);
+
+    /**
+     * @brief The ring of one recorder, everything a dump needs.
+     */
+    struct Ring {
+        char name[kNameSize];
+        std::size_t nameLength;
+        char* data;
+        std::size_t mask;
+        std::atomic<std::uint64_t> head;
+    };
+
+    std::atomic<const Ring*> registry[kRegistrySize];
+    std::atomic<unsigned> dumping{0};
+
+    /**
+     * @brief Writes all of a buffer, retrying after signals and short writes.
+     */
+    void writeAll(int fd, const char* data, std::size_t size)
+    {
+        while(size > 0) {
+            ssize_t written = ::write(fd, data, size);
+            if(written < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
+    }
+
+    /**
+     * @brief Writes the name and the surviving lines of a ring, async-signal-safe.
+     */
+    void dumpRing(int fd, const Ring* ring)
+    {
+        writeAll(fd, "--- ", 4);
+        writeAll(fd, ring->name, ring->nameLength);
+        writeAll(fd, " ---\n", 5);
+
+        const std::uint64_t capacity = ring->mask + 1;
+        const std::uint64_t end = ring->head.load(std::memory_order_acquire);
+        std::uint64_t begin = end > capacity ? end - capacity : 0;
+        if(begin > 0) {
+            // The oldest line was partly overwritten, start at the next one
+            while(begin < end && ring->data[begin & ring->mask] != '\n') {
+                ++begin;
+            }
+            ++begin;
+        }
+        if(begin >= end) {
+            return;
+        }
+
+        const std::size_t offset = static_cast<std::size_t>(begin & ring->mask);
+        const std::size_t size = static_cast<std::size_t>(end - begin);
+        const std::size_t first = std::min<std::size_t>(size, capacity - offset);
+        writeAll(fd, ring->data + offset, first);
+        writeAll(fd, ring->data, size - first);
+    }
+
+    /**
+     * @brief State of the crash handlers, changed by install() and uninstall() only.
+     */
+    struct CrashHandlers {
+        std::atomic<int> fd{-1};
+        std::atomic_flag dumped = ATOMIC_FLAG_INIT;
+        bool installed = false;
+        struct sigaction previous[kSignalCount];
+        std::terminate_handler previousTerminate = nullptr;
+        std::mutex mtx;
+    };
+
+    CrashHandlers handlers;
+
+    /**
+     * @brief Alternate signal stack of the calling thread, disabled and freed when the thread exits.
+     */
+    struct AlternateStack {
+        ~AlternateStack()
+        {
+            if(!memory) {
+                return;
+            }
+            stack_t current;
+            if(sigaltstack(nullptr, &current) == 0 && current.ss_sp == memory) {
+                stack_t disabled;
+                std::memset(&disabled, 0, sizeof(disabled));
+                disabled.ss_flags = SS_DISABLE;
+                sigaltstack(&disabled, nullptr);
+            }
+            delete[] memory;
+        }
+
+        char* memory = nullptr;
+    };
+
+    thread_local AlternateStack alternateStack;
+
+    /**
+     * @brief Dumps every recorder the first time the process crashes.
+     */
+    void dumpOnce()
+    {
+        if(!handlers.dumped.test_and_set()) {
+            const int fd = handlers.fd.load();
+            if(fd >= 0) {
+                FlightRecorder::dump(fd);
+            }
+        }
+    }
+
+    /**
+     * @brief Fatal signal handler, dumps and then lets the previous handler take the signal.
+     *
+     * The signal is blocked while the handler runs, so raising it again only takes effect
+     * when the handler returns, by which time the previous disposition is back. A fault
+     * that is not raised would repeat on return anyway.
+     */
+    void onSignal(int signal, siginfo_t*, void*)
+    {
+        const int savedErrno = errno;
+        dumpOnce();
+        for(std::size_t i = 0; i < kSignalCount; ++i) {
+            if(kSignals[i] == signal) {
+                sigaction(signal, &handlers.previous[i], nullptr);
+            }
+        }
+        raise(signal);
+        errno = savedErrno;
+    }
+
+    /**
+     * @brief Terminate handler, dumps and then calls the previous terminate handler.
+     */
+    void onTerminate()
+    {
+        dumpOnce();
+        if(handlers.previousTerminate) {
+            handlers.previousTerminate();
+        }
+        std::abort();
+    }
+}
+
+/**
+ * @struct FlightRecorder::FlightRecorderPimpl
+ * @brief Private implementation (Pimpl) for the FlightRecorder class.
+ *
+ * @details
+ * - `ring`: The preallocated ring, its name and the position of the next byte.
+ * - `slot`: Index of the ring in the registry, or kRegistrySize if it is not registered.
+ */
+struct HIDDEN FlightRecorder::FlightRecorderPimpl {
+    Ring ring;
+    std::size_t slot = kRegistrySize;
+
+    /**
+     * @brief Copies bytes to a position of the ring, skipping what the same batch overwrites.
+     */
+    void copy(std::uint64_t at, const char* data, std::size_t size, std::uint64_t floor)
+    {
+        if(at + size <= floor) {
+            return;
+        }
+        if(at < floor) {
+            data += floor - at;
+            size -= static_cast<std::size_t>(floor - at);
+            at = floor;
+        }
+        const std::size_t offset = static_cast<std::size_t>(at & ring.mask);
+        const std::size_t first = std::min(size, ring.mask + 1 - offset);
+        std::memcpy(ring.data + offset, data, first);
+        std::memcpy(ring.data, data + first, size - first);
+    }
+};
+
+FlightRecorder::FlightRecorder(const std::string& name, std::size_t capacity)
+{
+    d = new FlightRecorderPimpl();
+
+    std::size_t size = 64;
+    while(size < capacity) {
+        size <<= 1;
+    }
+    d->ring.nameLength = std::min(name.size(), kNameSize - 1);
+    std::memcpy(d->ring.name, name.data(), d->ring.nameLength);
+    d->ring.name[d->ring.nameLength] = '\0';
+    // Touch every page now so that recording never faults one in
+    d->ring.data = new char[size]();
+    d->ring.mask = size - 1;
+    d->ring.head.store(0);
+
+    for(std::size_t i = 0; i < kRegistrySize; ++i) {
+        const Ring* expected = nullptr;
+        if(registry[i].compare_exchange_strong(expected, &d->ring)) {
+            d->slot = i;
+            break;
+        }
+    }
+}
+
+FlightRecorder::~FlightRecorder()
+{
+    if(d->slot < kRegistrySize) {
+        registry[d->slot].store(nullptr);
+        // A dump that found the ring before it left the registry may still be reading it
+        while(dumping.load() != 0) {
+            std::this_thread::yield();
+        }
+    }
+    delete[] d->ring.data;
+    delete d;
+}
+
+bool FlightRecorder::active() const
+{
+    return d->slot < kRegistrySize;
+}
+
+void FlightRecorder::update(std::string_view line)
+{
+    updateBatch(&line, 1);
+}
+
+void FlightRecorder::updateBatch(const std::string_view* lines, std::size_t count)
+{
+    std::size_t total = 0;
+    for(std::size_t i = 0; i < count; ++i) {
+        total += lines[i].size() + 1;
+    }
+    if(total == 0) {
+        return;
+    }
+
+    std::uint64_t at = d->ring.head.fetch_add(total, std::memory_order_acq_rel);
+    const std::uint64_t end = at + total;
+    const std::uint64_t floor = end > d->ring.mask + 1 ? end - (d->ring.mask + 1) : 0;
+    for(std::size_t i = 0; i < count; ++i) {
+        d->copy(at, lines[i].data(), lines[i].size(), floor);
+        at += lines[i].size();
+        d->copy(at, "\n", 1, floor);
+        ++at;
+    }
+}
+
+void FlightRecorder::dump(int fd)
+{
+    dumping.fetch_add(1);
+    for(std::size_t i = 0; i < kRegistrySize; ++i) {
+        const Ring* ring = registry[i].load();
+        if(ring) {
+            dumpRing(fd, ring);
+        }
+    }
+    dumping.fetch_sub(1);
+}
+
+bool FlightRecorder::installAlternateStack()
+{
+    stack_t current;
+    if(sigaltstack(nullptr, &current) != 0) {
+        return false;
+    }
+    if(!(current.ss_flags & SS_DISABLE)) {
+        return true;
+    }
+
+    // Left uninitialised, so the pages are only committed if a handler ever runs on them
+    if(!alternateStack.memory) {
+        alternateStack.memory = new char[kAlternateStackSize];
+    }
+    stack_t stack;
+    stack.ss_sp = alternateStack.memory;
+    stack.ss_size = kAlternateStackSize;
+    stack.ss_flags = 0;
+    return sigaltstack(&stack, nullptr) == 0;
+}
+
+bool FlightRecorder::install(int fd)
+{
+    std::lock_guard<std::mutex> lock(handlers.mtx);
+    handlers.fd.store(fd);
+    handlers.dumped.clear();
+    if(handlers.installed) {
+        return true;
+    }
+
+    // Run on an alternate stack so that a stack overflow can still be dumped
+    installAlternateStack();
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_sigaction = onSignal;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    for(std::size_t i = 0; i < kSignalCount; ++i) {
+        if(sigaction(kSignals[i], &action, &handlers.previous[i]) != 0) {
+            while(i-- > 0) {
+                sigaction(kSignals[i], &handlers.previous[i], nullptr);
+            }
+            handlers.fd.store(-1);
+            return false;
+        }
+    }
+    handlers.previousTerminate = std::set_terminate(onTerminate);
+    handlers.installed = true;
+    return true;
+}
+
+void FlightRecorder::uninstall()
+{
+    std::lock_guard<std::mutex> lock(handlers.mtx);
+    if(!handlers.installed) {
+        return;
+    }
+    for(std::size_t i = 0; i < kSignalCount; ++i) {
+        sigaction(kSignals[i], &handlers.previous[i], nullptr);
+    }
+    std::set_terminate(handlers.previousTerminate);
+    handlers.previousTerminate = nullptr;
+    handlers.installed = false;
+    handlers.fd.store(-1);
+}
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
@@ -0,0 +1,139 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#include <CRedirect_config.h>
+#include <LineSplitter.hpp>
+
+#include <cstring>
+
+#if defined(LIB_CREDIRECT_ENABLE_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# include <immintrin.h>
+# define LIB_CREDIRECT_HAVE_X86_SIMD
+#endif
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+/**
+ * @file LineSplitter.cpp
+ * @brief Implementation of the LineSplitter class.
+ *
+ * Each implementation compares a block of bytes against '\n', turns the result into a
+ * bit mask and emits one line per set bit, so a block holding many short lines costs a
+ * single load and compare.
+ */
+
+namespace {
+    using SplitFunction = std::size_t (*)(const char*, std::size_t, std::size_t, std::vector<std::string_view>&);
+
+    std::size_t splitScalar(const char* data, std::size_t size, std::size_t scanned,
+                            std::vector<std::string_view>& lines) {
+        const char* end = data + size;
+        std::size_t begin = 0;
+
+        for(const char* p = data + scanned; p < end; ) {
+            const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if(!newline) {
+                break;
+            }
+            lines.emplace_back(data + begin, (newline - data) - begin);
+            begin = (newline - data) + 1;
+            p = newline + 1;
+        }
+        return begin;
+    }
+
+#ifdef LIB_CREDIRECT_HAVE_X86_SIMD
+    /**
+     * @brief Emits a line for every bit set in `mask`, bit i standing for a newline at `position + i`.
+     */
+    inline void emitLines(unsigned mask, std::size_t position, const char* data, std::size_t& begin,
+                          std::vector<std::string_view>& lines) {
+        while(mask) {
+            std::size_t newline = position + static_cast<std::size_t>(__builtin_ctz(mask));
+            lines.emplace_back(data + begin, newline - begin);
+            begin = newline + 1;
+            mask &= mask - 1;
+        }
+    }
+
+    /**
+     * @brief Handles the bytes after the last full block.
+     */
+    inline std::size_t splitTail(const char* data, std::size_t position, std::size_t size, std::size_t begin,
+                                 std::vector<std::string_view>& lines) {
+        for(; position < size; ++position) {
+            if(data[position] == '\n') {
+                lines.emplace_back(data + begin, position - begin);
+                begin = position + 1;
+            }
+        }
+        return begin;
+    }
+
+    __attribute__((target("sse2")))
+    std::size_t splitSse2(const char* data, std::size_t size, std::size_t scanned,
+                          std::vector<std::string_view>& lines) {
+        const __m128i newline = _mm_set1_epi8('\n');
+        std::size_t begin = 0;
+        std::size_t position = scanned;
+
+        for(; position + 16 <= size; position += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+            emitLines(mask, position, data, begin, lines);
+        }
+        return splitTail(data, position, size, begin, lines);
+    }
+
+    __attribute__((target("avx2")))
+    std::size_t splitAvx2(const char* data, std::size_t size, std::size_t scanned,
+                          std::vector<std::string_view>& lines) {
+        const __m256i newline = _mm256_set1_epi8('\n');
+        std::size_t begin = 0;
+        std::size_t position = scanned;
+
+        for(; position + 32 <= size; position += 32) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + position));
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)));
+            emitLines(mask, position, data, begin, lines);
+        }
+        return splitTail(data, position, size, begin, lines);
+    }
+#endif
+
+    SplitFunction selectSplit() {
+#ifdef LIB_CREDIRECT_HAVE_X86_SIMD
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) {
+            return splitAvx2;
+        }
+        if(__builtin_cpu_supports("sse2")) {
+            return splitSse2;
+        }
+#endif
+        return splitScalar;
+    }
+}
+
+std::size_t LineSplitter::split(const char* data, std::size_t size, std::size_t scanned,
+                                std::vector<std::string_view>& lines)
+{
+    static const SplitFunction selected = selectSplit();
+    return selected(data, size, scanned, lines);
+}
+
+LIB_CREDIRECT_NAMESPACE_END
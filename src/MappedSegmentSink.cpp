@@ -0,0 +1,442 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#include <CRedirect_config.h>
+#include <MappedSegmentSink.hpp>
+#include <FlightRecorder.hpp>
+
+#ifdef LIB_CREDIRECT_ENABLE_FILE_SINK
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+/**
+ * @file MappedSegmentSink.cpp
+ * @brief Implementation of the MappedSegmentSink class.
+ *
+ * Two segments take turns: while writers fill the current one, the background thread
+ * closes the previous one and maps its successor in the same slot. A writer registers in
+ * `writers` before it checks that the segment is still current, so once the background
+ * thread sees no writers on a segment that is no longer current, nobody touches its
+ * mapping any more.
+ *
+ * A writer reserves room by advancing `reserved`, copies its batch and adds its size to
+ * `committed`, without waiting for the writers that reserved before it. The batches that
+ * fit are contiguous, so once a segment has no writers `committed` is the exact length of
+ * its data; while writers are active it is the amount copied so far. The writer whose
+ * reservation crosses the end of the segment is the only one that rolls over to the next
+ * segment, the others that did not fit wait for it and try again.
+ */
+
+namespace {
+    std::string segmentName(const std::string& path, std::uint64_t index) {
+        char suffix[24];
+        std::snprintf(suffix, sizeof(suffix), ".%06llu", static_cast<unsigned long long>(index));
+        return path + suffix;
+    }
+
+    /**
+     * @brief Returns the index after the highest existing segment of a path.
+     */
+    std::uint64_t firstFreeIndex(const std::string& path) {
+        namespace fs = std::filesystem;
+        fs::path base(path);
+        fs::path dir = base.has_parent_path() ? base.parent_path() : fs::path(".");
+        std::string prefix = base.filename().string() + ".";
+
+        std::uint64_t last = 0;
+        std::error_code ec;
+        for(const auto& entry : fs::directory_iterator(dir, ec)) {
+            std::string name = entry.path().filename().string();
+            if(name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0
+               && name.find_first_not_of("0123456789", prefix.size()) == std::string::npos) {
+                last = std::max<std::uint64_t>(last, std::strtoull(name.c_str() + prefix.size(), nullptr, 10));
+            }
+        }
+        return last + 1;
+    }
+}
+
+/**
+ * @struct MappedSegmentSink::MappedSegmentSinkPimpl
+ * @brief Private implementation (Pimpl) for the MappedSegmentSink class.
+ *
+ * @details
+ * - `segments`: The two segment slots, `current` points to the one being written.
+ * - `retiring`: Full segment the background thread has to close, protected by `mtx`.
+ * - `preparing`: Slot the background thread has to map the next segment into.
+ * - `failed`: No further segment could be created, lines are dropped from then on.
+ * - `segmentsUsed`: Incremented by every rollover, writers that did not fit wait for it to change.
+ */
+struct HIDDEN MappedSegmentSink::MappedSegmentSinkPimpl {
+    struct Segment {
+        std::atomic<int> writers{0};
+        std::atomic<std::size_t> reserved{0};
+        std::atomic<std::size_t> committed{0};
+        char* base = nullptr;
+        std::size_t size = 0;
+        int fd = -1;
+        std::string name;
+        std::size_t flushed = 0;    // only used by the background thread
+        bool ready = false;         // mapped and waiting to become current, protected by `mtx`
+    };
+
+    MappedSegmentSinkPimpl(const std::string& path, const MappedSegmentOptions& options) :
+        options(options),
+        path(path),
+        nextIndex(firstFreeIndex(path)) {}
+
+    bool open(Segment& segment);
+    void close(Segment& segment);
+    void roll(Segment* full);
+
+    const MappedSegmentOptions options;
+    const std::string path;
+    std::uint64_t nextIndex;
+    Segment segments[2];
+    std::atomic<Segment*> current{nullptr};
+    std::atomic<bool> failed{false};
+    std::atomic<std::uint64_t> droppedLines{0};
+
+    mutable std::mutex mtx;
+    std::condition_variable rolled;
+    std::condition_variable work;
+    Segment* retiring = nullptr;
+    Segment* preparing = nullptr;
+    bool stopping = false;
+    std::uint64_t retiredBytes = 0;
+    std::atomic<std::uint64_t> segmentsUsed{0};
+    std::thread background;
+};
+
+/**
+ * @brief Creates the next segment file at its full size and maps it into a slot.
+ */
+bool MappedSegmentSink::MappedSegmentSinkPimpl::open(Segment& segment)
+{
+    int fd = -1;
+    std::string name;
+    do {
+        name = segmentName(path, nextIndex++);
+        fd = ::open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    } while(fd < 0 && errno == EEXIST);
+    if(fd < 0) {
+        return false;
+    }
+
+    // Allocate the blocks now so that a full disk shows here and not as SIGBUS in a writer,
+    // a sparse file is only used where the file system cannot preallocate at all
+    const auto size = static_cast<off_t>(options.segmentSize);
+    const int allocated = ::posix_fallocate(fd, 0, size);
+    const bool unsupported = allocated == EOPNOTSUPP || allocated == EINVAL;
+    if(allocated != 0 && (!unsupported || ::ftruncate(fd, size) != 0)) {
+        ::close(fd);
+        ::unlink(name.c_str());
+        return false;
+    }
+
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+    void* base = ::mmap(nullptr, options.segmentSize, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if(base == MAP_FAILED) {
+        ::close(fd);
+        ::unlink(name.c_str());
+        return false;
+    }
+    ::madvise(base, options.segmentSize, MADV_SEQUENTIAL);
+
+    segment.base = static_cast<char*>(base);
+    segment.size = options.segmentSize;
+    segment.fd = fd;
+    segment.name = std::move(name);
+    segment.flushed = 0;
+    segment.reserved = 0;
+    segment.committed = 0;
+    return true;
+}
+
+/**
+ * @brief Unmaps a segment nobody writes to any more and truncates it to its committed length.
+ *
+ * An empty segment is removed.
+ */
+void MappedSegmentSink::MappedSegmentSinkPimpl::close(Segment& segment)
+{
+    if(segment.base == nullptr) {
+        return;
+    }
+
+    std::size_t length = segment.committed.load();
+    if(options.syncOnRollover && length > 0) {
+        ::msync(segment.base, length, MS_SYNC);
+    }
+    ::munmap(segment.base, segment.size);
+    ::ftruncate(segment.fd, static_cast<off_t>(length));
+    ::close(segment.fd);
+    if(length == 0) {
+        ::unlink(segment.name.c_str());
+    }
+    segment.base = nullptr;
+    segment.fd = -1;
+}
+
+/**
+ * @brief Makes the other slot current once its segment is mapped, called by the writer
+ * whose reservation crossed the end of `full`.
+ */
+void MappedSegmentSink::MappedSegmentSinkPimpl::roll(Segment* full)
+{
+    Segment* next = full == &segments[0] ? &segments[1] : &segments[0];
+
+    std::unique_lock<std::mutex> lock(mtx);
+    rolled.wait(lock, [this, next] { return next->ready || failed.load() || stopping; });
+    if(next->ready) {
+        next->ready = false;
+        current = next;
+        retiring = full;
+        ++segmentsUsed;
+        work.notify_one();
+    }
+    rolled.notify_all();
+}
+
+MappedSegmentSink::MappedSegmentSink(const std::string& path, const MappedSegmentOptions& options)
+{
+    d = new MappedSegmentSinkPimpl(path, options);
+    if(options.segmentSize == 0 || !d->open(d->segments[0])) {
+        return;
+    }
+
+    d->current = &d->segments[0];
+    d->segmentsUsed = 1;
+    d->preparing = &d->segments[1];
+    d->background = std::thread(&MappedSegmentSink::writeback, this);
+}
+
+MappedSegmentSink::~MappedSegmentSink()
+{
+    if(d->background.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(d->mtx);
+            d->stopping = true;
+        }
+        d->work.notify_all();
+        d->rolled.notify_all();
+        d->background.join();
+    }
+
+    d->close(d->segments[0]);
+    d->close(d->segments[1]);
+    delete d;
+}
+
+bool MappedSegmentSink::active() const
+{
+    return d->background.joinable() && !d->failed;
+}
+
+void MappedSegmentSink::update(std::string_view line)
+{
+    updateBatch(&line, 1);
+}
+
+void MappedSegmentSink::updateBatch(const std::string_view* lines, std::size_t count)
+{
+    if(!d->background.joinable()) {
+        return;
+    }
+
+    const std::size_t ending = d->options.lineEnding.size();
+    std::size_t size = 0;
+    for(std::size_t i = 0; i < count; ++i) {
+        size += lines[i].size() + ending;
+    }
+
+    if(size <= d->options.segmentSize) {
+        append(lines, count, size);
+        return;
+    }
+
+    // Too large for one segment, store line by line
+    for(std::size_t i = 0; i < count; ++i) {
+        if(lines[i].size() + ending <= d->options.segmentSize) {
+            append(&lines[i], 1, lines[i].size() + ending);
+        } else {
+            ++d->droppedLines;
+        }
+    }
+}
+
+MappedSegmentStats MappedSegmentSink::stats() const
+{
+    std::lock_guard<std::mutex> lock(d->mtx);
+    MappedSegmentStats result;
+    result.bytesCommitted = d->retiredBytes;
+    if(d->retiring != nullptr) {
+        result.bytesCommitted += d->retiring->committed.load();
+    }
+    if(d->current.load() != nullptr) {
+        result.bytesCommitted += d->current.load()->committed.load();
+    }
+    result.segments = d->segmentsUsed;
+    result.droppedLines = d->droppedLines;
+    return result;
+}
+
+/**
+ * @brief Reserves room for a batch that fits in a segment, copies and commits it.
+ *
+ * @param lines The lines to store.
+ * @param count Number of lines.
+ * @param size Size of the lines with their line endings.
+ */
+void HIDDEN MappedSegmentSink::append(const std::string_view* lines, std::size_t count, std::size_t size)
+{
+    using Segment = MappedSegmentSinkPimpl::Segment;
+    const std::string& ending = d->options.lineEnding;
+
+    for(;;) {
+        if(d->failed) {
+            d->droppedLines += count;
+            return;
+        }
+
+        // Read before the segment is known to be current, so its rollover changes the count
+        std::uint64_t used = d->segmentsUsed.load();
+        Segment* segment = d->current.load();
+        segment->writers.fetch_add(1);
+        if(d->current.load() != segment) {
+            segment->writers.fetch_sub(1);
+            continue;
+        }
+
+        std::size_t start = segment->reserved.fetch_add(size);
+        if(start + size <= segment->size) {
+            char* out = segment->base + start;
+            for(std::size_t i = 0; i < count; ++i) {
+                std::memcpy(out, lines[i].data(), lines[i].size());
+                out += lines[i].size();
+                std::memcpy(out, ending.data(), ending.size());
+                out += ending.size();
+            }
+
+            segment->committed.fetch_add(size, std::memory_order_release);
+            segment->writers.fetch_sub(1, std::memory_order_release);
+            return;
+        }
+
+        bool crossed = start <= segment->size;
+        segment->writers.fetch_sub(1);
+        if(crossed) {
+            d->roll(segment);
+        } else {
+            // The slot may be current again by the time this thread wakes, the count is not
+            std::unique_lock<std::mutex> lock(d->mtx);
+            d->rolled.wait(lock, [this, used] {
+                return d->segmentsUsed.load() != used || d->failed.load() || d->stopping;
+            });
+        }
+    }
+}
+
+/**
+ * @brief Background thread loop, closes full segments, maps the next one and starts
+ * writeback of committed data until stopped.
+ */
+void HIDDEN MappedSegmentSink::writeback()
+{
+#ifdef LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+    FlightRecorder::installAlternateStack();
+#endif
+    using Segment = MappedSegmentSinkPimpl::Segment;
+
+    std::unique_lock<std::mutex> lock(d->mtx);
+    for(;;) {
+        d->work.wait_for(lock, d->options.writebackInterval, [this] {
+            return d->stopping || d->retiring != nullptr || d->preparing != nullptr;
+        });
+
+        if(d->retiring != nullptr) {
+            Segment* segment = d->retiring;
+            lock.unlock();
+            while(segment->writers.load() != 0) {
+                std::this_thread::yield();
+            }
+            std::size_t length = segment->committed.load();
+            d->close(*segment);
+
+            lock.lock();
+            d->retiring = nullptr;
+            d->retiredBytes += length;
+            d->preparing = segment;
+            continue;
+        }
+
+        if(d->preparing != nullptr && !d->stopping) {
+            Segment* segment = d->preparing;
+            d->preparing = nullptr;
+            lock.unlock();
+            bool mapped = d->open(*segment);
+
+            lock.lock();
+            segment->ready = mapped;
+            d->failed = !mapped;
+            d->rolled.notify_all();
+            continue;
+        }
+
+        if(d->stopping) {
+            break;
+        }
+
+        // Start writeback of about what was copied since the last round, without waiting for it
+        Segment* segment = d->current.load();
+        std::size_t length = segment->committed.load(std::memory_order_acquire);
+        if(length > segment->flushed) {
+            lock.unlock();
+#ifdef __linux__
+            ::sync_file_range(segment->fd, static_cast<off_t>(segment->flushed),
+                              static_cast<off_t>(length - segment->flushed), SYNC_FILE_RANGE_WRITE);
+#else
+            std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+            std::size_t from = segment->flushed / page * page;
+            ::msync(segment->base + from, length - from, MS_ASYNC);
+#endif
+            segment->flushed = length;
+            lock.lock();
+        }
+    }
+}
+
+LIB_CREDIRECT_NAMESPACE_END
+
+#endif // LIB_CREDIRECT_ENABLE_FILE_SINK
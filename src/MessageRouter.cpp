@@ -0,0 +1,170 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#include <CRedirect_config.h>
+#include <MessageRouter.hpp>
+#include <Snapshot.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+/**
+ * @file MessageRouter.cpp
+ * @brief Implementation of the MessageRouter class.
+ *
+ * The subscriptions are an immutable Snapshot replaced as a whole on every change, read by
+ * publish() without a lock in the same way StreamRedirect reads its observers. For every
+ * level the union of the destinations subscribed to is kept in an atomic of its own, so
+ * that coverage() is a single load.
+ */
+
+namespace {
+    constexpr unsigned kLevels = 32;
+}
+
+/**
+ * @struct MessageRouter::MessageRouterPimpl
+ * @brief Private implementation (Pimpl) for the MessageRouter class.
+ *
+ * @details
+ * - `subscriptions`: Immutable snapshot of the observers and their masks.
+ * - `coverage`: Per level, the destinations that at least one observer subscribed to.
+ * - `mtx`: Mutex serializing attach and detach, never taken by publish.
+ */
+struct HIDDEN MessageRouter::MessageRouterPimpl {
+    /**
+     * @brief An observer and the levels and destinations it wants.
+     */
+    struct Subscription {
+        LineObserver* observer;
+        std::uint32_t levels;
+        std::uint32_t destinations;
+    };
+    using SubscriptionList = std::vector<Subscription>;
+
+    MessageRouterPimpl() {
+        for(auto& destinations : coverage) {
+            destinations.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Publishes a new snapshot and the coverage it implies, called with `mtx` held.
+     *
+     * A destination leaves the coverage before the snapshot without its observers is
+     * published and joins it only after the snapshot with them, so that a message is never
+     * routed by a coverage newer than the snapshot it is delivered with: it is neither
+     * routed to a snapshot that lacks the new observer nor written directly as well as
+     * delivered to an observer that is leaving.
+     */
+    void replace(SubscriptionList list) {
+        std::uint32_t updated[kLevels] = {};
+        for(unsigned level = 0; level < kLevels; ++level) {
+            for(const Subscription& subscription : list) {
+                if(subscription.levels & (1u << level)) {
+                    updated[level] |= subscription.destinations;
+                }
+            }
+            coverage[level].fetch_and(updated[level], std::memory_order_release);
+        }
+        subscriptions.replace(std::move(list));
+        for(unsigned level = 0; level < kLevels; ++level) {
+            coverage[level].store(updated[level], std::memory_order_release);
+        }
+    }
+
+    Snapshot<SubscriptionList> subscriptions;
+    std::atomic<std::uint32_t> coverage[kLevels];
+    std::mutex mtx;
+};
+
+MessageRouter::MessageRouter()
+{
+    d = new MessageRouterPimpl();
+}
+
+MessageRouter::~MessageRouter()
+{
+    delete d;
+}
+
+void MessageRouter::attach(LineObserver* observer, std::uint32_t levels, std::uint32_t destinations)
+{
+    if(!observer)
+        return;
+
+    std::lock_guard<std::mutex> lock(d->mtx);
+    MessageRouterPimpl::SubscriptionList list = d->subscriptions.get();
+    auto existing = std::find_if(list.begin(), list.end(),
+        [observer](const MessageRouterPimpl::Subscription& subscription) { return subscription.observer == observer; });
+    if(existing != list.end()) {
+        existing->levels = levels;
+        existing->destinations = destinations;
+    } else {
+        list.push_back({ observer, levels, destinations });
+    }
+    d->replace(std::move(list));
+    d->subscriptions.reclaim();
+}
+
+void MessageRouter::detach(LineObserver* observer)
+{
+    if(!observer)
+        return;
+
+    std::lock_guard<std::mutex> lock(d->mtx);
+    MessageRouterPimpl::SubscriptionList list = d->subscriptions.get();
+    list.erase(std::remove_if(list.begin(), list.end(),
+        [observer](const MessageRouterPimpl::Subscription& subscription) { return subscription.observer == observer; }),
+        list.end());
+    d->replace(std::move(list));
+    d->subscriptions.synchronize();
+}
+
+std::uint32_t MessageRouter::coverage(unsigned level) const
+{
+    return level < kLevels ? d->coverage[level].load(std::memory_order_acquire) : 0;
+}
+
+bool MessageRouter::publish(const std::string_view* lines, std::size_t count, unsigned level, std::uint32_t destinations)
+{
+    if(level >= kLevels || count == 0) {
+        return false;
+    }
+
+    const Snapshot<MessageRouterPimpl::SubscriptionList>::Reader subscriptions(d->subscriptions);
+    bool delivered = false;
+    const std::uint32_t bit = 1u << level;
+    for(const MessageRouterPimpl::Subscription& subscription : *subscriptions) {
+        if((subscription.levels & bit) && (subscription.destinations & destinations)) {
+            subscription.observer->updateBatch(lines, count);
+            delivered = true;
+        }
+    }
+    return delivered;
+}
+
+bool MessageRouter::publish(std::string_view line, unsigned level, std::uint32_t destinations)
+{
+    return publish(&line, 1, level, destinations);
+}
+
+LIB_CREDIRECT_NAMESPACE_END
@@ -0,0 +1,224 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#include <CRedirect_config.h>
+#include <MirroredBuffer.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <unistd.h>
+# define LIB_CREDIRECT_HAVE_MMAP
+#endif
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+/**
+ * @file MirroredBuffer.cpp
+ * @brief Implementation of the MirroredBuffer class.
+ *
+ * The mirror is built by reserving twice the capacity of address space and then
+ * mapping the same shared memory object over both halves. On Linux the memory
+ * object comes from memfd_create, on other POSIX systems from an immediately
+ * unlinked shm_open object.
+ */
+
+namespace {
+    std::size_t roundCapacity(std::size_t capacity, std::size_t minimum) {
+        std::size_t result = 1;
+        while(result < capacity || result < minimum) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+#ifdef LIB_CREDIRECT_HAVE_MMAP
+    int createMemoryObject() {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+        return memfd_create("credirect", MFD_CLOEXEC);
+#else
+        static std::atomic<unsigned> counter{0};
+        std::string name = "/credirect-" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if(fd >= 0) {
+            shm_unlink(name.c_str());
+        }
+        return fd;
+#endif
+    }
+
+    char* mapMirrored(std::size_t capacity) {
+        int fd = createMemoryObject();
+        if(fd < 0) {
+            return nullptr;
+        }
+        if(ftruncate(fd, static_cast<off_t>(capacity)) != 0) {
+            close(fd);
+            return nullptr;
+        }
+
+        // Reserve the address range for both halves, then map the object over it twice
+        void* reserved = mmap(nullptr, capacity * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(reserved == MAP_FAILED) {
+            close(fd);
+            return nullptr;
+        }
+
+        char* base = static_cast<char*>(reserved);
+        void* first = mmap(base, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+        void* second = mmap(base + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+        close(fd);
+
+        if(first != base || second != base + capacity) {
+            munmap(base, capacity * 2);
+            return nullptr;
+        }
+        return base;
+    }
+#endif
+}
+
+/**
+ * @struct MirroredBuffer::MirroredBufferPimpl
+ * @brief Private implementation (Pimpl) for the MirroredBuffer class.
+ */
+struct HIDDEN MirroredBuffer::MirroredBufferPimpl {
+    MirroredBufferPimpl() : base(nullptr), capacity(0), mirrored(false) {}
+
+    ~MirroredBufferPimpl() {
+        if(!base) {
+            return;
+        }
+#ifdef LIB_CREDIRECT_HAVE_MMAP
+        if(mirrored) {
+            munmap(base, capacity * 2);
+            return;
+        }
+#endif
+        delete[] base;
+    }
+
+    char* base;
+    std::size_t capacity;
+    bool mirrored;
+};
+
+MirroredBuffer::MirroredBuffer() : d(new MirroredBufferPimpl())
+{
+}
+
+/**
+ * @brief Constructor for the MirroredBuffer class.
+ *
+ * Tries to create the double mapping first and falls back to a plain allocation.
+ *
+ * @param capacity Capacity in bytes, rounded up to a power of two (and to the page size when mirrored).
+ */
+MirroredBuffer::MirroredBuffer(std::size_t capacity) : d(new MirroredBufferPimpl())
+{
+#ifdef LIB_CREDIRECT_HAVE_MMAP
+    long page = sysconf(_SC_PAGESIZE);
+    std::size_t mapped = roundCapacity(capacity, page > 0 ? static_cast<std::size_t>(page) : 4096);
+    d->base = mapMirrored(mapped);
+    if(d->base) {
+        d->capacity = mapped;
+        d->mirrored = true;
+        return;
+    }
+#endif
+    d->capacity = roundCapacity(capacity, 16);
+    d->base = new char[d->capacity];
+}
+
+MirroredBuffer::~MirroredBuffer()
+{
+    delete d;
+}
+
+MirroredBuffer::MirroredBuffer(MirroredBuffer&& other) noexcept : d(other.d)
+{
+    other.d = new MirroredBufferPimpl();
+}
+
+MirroredBuffer& MirroredBuffer::operator=(MirroredBuffer&& other) noexcept
+{
+    std::swap(d, other.d);
+    return *this;
+}
+
+char* MirroredBuffer::data() const
+{
+    return d->base;
+}
+
+std::size_t MirroredBuffer::capacity() const
+{
+    return d->capacity;
+}
+
+bool MirroredBuffer::mirrored() const
+{
+    return d->mirrored;
+}
+
+/**
+ * @brief Returns the number of bytes that are contiguous in memory starting at a logical position.
+ *
+ * @param position Logical (unwrapped) position in the circular buffer.
+ * @param size Number of bytes wanted.
+ * @return size if the range is contiguous, otherwise the number of bytes up to the end of the buffer.
+ */
+std::size_t MirroredBuffer::contiguous(std::uint64_t position, std::size_t size) const
+{
+    if(d->mirrored) {
+        return size;
+    }
+    std::size_t offset = static_cast<std::size_t>(position & (d->capacity - 1));
+    return std::min(size, d->capacity - offset);
+}
+
+/**
+ * @brief Returns a pointer to a logical (unwrapped) position in the circular buffer.
+ */
+char* MirroredBuffer::at(std::uint64_t position) const
+{
+    return d->base + static_cast<std::size_t>(position & (d->capacity - 1));
+}
+
+/**
+ * @brief Copies a range of this buffer into another circular buffer at the same logical position.
+ *
+ * @param target Buffer receiving the data.
+ * @param position Logical position of the first byte.
+ * @param size Number of bytes to copy, at most the capacity of both buffers.
+ */
+void MirroredBuffer::copyTo(MirroredBuffer& target, std::uint64_t position, std::size_t size) const
+{
+    while(size > 0) {
+        std::size_t chunk = std::min(contiguous(position, size), target.contiguous(position, size));
+        std::memcpy(target.at(position), at(position), chunk);
+        position += chunk;
+        size -= chunk;
+    }
+}
+
+LIB_CREDIRECT_NAMESPACE_END
@@ -0,0 +1,446 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#include <CRedirect_config.h>
+#include <RingBuffer.hpp>
+#include <CaptureClock.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+/**
+ * @file RingBuffer.cpp
+ * @brief Implementation of the RingBuffer class.
+ *
+ * Each record starts with a 24 byte header: the payload length in the first 4 bytes,
+ * then the CaptureClock time of the write and its global sequence number, 8 bytes
+ * each. A zero length means the record has been reserved but not committed yet, the
+ * high bit marks a padding record that skips to the start of the ring. Only records
+ * holding a newline draw a sequence number, the others have 0.
+ * The consumer zeroes every record it releases so that any 8 byte aligned offset
+ * reads as "not committed" until a producer publishes a header there.
+ */
+
+namespace {
+    using header_type = std::atomic<std::uint32_t>;
+    static_assert(sizeof(header_type) == sizeof(std::uint32_t), "record header must be a plain 32-bit word");
+
+    constexpr std::size_t kHeaderSize = 24;
+    constexpr std::size_t kTimeOffset = 8;
+    constexpr std::size_t kSequenceOffset = 16;
+    constexpr std::size_t kAlignment = 8;
+    constexpr std::uint32_t kPadding = 0x80000000u;
+    constexpr std::size_t kMinCapacity = 256;
+    constexpr std::size_t kMaxCapacity = std::size_t(1) << 30;
+    constexpr int kSpinCount = 64;
+
+    // Consumer states seen by the producers when they decide whether to wake it
+    constexpr int kRunning = 0;
+    constexpr int kIdle = 1;
+    constexpr int kCoalescing = 2;
+
+    constexpr std::size_t align(std::size_t size) {
+        return (size + kAlignment - 1) & ~(kAlignment - 1);
+    }
+
+    std::size_t roundCapacity(std::size_t capacity) {
+        std::size_t result = kMinCapacity;
+        while(result < capacity && result < kMaxCapacity) {
+            result <<= 1;
+        }
+        return result;
+    }
+}
+
+/**
+ * @struct RingBuffer::RingBufferPimpl
+ * @brief Private implementation (Pimpl) for the RingBuffer class.
+ *
+ * @details
+ * - `storage`: Backing store, kept as 64-bit words so record headers are aligned.
+ * - `base`: Byte view of the backing store.
+ * - `mask`: Capacity minus one, used to turn cursors into offsets.
+ * - `head`: Reservation cursor shared by all producers.
+ * - `tail`: Release cursor owned by the consumer.
+ * - `consumerState`: kRunning, or why the consumer is (about to be) asleep on `consumerCv`:
+ *   kIdle while the ring is empty, kCoalescing while it waits for a wakeup for data it already has.
+ * - `signaled`: Set by a commit that satisfied the wakeup policy.
+ * - `producersWaiting`: Number of producers asleep on `producerCv` waiting for space.
+ * - `overflow`, `timeout`: What a producer does when the ring is full.
+ * - `droppedBytes`, `droppedLines`: Data discarded by the overflow policy.
+ * - `terminated`: Set once the ring stops accepting data.
+ * - `mtx`: Mutex used only to sleep and wake threads, never on the data path.
+ */
+struct HIDDEN RingBuffer::RingBufferPimpl {
+    RingBufferPimpl(std::size_t cap, WakeupPolicy policy, std::size_t mark, std::chrono::microseconds wait) :
+        storage(cap / sizeof(std::uint64_t), 0),
+        base(reinterpret_cast<char*>(storage.data())),
+        capacity(cap),
+        mask(cap - 1),
+        wakeup(policy),
+        highWaterMark(mark),
+        delay(wait),
+        head(0),
+        tail(0),
+        consumerState(kRunning),
+        signaled(false),
+        producersWaiting(0),
+        overflow(OverflowPolicy::Block),
+        timeout(0),
+        droppedBytes(0),
+        droppedLines(0),
+        terminated(false) {}
+
+    header_type* header(std::uint64_t cursor) const {
+        return reinterpret_cast<header_type*>(base + (cursor & mask));
+    }
+
+    bool hasSpace(std::size_t total) const {
+        std::uint64_t t = tail.load(std::memory_order_seq_cst);
+        std::uint64_t h = head.load(std::memory_order_acquire);
+        return h + total - t <= capacity;
+    }
+
+    bool readable() const {
+        std::uint64_t t = tail.load(std::memory_order_relaxed);
+        if(t == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        return header(t)->load(std::memory_order_acquire) != 0;
+    }
+
+    /**
+     * @brief Waits until `total` bytes are free, returns false if the overflow policy gives up instead.
+     */
+    bool waitForSpace(std::size_t total) {
+        if(overflow != OverflowPolicy::Block) {
+            return hasSpace(total) || terminated;
+        }
+
+        for(int i = 0; i < kSpinCount; ++i) {
+            if(hasSpace(total) || terminated) {
+                return true;
+            }
+            std::this_thread::yield();
+        }
+
+        auto ready = [this, total] { return hasSpace(total) || terminated; };
+        std::unique_lock<std::mutex> lock(mtx);
+        producersWaiting.fetch_add(1, std::memory_order_seq_cst);
+        bool result = true;
+        if(timeout.count() > 0) {
+            result = producerCv.wait_for(lock, timeout, ready);
+        } else {
+            producerCv.wait(lock, ready);
+        }
+        producersWaiting.fetch_sub(1, std::memory_order_relaxed);
+        return result;
+    }
+
+    void drop(const char* data, std::size_t size) {
+        droppedBytes.fetch_add(size, std::memory_order_relaxed);
+        droppedLines.fetch_add(static_cast<std::uint64_t>(std::count(data, data + size, '\n')), std::memory_order_relaxed);
+    }
+
+    void wakeConsumer(bool newline) {
+        bool wake = wakeup == WakeupPolicy::EveryWrite ||
+            (wakeup == WakeupPolicy::Newline && newline) ||
+            head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed) >= highWaterMark;
+        if(wake) {
+            signaled.store(true, std::memory_order_relaxed);
+        }
+
+        // An idle consumer is always woken so that it can start its coalescing delay,
+        // a coalescing one only when the policy asks for it.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(notifier) {
+            notifier(wake);
+            return;
+        }
+        int state = consumerState.load(std::memory_order_relaxed);
+        if(state == kIdle || (wake && state == kCoalescing)) {
+            std::lock_guard<std::mutex> lock(mtx);
+            consumerCv.notify_one();
+        }
+    }
+
+    bool writeRecord(const char* data, std::size_t size) {
+        const std::uint64_t captured = CaptureClock::now();
+        const bool newline = std::memchr(data, '\n', size) != nullptr;
+        const std::uint64_t sequence = newline ? CaptureClock::nextSequence() : 0;
+        const std::size_t need = align(kHeaderSize + size);
+        std::uint64_t h;
+        std::size_t offset;
+        std::size_t total;
+
+        for(;;) {
+            if(terminated) {
+                return false;
+            }
+            std::uint64_t t = tail.load(std::memory_order_acquire);
+            h = head.load(std::memory_order_acquire);
+            offset = h & mask;
+            std::size_t toEnd = capacity - offset;
+            total = need <= toEnd ? need : toEnd + need;
+
+            if(h + total - t > capacity) {
+                if(!waitForSpace(total)) {
+                    drop(data, size);
+                    return true;
+                }
+                continue;
+            }
+            if(head.compare_exchange_weak(h, h + total, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+
+        if(total != need) {
+            // The record does not fit before the end of the ring, skip to the start
+            header(h)->store(static_cast<std::uint32_t>(capacity - offset) | kPadding, std::memory_order_release);
+            offset = 0;
+        }
+
+        std::memcpy(base + offset + kTimeOffset, &captured, sizeof(captured));
+        std::memcpy(base + offset + kSequenceOffset, &sequence, sizeof(sequence));
+        std::memcpy(base + offset + kHeaderSize, data, size);
+        header(offset)->store(static_cast<std::uint32_t>(size), std::memory_order_release);
+        wakeConsumer(newline);
+        return true;
+    }
+
+    std::vector<std::uint64_t> storage;
+    char* base;
+    const std::size_t capacity;
+    const std::size_t mask;
+    const WakeupPolicy wakeup;
+    const std::size_t highWaterMark;
+    const std::chrono::microseconds delay;
+    std::function<void(bool)> notifier;
+    alignas(64) std::atomic<std::uint64_t> head;
+    alignas(64) std::atomic<std::uint64_t> tail;
+    alignas(64) std::atomic<int> consumerState;
+    std::atomic<bool> signaled;
+    std::atomic<int> producersWaiting;
+    OverflowPolicy overflow;
+    std::chrono::milliseconds timeout;
+    std::atomic<std::uint64_t> droppedBytes;
+    std::atomic<std::uint64_t> droppedLines;
+    std::atomic<bool> terminated;
+    std::mutex mtx;
+    std::condition_variable consumerCv;
+    std::condition_variable producerCv;
+};
+
+/**
+ * @brief Constructor for the RingBuffer class.
+ *
+ * @param capacity Capacity in bytes, rounded up to a power of two.
+ * @param wakeup When a commit wakes the consumer.
+ * @param highWaterMark Amount of unread data in bytes that always wakes the consumer.
+ * @param delay Longest time the consumer waits for a wakeup once data that did not wake it is readable.
+ */
+RingBuffer::RingBuffer(std::size_t capacity, WakeupPolicy wakeup, std::size_t highWaterMark, std::chrono::microseconds delay)
+{
+    d = new RingBufferPimpl(roundCapacity(capacity), wakeup, highWaterMark, delay);
+}
+
+/**
+ * @brief Destructor for the RingBuffer class.
+ */
+RingBuffer::~RingBuffer()
+{
+    terminate();
+    delete d;
+}
+
+/**
+ * @brief Copies data into the ring, waiting for space when the ring is full.
+ *
+ * The data is split into records of at most half the ring so that a record
+ * plus its padding can always fit once the consumer has caught up.
+ *
+ * @param data Pointer to the bytes to write.
+ * @param size Number of bytes to write.
+ * @return The number of bytes written, less than size only if the ring was terminated.
+ */
+std::size_t RingBuffer::write(const char* data, std::size_t size)
+{
+    const std::size_t maxRecord = d->capacity / 2 - kHeaderSize;
+    std::size_t written = 0;
+
+    while(written < size) {
+        std::size_t chunk = std::min(size - written, maxRecord);
+        if(!d->writeRecord(data + written, chunk)) {
+            break;
+        }
+        written += chunk;
+    }
+    return written;
+}
+
+/**
+ * @brief Hands every committed record to the consumer callback and frees its space.
+ *
+ * @param consumer Called once per record with a pointer to the payload, its size, the
+ *                 CaptureClock time at which it was written and its global sequence number.
+ * @return The number of payload bytes consumed.
+ */
+std::size_t RingBuffer::consume(const std::function<void(const char*, std::size_t, std::uint64_t, std::uint64_t)>& consumer)
+{
+    std::uint64_t t = d->tail.load(std::memory_order_relaxed);
+    const std::uint64_t h = d->head.load(std::memory_order_acquire);
+    std::size_t bytes = 0;
+
+    while(t != h) {
+        header_type* hdr = d->header(t);
+        std::uint32_t value = hdr->load(std::memory_order_acquire);
+        if(value == 0) {
+            // Reserved but not committed yet, records must be consumed in order
+            break;
+        }
+
+        std::size_t recordSize;
+        char* record = reinterpret_cast<char*>(hdr);
+        if(value & kPadding) {
+            recordSize = value & ~kPadding;
+        } else {
+            std::uint64_t captured;
+            std::uint64_t sequence;
+            std::memcpy(&captured, record + kTimeOffset, sizeof(captured));
+            std::memcpy(&sequence, record + kSequenceOffset, sizeof(sequence));
+            consumer(record + kHeaderSize, value, captured, sequence);
+            bytes += value;
+            recordSize = align(kHeaderSize + value);
+        }
+
+        hdr->store(0, std::memory_order_relaxed);
+        std::memset(record + sizeof(header_type), 0, recordSize - sizeof(header_type));
+        t += recordSize;
+    }
+
+    d->tail.store(t, std::memory_order_seq_cst);
+    if(d->producersWaiting.load(std::memory_order_seq_cst) != 0) {
+        std::lock_guard<std::mutex> lock(d->mtx);
+        d->producerCv.notify_all();
+    }
+    return bytes;
+}
+
+/**
+ * @brief Blocks the consumer until a committed record is available or the ring is terminated.
+ *
+ * The wait has two stages. While the ring is empty the consumer sleeps without a timeout
+ * and the first commit wakes it. If that data did not satisfy the wakeup policy, the consumer
+ * then sleeps for at most the coalescing delay, or until a commit satisfies the policy.
+ *
+ * @return true if data is available, false if the ring was terminated and is empty.
+ */
+bool RingBuffer::wait()
+{
+    if(!d->readable()) {
+        std::unique_lock<std::mutex> lock(d->mtx);
+        d->consumerState.store(kIdle, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        d->consumerCv.wait(lock, [this] { return d->readable() || d->terminated; });
+        d->consumerState.store(kRunning, std::memory_order_relaxed);
+    }
+
+    if(d->wakeup != WakeupPolicy::EveryWrite && !d->signaled.load(std::memory_order_relaxed) && !d->terminated) {
+        std::unique_lock<std::mutex> lock(d->mtx);
+        d->consumerState.store(kCoalescing, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        d->consumerCv.wait_for(lock, d->delay, [this] { 
+            return d->signaled.load(std::memory_order_relaxed) || d->terminated; 
+        });
+        d->consumerState.store(kRunning, std::memory_order_relaxed);
+    }
+    d->signaled.store(false, std::memory_order_relaxed);
+
+    return d->readable();
+}
+
+/**
+ * @brief Returns true if at least one committed record is waiting for the consumer.
+ */
+bool RingBuffer::readable() const
+{
+    return d->readable();
+}
+
+/**
+ * @brief Marks the ring as terminated and wakes all waiting threads.
+ */
+void RingBuffer::terminate()
+{
+    std::lock_guard<std::mutex> lock(d->mtx);
+    d->terminated = true;
+    d->consumerCv.notify_all();
+    d->producerCv.notify_all();
+}
+
+/**
+ * @brief Returns the usable capacity of the ring in bytes.
+ */
+std::size_t RingBuffer::capacity() const
+{
+    return d->capacity;
+}
+
+/**
+ * @brief Installs a callback that is told about every commit instead of waking a waiting consumer.
+ *
+ * @param notifier Callback taking whether the wakeup policy asks for the consumer to run now.
+ */
+void RingBuffer::setNotifier(std::function<void(bool)> notifier)
+{
+    d->notifier = std::move(notifier);
+}
+
+/**
+ * @brief Selects what a producer does when the ring is full.
+ *
+ * @param overflow Policy applied to a record that does not fit.
+ * @param timeout Longest time a blocked producer waits before its record is dropped, 0 to wait forever.
+ */
+void RingBuffer::setOverflow(OverflowPolicy overflow, std::chrono::milliseconds timeout)
+{
+    d->overflow = overflow;
+    d->timeout = timeout;
+}
+
+/**
+ * @brief Returns the dropped data counters and the capacity of the ring.
+ */
+RedirectStats RingBuffer::stats() const
+{
+    RedirectStats stats;
+    stats.droppedBytes = d->droppedBytes.load(std::memory_order_relaxed);
+    stats.droppedLines = d->droppedLines.load(std::memory_order_relaxed);
+    stats.bufferSize = d->capacity;
+    return stats;
+}
+
+LIB_CREDIRECT_NAMESPACE_END
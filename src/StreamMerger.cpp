@@ -0,0 +1,266 @@
+/*
+ * This file is part of libCRedirect.
+ *
+ * libCRedirect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libCRedirect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libCRedirect. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Brian G Shea <bgshea@gmail.com>
+ */
+#include <CRedirect_config.h>
+#include <StreamMerger.hpp>
+#include <CaptureClock.hpp>
+#include <FlightRecorder.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+LIB_CREDIRECT_NAMESPACE_BEGIN
+/**
+ * @file StreamMerger.cpp
+ * @brief Implementation of the StreamMerger class.
+ *
+ * The inputs append to an unsorted list under the lock, the merger thread moves it into
+ * a min-heap keyed by global sequence number and releases the top of the heap while it
+ * continues the sequence already released, or the heap is over capacity. A line that has
+ * waited out the window is released with every line ordered before it, wherever it sits in
+ * the heap, so no line is held much longer than the window. Lines are delivered without
+ * holding the lock.
+ */
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief A line held by the merger, with the input it arrived on and when.
+     */
+    struct Entry {
+        std::size_t source;
+        std::string text;
+        LineMetadata metadata;
+        Clock::time_point arrived;
+    };
+
+    /**
+     * @brief Orders the heap so that its front is the line published first.
+     *
+     * Lines of one publish share their global sequence number, the input and the per stream
+     * sequence number then keep them in the order they were written.
+     */
+    bool later(const Entry& a, const Entry& b)
+    {
+        if(a.metadata.globalSequence != b.metadata.globalSequence) {
+            return a.metadata.globalSequence > b.metadata.globalSequence;
+        }
+        if(a.source != b.source) {
+            return a.source > b.source;
+        }
+        return a.metadata.sequence > b.metadata.sequence;
+    }
+}
+
+/**
+ * @struct StreamMerger::StreamMergerPimpl
+ * @brief Private implementation (Pimpl) for the StreamMerger class.
+ *
+ * @details
+ * - `observer`: Receives the merged timeline, only called from `worker`.
+ * - `inputs`: The inputs handed out by input(), index in the vector is the source of a line.
+ * - `incoming`: Lines copied by the inputs and not yet moved into `heap`.
+ * - `heap`: Reorder buffer, a min-heap ordered by `later`.
+ * - `released`: Highest global sequence number handed to the observer.
+ * - `inFlight`: Number of lines being delivered by the worker.
+ * - `stopping`: Set by the destructor, the worker releases everything and exits.
+ */
+struct HIDDEN StreamMerger::StreamMergerPimpl {
+    /**
+     * @brief Input attached to one stream, copies its batches into the merger.
+     */
+    class Input final : public MetadataObserver {
+    public:
+        Input(StreamMergerPimpl* owner, std::size_t index, const std::string& name) :
+            owner(owner), index(index), name(name) {}
+
+        void updateBatch(const std::string_view* lines, const LineMetadata* metadata, std::size_t count) override
+        {
+            owner->push(index, lines, metadata, count);
+        }
+
+        StreamMergerPimpl* const owner;
+        const std::size_t index;
+        const std::string name;
+    };
+
+    StreamMergerPimpl(MergedObserver* observer, std::chrono::microseconds window, std::size_t capacity) :
+        observer(observer),
+        window(window),
+        capacity(std::max<std::size_t>(capacity, 1)),
+        released(CaptureClock::lastSequence()),
+        inFlight(0),
+        stopping(false) {}
+
+    void push(std::size_t source, const std::string_view* lines, const LineMetadata* metadata, std::size_t count)
+    {
+        const Clock::time_point now = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for(std::size_t i = 0; i < count; ++i) {
+                incoming.push_back(Entry{source, std::string(lines[i]), metadata[i], now});
+            }
+            stats.maxPending = std::max(stats.maxPending, incoming.size() + heap.size() + inFlight);
+        }
+        wakeup.notify_one();
+    }
+
+    MergedObserver* observer;
+    const std::chrono::microseconds window;
+    const std::size_t capacity;
+    std::vector<std::unique_ptr<Input>> inputs;
+    std::vector<Entry> incoming;
+    std::vector<Entry> heap;
+    std::uint64_t released;
+    std::size_t inFlight;
+    bool stopping;
+    StreamMergerStats stats;
+    mutable std::mutex mtx;
+    std::condition_variable wakeup;
+    std::thread worker;
+};
+
+StreamMerger::StreamMerger(MergedObserver* observer, std::chrono::microseconds window, std::size_t capacity)
+{
+    d = new StreamMergerPimpl(observer, window, capacity);
+    d->worker = std::thread(&StreamMerger::merge, this);
+}
+
+StreamMerger::~StreamMerger()
+{
+    {
+        std::lock_guard<std::mutex> lock(d->mtx);
+        d->stopping = true;
+    }
+    d->wakeup.notify_all();
+    if(d->worker.joinable()) {
+        d->worker.join();
+    }
+    delete d;
+}
+
+MetadataObserver* StreamMerger::input(const std::string& source)
+{
+    std::lock_guard<std::mutex> lock(d->mtx);
+    d->inputs.push_back(std::make_unique<StreamMergerPimpl::Input>(d, d->inputs.size(), source));
+    return d->inputs.back().get();
+}
+
+StreamMergerStats StreamMerger::stats() const
+{
+    std::lock_guard<std::mutex> lock(d->mtx);
+    StreamMergerStats result = d->stats;
+    result.pending = d->incoming.size() + d->heap.size() + d->inFlight;
+    return result;
+}
+
+/**
+ * @brief Merger loop, releases the reorder buffer in order until stopped and drained.
+ */
+void HIDDEN StreamMerger::merge()
+{
+#ifdef LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+    FlightRecorder::installAlternateStack();
+#endif
+    std::vector<Entry> batch;
+    std::vector<MergedLine> lines;
+    std::unique_lock<std::mutex> lock(d->mtx);
+
+    for(;;) {
+        for(Entry& entry : d->incoming) {
+            d->heap.push_back(std::move(entry));
+            std::push_heap(d->heap.begin(), d->heap.end(), later);
+        }
+        d->incoming.clear();
+
+        // The last line in merge order that has waited out the window is due with everything
+        // before it, the first of the others to arrive decides when to look again
+        const Clock::time_point now = Clock::now();
+        Entry due{0, std::string(), LineMetadata(), now};
+        bool anyDue = false;
+        Clock::time_point deadline = Clock::time_point::max();
+        for(const Entry& entry : d->heap) {
+            if(entry.arrived + d->window > now) {
+                deadline = std::min(deadline, entry.arrived + d->window);
+            } else if(!anyDue || later(entry, due)) {
+                due.source = entry.source;
+                due.metadata = entry.metadata;
+                anyDue = true;
+            }
+        }
+
+        while(!d->heap.empty()) {
+            const Entry& top = d->heap.front();
+            const std::uint64_t sequence = top.metadata.globalSequence;
+            const bool next = sequence <= d->released + 1;
+            const bool expired = anyDue && !later(top, due);
+            const bool full = d->heap.size() > d->capacity;
+            if(!next && !expired && !full && !d->stopping) {
+                break;
+            }
+
+            if(!next && !expired && full) {
+                ++d->stats.forced;
+            }
+            if(sequence != 0 && sequence < d->released) {
+                ++d->stats.late;
+            }
+            d->released = std::max(d->released, sequence);
+
+            std::pop_heap(d->heap.begin(), d->heap.end(), later);
+            batch.push_back(std::move(d->heap.back()));
+            d->heap.pop_back();
+        }
+
+        if(!batch.empty()) {
+            // inputs may grow while the lock is released, the names themselves do not move
+            lines.clear();
+            for(const Entry& entry : batch) {
+                lines.push_back(MergedLine{d->inputs[entry.source]->name, entry.text, entry.metadata});
+            }
+            d->inFlight = batch.size();
+            lock.unlock();
+
+            d->observer->updateBatch(lines.data(), lines.size());
+
+            lock.lock();
+            d->stats.merged += batch.size();
+            d->inFlight = 0;
+            batch.clear();
+            continue;
+        }
+
+        if(d->stopping && d->incoming.empty()) {
+            break;
+        }
+
+        auto woken = [this] { return !d->incoming.empty() || d->stopping; };
+        if(d->heap.empty()) {
+            d->wakeup.wait(lock, woken);
+        } else {
+            d->wakeup.wait_until(lock, deadline, woken);
+        }
+    }
+}
+
+LIB_CREDIRECT_NAMESPACE_END
@@ -19,13 +19,21 @@
 #include <CRedirect_config.h>
 #include <StreamRedirect.hpp>
 #include <StreamObserver.hpp>
+#include <CaptureClock.hpp>
 #include <SynchronousStreamBuf.hpp>
+#include <Snapshot.hpp>
+#include <Dispatcher.hpp>
+#include <LineSplitter.hpp>
+#include <FlightRecorder.hpp>
 
 #include <algorithm>
 #include <atomic>
+#include <deque>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 #include <condition_variable>
@@ -40,6 +48,65 @@ LIB_CREDIRECT_NAMESPACE_BEGIN
  * stream buffer.
  */
 
+namespace {
+    /**
+     * @brief Scratch object of the calling thread, one for every nesting depth.
+     *
+     * An observer called in Inline dispatch mode may write to another redirected stream and
+     * so notify again on the same thread while its caller still uses the scratch object. Each
+     * level gets an object of its own; a deque never moves the existing ones as it grows.
+     */
+    template<typename T>
+    class Scratch {
+    public:
+        Scratch() : depth(level()++) {
+            if(depth == stack().size()) {
+                stack().emplace_back();
+            }
+        }
+
+        ~Scratch() { --level(); }
+
+        T& get() { return stack()[depth]; }
+
+    private:
+        Scratch(const Scratch&) = delete;
+        Scratch& operator=(const Scratch&) = delete;
+
+        static std::deque<T>& stack() {
+            thread_local std::deque<T> objects;
+            return objects;
+        }
+
+        static std::size_t& level() {
+            thread_local std::size_t depth = 0;
+            return depth;
+        }
+
+        const std::size_t depth;
+    };
+
+    /**
+     * @brief Adapts a StreamObserver to the LineObserver interface.
+     * 
+     * Each line is copied into a reused std::string, so existing observers keep working
+     * at the cost of the copy that LineObserver avoids.
+     */
+    class StreamObserverAdapter final : public LineObserver {
+    public:
+        explicit StreamObserverAdapter(StreamObserver* observer) : observer(observer) {}
+
+        void update(std::string_view line) override {
+            // Per thread and depth so that Inline dispatch mode can call the adapter from several writers
+            Scratch<std::string> copy;
+            copy.get().assign(line.data(), line.size());
+            observer->update(copy.get());
+        }
+
+        StreamObserver* const observer;
+    };
+}
+
 /**
  * @struct StreamRedirect::StreamRedirectPimpl
  * @brief Private implementation (Pimpl) for the StreamRedirect class.
@@ -54,30 +121,56 @@ LIB_CREDIRECT_NAMESPACE_BEGIN
  * - `oldStreamBuf`: Pointer to the original stream buffer, used for restoration.
  * - `originalStream`: Reference to the original std::ostream that is being redirected.
  * - `running`: Atomic flag indicating whether the redirection is active.
- * - `monitorThread`: Thread used for monitoring the redirected stream.
- * - `observers`: List of observers that receive notifications about stream updates.
- * - `mtx`: Mutex used for synchronizing access to observers.
+ * - `monitorThread`: Thread used for monitoring the redirected stream (Thread dispatch mode).
+ * - `dispatcher`, `task`: Shared pool and work item that replace the monitor thread (Shared dispatch mode).
+ * - `lines`, `scanned`: Line views of the current batch and the length of the trailing partial line already scanned.
+ * - `sequence`: Sequence number of the next line, counted for every line whether or not anybody wants its metadata.
+ * - `observers`: Immutable snapshot of the observers that receive notifications about stream updates.
+ * - `adapters`: Adapters owned on behalf of attached StreamObserver instances.
+ * - `recorder`: Ring of recent lines dumped on a crash, attached before any other observer.
+ * - `mtx`: Mutex serializing attach and detach, never taken by notify.
  * 
  * @note This structure is intended for internal use within the StreamRedirect class
  * and should not be accessed directly by external code.
  */
 struct HIDDEN StreamRedirect::StreamRedirectPimpl {
-    StreamRedirectPimpl(std::ostream& origStream, std::streamsize initial_size = 1024) :
-        streamBuf(initial_size), 
+    StreamRedirectPimpl(std::ostream& origStream, const RedirectOptions& options) :
+        streamBuf(options), 
         stream(&streamBuf), 
         oldStreamBuf(nullptr),
         originalStream(origStream),
-        running(false) {}
-    
-    ~StreamRedirectPimpl() {}
+        running(false),
+        dispatch(options.dispatch),
+        delay(options.wakeupDelay),
+        scanned(0),
+        sequence(0) {}
+
+    /**
+     * @brief Immutable list of observers, replaced as a whole on every change.
+     */
+    struct ObserverList {
+        std::vector<LineObserver*> observers;
+        std::vector<MetadataObserver*> metadataObservers;
+    };
 
     SynchronousStreamBuf streamBuf;
     std::ostream stream;
     std::streambuf* oldStreamBuf;
     std::ostream& originalStream;
     std::atomic<bool> running;
+    const DispatchMode dispatch;
+    const std::chrono::microseconds delay;
     std::thread monitorThread;
-    std::vector<StreamObserver*> observers;
+    std::shared_ptr<Dispatcher> dispatcher;
+    std::unique_ptr<Dispatcher::Task> task;
+    std::vector<std::string_view> lines;
+    std::size_t scanned;
+    std::atomic<std::uint64_t> sequence;
+    Snapshot<ObserverList> observers;
+    std::vector<std::unique_ptr<StreamObserverAdapter>> adapters;
+#ifdef LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+    std::unique_ptr<FlightRecorder> recorder;
+#endif
     std::mutex mtx;
 };
 
@@ -85,18 +178,52 @@ struct HIDDEN StreamRedirect::StreamRedirectPimpl {
  * @brief Constructor for the StreamRedirect class.
  * 
  * This constructor initializes the StreamRedirect instance, setting up the custom stream buffer
- * and redirecting a std::ostream to it. It also starts a monitoring thread to process output from the stream.
+ * and redirecting a std::ostream to it. It also starts a monitoring thread to process output from the stream,
+ * or, in Shared dispatch mode, registers the stream with the shared dispatcher pool instead. In Inline
+ * dispatch mode no thread is involved, lines are delivered by the writing thread.
+ * 
+ * @param stream The std::ostream to redirect.
+ * @param options Buffer engine, sizes and dispatch mode used for the custom stream buffer.
+ * @param name Name of the stream in flight recorder dumps.
  */
-StreamRedirect::StreamRedirect(std::ostream& stream) { 
+StreamRedirect::StreamRedirect(std::ostream& stream, const RedirectOptions& options, const std::string& name) { 
     //struct StreamRedirect::StreamRedirectPimpl* d;
-    d = new StreamRedirectPimpl(stream);
+    d = new StreamRedirectPimpl(stream, options);
+
+#ifdef LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+    if(options.flightRecorderSize > 0) {
+        // First in the observer list, so a line is recorded even if an observer crashes on it
+        d->recorder = std::make_unique<FlightRecorder>(name, options.flightRecorderSize);
+        attach(d->recorder.get());
+    }
+#else
+    (void)name;
+#endif
+
+    if(d->dispatch == DispatchMode::Inline) {
+        d->streamBuf.setLineSink([this](const std::string_view* lines, std::size_t count) { notify(lines, count, nullptr); });
+    } else if(d->dispatch == DispatchMode::Shared) {
+        d->dispatcher = Dispatcher::shared(options.dispatcherThreads);
+        d->task = std::make_unique<Dispatcher::Task>([this] { dispatchStream(); });
+        d->streamBuf.setNotifier(
+            [dispatcher = d->dispatcher.get(), task = d->task.get(), delay = d->delay](bool wake) {
+                if(wake) {
+                    dispatcher->schedule(task);
+                } else {
+                    dispatcher->schedule(task, delay);
+                }
+            }
+        );
+    }
     
     // Redirect std::ostream to the custom stream buffer
     d->oldStreamBuf = stream.rdbuf(d->stream.rdbuf());
 
     // Start the monitoring thread
     d->running = true;
-    d->monitorThread = std::thread(&StreamRedirect::monitorStream, this);        
+    if(d->dispatch == DispatchMode::Thread) {
+        d->monitorThread = std::thread(&StreamRedirect::monitorStream, this);
+    }
 }
 
 /**
@@ -108,15 +235,28 @@ StreamRedirect::StreamRedirect(std::ostream& stream) {
 StreamRedirect::~StreamRedirect() {
     // Ensure that the static instance is cleaned up only once
     if(d) {
+        // Restore std::Stream to its original stream buffer first so that
+        // anything written from here on is not lost, then let the monitor
+        // thread drain what is already buffered before it stops.
+        d->originalStream.rdbuf(d->oldStreamBuf);
+        d->streamBuf.pubsync();
+
         d->running = false;
         d->streamBuf.terminate();
         if(d->monitorThread.joinable()) {
             d->monitorThread.join();
         }
-        
-        std::lock_guard<std::mutex> lock(d->mtx);
-        // Restore std::Stream to its original stream buffer
-        d->originalStream.rdbuf(d->oldStreamBuf);
+
+        if(d->task) {
+            // Take the stream out of the pool, then drain it on this thread
+            const char* data = nullptr;
+            std::size_t size = 0;
+            d->dispatcher->remove(d->task.get());
+            while(d->streamBuf.poll(data, size)) {
+                deliver(data, size);
+            }
+            deliverLast(data, size);
+        }
 
         delete d;
         d = nullptr;
@@ -127,22 +267,73 @@ StreamRedirect::~StreamRedirect() {
  * @brief Monitors the redirected stream and notifies observers of new lines.
  * 
  * This method continuously reads from the custom stream buffer and notifies
- * all attached observers whenever a new line is read. It runs in a separate thread
- * to avoid blocking the main application flow.
+ * all attached observers whenever new lines are read. It runs in a separate thread
+ * to avoid blocking the main application flow. The loop ends once the stream buffer
+ * has been terminated and everything written before that has been delivered; a trailing
+ * line without a newline is delivered last.
  */
 void HIDDEN StreamRedirect::monitorStream() {
-    std::istream instream(&d->streamBuf);
-    std::string line;
-    
-    while(d->running) {
-        while (std::getline(instream, line)) {
-            // Process the line read from the stream
-            notify(line);
-            if(instream.eof()) {
-                break;
-            }
-        }
+#ifdef LIB_CREDIRECT_ENABLE_FLIGHT_RECORDER
+    FlightRecorder::installAlternateStack();
+#endif
+    const char* data = nullptr;
+    std::size_t size = 0;
+
+    while (d->streamBuf.read(data, size)) {
+        deliver(data, size);
+    }
+    deliverLast(data, size);
+}
+
+/**
+ * @brief Delivers whatever the redirected stream holds without blocking.
+ * 
+ * This is the task run by the shared dispatcher pool in Shared dispatch mode. The pool
+ * never runs it on two threads at once, so lines are delivered in order.
+ */
+void HIDDEN StreamRedirect::dispatchStream() {
+    const char* data = nullptr;
+    std::size_t size = 0;
+
+    while (d->streamBuf.poll(data, size)) {
+        deliver(data, size);
+    }
+}
+
+/**
+ * @brief Notifies observers of the complete lines in a view of unconsumed data.
+ * 
+ * The whole view is scanned with the vectorized LineSplitter and the lines are handed out
+ * as views into the stream buffer, one batch per call. The buffer space is released once
+ * every observer has seen them, the trailing partial line stays for the next call.
+ * 
+ * @param data First unconsumed byte.
+ * @param size Number of unconsumed bytes.
+ */
+void HIDDEN StreamRedirect::deliver(const char* data, std::size_t size) {
+    d->lines.clear();
+    std::size_t complete = LineSplitter::split(data, size, d->scanned, d->lines);
+
+    if(!d->lines.empty()) {
+        notify(d->lines.data(), d->lines.size(), data);
+    }
+    d->streamBuf.consume(complete);
+    d->scanned = size - complete;
+}
+
+/**
+ * @brief Delivers a final line that was not terminated by a newline.
+ * 
+ * @param data First unconsumed byte.
+ * @param size Number of unconsumed bytes, nothing is delivered if zero.
+ */
+void HIDDEN StreamRedirect::deliverLast(const char* data, std::size_t size) {
+    if(size > 0) {
+        std::string_view last(data, size);
+        notify(&last, 1, data);
+        d->streamBuf.consume(size);
     }
+    d->scanned = 0;
 }
 
 /**
@@ -150,6 +341,7 @@ void HIDDEN StreamRedirect::monitorStream() {
  * 
  * This method allows an observer to be attached to the StreamRedirect instance,
  * enabling it to receive notifications about new lines written to std::ostream.
+ * The observer is wrapped in an adapter that copies each line into a std::string.
  * 
  * @param observer Pointer to the StreamObserver instance to attach.
  */
@@ -157,11 +349,14 @@ void StreamRedirect::attach(StreamObserver* observer) {
     if(!observer) 
         return;
     
-    // Only this section of code requires a lock guard
-    {
-        std::lock_guard<std::mutex> lock(d->mtx);
-        d->observers.push_back(observer);
-    }
+    auto adapter = std::make_unique<StreamObserverAdapter>(observer);
+
+    std::lock_guard<std::mutex> lock(d->mtx);
+    StreamRedirectPimpl::ObserverList list = d->observers.get();
+    list.observers.push_back(adapter.get());
+    d->adapters.push_back(std::move(adapter));
+    d->observers.replace(std::move(list));
+    d->observers.reclaim();
 }
 
 /**
@@ -169,6 +364,8 @@ void StreamRedirect::attach(StreamObserver* observer) {
  * 
  * This method allows an observer to be detached from the StreamRedirect instance,
  * stopping it from receiving further notifications about new lines written to std::ostream.
+ * When it returns the observer is no longer being called and may be destroyed, so it
+ * must not be called from within an observer.
  * 
  * @param observer Pointer to the StreamObserver instance to detach.
  */
@@ -176,13 +373,106 @@ void StreamRedirect::detach(StreamObserver* observer) {
     if(!observer)
         return;
     
-    {
-        std::lock_guard<std::mutex> lock(d->mtx);
-        d->observers.erase(
-            std::remove(d->observers.begin(), d->observers.end(), observer), 
-            d->observers.end()
-        );
+    std::lock_guard<std::mutex> lock(d->mtx);
+    StreamRedirectPimpl::ObserverList list = d->observers.get();
+    auto detached = std::stable_partition(d->adapters.begin(), d->adapters.end(),
+        [observer](const std::unique_ptr<StreamObserverAdapter>& adapter) {
+            return adapter->observer != observer;
+        });
+    for(auto it = detached; it != d->adapters.end(); ++it) {
+        list.observers.erase(std::remove(list.observers.begin(), list.observers.end(), it->get()), list.observers.end());
     }
+
+    d->observers.replace(std::move(list));
+    d->observers.synchronize();
+    d->adapters.erase(detached, d->adapters.end());
+}
+
+/**
+ * @brief Attaches a zero-copy observer to the StreamRedirect instance.
+ * 
+ * The observer receives views into the stream buffer, one batch per wakeup of the
+ * monitor thread. Attaching copies the observer list and never waits for a
+ * notification in progress.
+ * 
+ * @param observer Pointer to the LineObserver instance to attach.
+ */
+void StreamRedirect::attach(LineObserver* observer) {
+    if(!observer) 
+        return;
+    
+    std::lock_guard<std::mutex> lock(d->mtx);
+    StreamRedirectPimpl::ObserverList list = d->observers.get();
+    list.observers.push_back(observer);
+    d->observers.replace(std::move(list));
+    d->observers.reclaim();
+}
+
+/**
+ * @brief Detaches a zero-copy observer from the StreamRedirect instance.
+ * 
+ * When it returns the observer is no longer being called and may be destroyed, so it
+ * must not be called from within an observer.
+ * 
+ * @param observer Pointer to the LineObserver instance to detach.
+ */
+void StreamRedirect::detach(LineObserver* observer) {
+    if(!observer)
+        return;
+    
+    std::lock_guard<std::mutex> lock(d->mtx);
+    StreamRedirectPimpl::ObserverList list = d->observers.get();
+    list.observers.erase(std::remove(list.observers.begin(), list.observers.end(), observer), list.observers.end());
+    d->observers.replace(std::move(list));
+    d->observers.synchronize();
+}
+
+/**
+ * @brief Attaches an observer that receives the capture time and sequence number of every line.
+ * 
+ * Like a LineObserver it receives views into the stream buffer, one batch per wakeup of
+ * the monitor thread. The metadata is only looked up while such an observer is attached.
+ * 
+ * @param observer Pointer to the MetadataObserver instance to attach.
+ */
+void StreamRedirect::attach(MetadataObserver* observer) {
+    if(!observer) 
+        return;
+    
+    std::lock_guard<std::mutex> lock(d->mtx);
+    StreamRedirectPimpl::ObserverList list = d->observers.get();
+    list.metadataObservers.push_back(observer);
+    d->observers.replace(std::move(list));
+    d->observers.reclaim();
+}
+
+/**
+ * @brief Detaches an observer that receives line metadata.
+ * 
+ * When it returns the observer is no longer being called and may be destroyed, so it
+ * must not be called from within an observer.
+ * 
+ * @param observer Pointer to the MetadataObserver instance to detach.
+ */
+void StreamRedirect::detach(MetadataObserver* observer) {
+    if(!observer)
+        return;
+    
+    std::lock_guard<std::mutex> lock(d->mtx);
+    StreamRedirectPimpl::ObserverList list = d->observers.get();
+    list.metadataObservers.erase(std::remove(list.metadataObservers.begin(), list.metadataObservers.end(), observer), 
+                                 list.metadataObservers.end());
+    d->observers.replace(std::move(list));
+    d->observers.synchronize();
+}
+
+/**
+ * @brief Returns the data dropped by the overflow policy and the size of the stream buffer.
+ * 
+ * @return Counters of the redirected stream.
+ */
+RedirectStats StreamRedirect::stats() const {
+    return d->streamBuf.stats();
 }
 
 /**
@@ -195,9 +485,70 @@ void StreamRedirect::detach(StreamObserver* observer) {
  * @param message The message to notify observers with.
  */
 void StreamRedirect::notify(const std::string& message) {
-    std::lock_guard<std::mutex> lock(d->mtx);
-    for(auto o : d->observers) {
-        o->update(message);
+    std::string_view line(message);
+    notify(&line, 1);
+}
+
+/**
+ * @brief Notifies all observers with a batch of lines.
+ * 
+ * Each observer receives the whole batch in a single updateBatch() call. The observer
+ * list is read from the current snapshot without taking any lock; registering with the
+ * reader counter of the current epoch keeps the snapshot alive until the call returns.
+ * Calls from different threads are not serialized. The monitor thread (or dispatcher pool)
+ * is the only caller, except in Inline dispatch mode where every writing thread calls it.
+ * 
+ * @param lines Pointer to the first line of the batch.
+ * @param count Number of lines in the batch.
+ */
+void StreamRedirect::notify(const std::string_view* lines, std::size_t count) {
+    notify(lines, count, nullptr);
+}
+
+/**
+ * @brief Notifies all observers with a batch of lines read from a view of the stream buffer.
+ * 
+ * The lines are numbered in the order they are delivered. When a MetadataObserver is
+ * attached, each line is given the time and global sequence number of the publish that
+ * completed it, looked up in the stamps of the stream buffer; lines that do not come
+ * from a view, as in Inline dispatch mode where they are delivered while being written,
+ * are given the current time and a sequence number drawn for the batch.
+ * 
+ * @param lines Pointer to the first line of the batch.
+ * @param count Number of lines in the batch.
+ * @param view Start of the view returned by the stream buffer that holds the lines, or nullptr.
+ */
+void HIDDEN StreamRedirect::notify(const std::string_view* lines, std::size_t count, const char* view) {
+    const std::uint64_t first = d->sequence.fetch_add(count, std::memory_order_relaxed);
+
+    const Snapshot<StreamRedirectPimpl::ObserverList>::Reader list(d->observers);
+    for(auto o : list->observers) {
+        o->updateBatch(lines, count);
+    }
+
+    if(!list->metadataObservers.empty()) {
+        // Per thread and depth so that Inline dispatch mode can notify from several writers
+        Scratch<std::vector<LineMetadata>> scratch;
+        std::vector<LineMetadata>& metadata = scratch.get();
+        metadata.resize(count);
+
+        const CaptureClock::Conversion conversion = CaptureClock::conversion();
+        SynchronousStreamBuf::Capture capture{ 0, 0 };
+        if(!view) {
+            capture = SynchronousStreamBuf::Capture{ CaptureClock::now(), CaptureClock::nextSequence() };
+        }
+        for(std::size_t i = 0; i < count; ++i) {
+            if(view) {
+                capture = d->streamBuf.captured(static_cast<std::size_t>(lines[i].data() + lines[i].size() - view));
+            }
+            metadata[i].sequence = first + i;
+            metadata[i].globalSequence = capture.sequence;
+            metadata[i].captured = conversion.toTimePoint(capture.ticks);
+        }
+
+        for(auto o : list->metadataObservers) {
+            o->updateBatch(lines, metadata.data(), count);
+        }
     }
 }
 
@@ -18,11 +18,25 @@
  */
 #include <CRedirect_config.h>
 #include <SynchronousStreamBuf.hpp>
+#include <CaptureClock.hpp>
+#include <RingBuffer.hpp>
+#include <MirroredBuffer.hpp>
+#include <LineSplitter.hpp>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <cstring>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 LIB_CREDIRECT_NAMESPACE_BEGIN
@@ -34,40 +48,522 @@ LIB_CREDIRECT_NAMESPACE_BEGIN
  * It allows for thread-safe reading and writing operations, with support for termination and synchronization.
  */
 
+namespace {
+    constexpr unsigned kShrinkDrains = 8;  // drains at a quarter of the buffer or less before it is halved
+}
+
 /**
  * @struct SynchronousStreamBuf::SynchronousStreamBufPimpl
  * @brief Private implementation (Pimpl) for the SynchronousStreamBuf class.
  * 
  * This structure encapsulates the internal details of the SynchronousStreamBuf class,
  * providing a mechanism to manage the stream buffer, synchronization, and termination.
+ * 
+ * The Mutex engine uses `buffer` as a circular buffer addressed by three logical
+ * (never wrapping) positions, all protected by `mtx`:
+ * - `readPos`: everything before it has been read and its space can be reused.
+ * - `readEnd`: end of the range currently handed to the reader as the get area.
+ * - `publishedPos`: end of the data published by sync(), the put area starts here.
+ * Publishing and consuming only advance these positions, data is never moved.
+ * When the buffer grows the old storage is kept in `retired` until the reader
+ * is done with the get area that may still point into it.
+ * 
+ * `readerState` and `signaled` implement the wakeup policy: the reader sleeps without
+ * a timeout while there is nothing to read (Idle) and, once it has data that did not
+ * satisfy the policy, for at most `delay` while waiting for data that does (Coalescing).
+ * When a `notifier` is installed nobody waits on `cv`; the notifier is told about every
+ * publish instead, together with whether the policy asks for a wakeup.
+ * 
+ * The buffer grows up to `maxCapacity` (0 for no limit). Once it is full the overflow policy
+ * blocks the writer on `space` until the reader releases data, drops the new data, or drops
+ * the oldest complete lines the reader has not been handed yet. Publishing shrinks the buffer
+ * again once the reader has drained it `kShrinkDrains` times in a row without a quarter of its
+ * capacity having been in use in between, counted in `quietDrains` from `peakUsed`.
+ * 
+ * In Inline dispatch mode neither engine is used. Each writing thread appends to a
+ * ThreadState of its own, and complete lines are handed to `sink` on that thread.
+ * 
+ * With thread staging the put area stays empty for both engines. Each writing thread
+ * assembles its output in its ThreadState and only commits complete lines to the engine,
+ * in one copy per write, so writers share nothing but the engine itself.
+ * 
+ * The ThreadStates live in `table`, which the writing threads share with the stream buffer.
+ * A thread that exits hands over its partial line as a line of its own and erases its state,
+ * so states do not pile up with short lived threads. terminate() closes the table and takes
+ * the partial lines of the threads that are still running.
+ * 
+ * Every publish that holds a newline is stamped with the CaptureClock time, a global
+ * sequence number and the logical position where it ends. The Mutex engine keeps the
+ * stamps in `stamps` under `mtx` and hands them to the reader with the view, the LockFree
+ * engine reads them from the ring records. The reader keeps those covering its view in
+ * `readStamps`, a byte belongs to the first stamp that ends after it, so every line gets
+ * the stamp of the publish that completed it and sequence numbers are only spent on
+ * publishes that complete lines.
  */
 struct HIDDEN SynchronousStreamBuf::SynchronousStreamBufPimpl 
 {
-    SynchronousStreamBufPimpl() : terminated(false) {};
+    enum class ReaderState { Running, Idle, Coalescing };
+
+    /**
+     * @brief CaptureClock time and global sequence number of a publish, and the logical position where its data ends.
+     */
+    struct Stamp {
+        std::uint64_t end;
+        Capture capture;
+    };
+
+    /**
+     * @brief Partial line of one writing thread, and its delivery state in Inline dispatch mode.
+     */
+    struct ThreadState {
+        std::string pending;                    // written but not yet delivered or committed, ends with a partial line
+        std::string batch;                      // complete lines being delivered
+        std::vector<std::string_view> lines;
+        bool delivering = false;                // guards against writes made by an observer
+    };
+
+    /**
+     * @brief The states of the threads writing to one stream buffer, shared with those threads.
+     * 
+     * The threads keep the table alive, so that a thread that exits can hand over its partial
+     * line and erase its state while the stream buffer exists, and skip both once terminate()
+     * has closed the table.
+     */
+    struct StateTable {
+        std::mutex mtx;                             // guards the members below, held while a partial line is retired
+        std::atomic<bool> open{true};               // false once terminate() has taken the partial lines
+        std::list<ThreadState> states;
+        std::function<void(std::string&)> retire;   // hands over the partial line of a thread that exits
+    };
+
+    /**
+     * @brief The states of the calling thread, one per stream buffer it wrote to, retired when it exits.
+     */
+    struct ThreadStates {
+        struct Entry {
+            std::uint64_t id;
+            std::shared_ptr<StateTable> table;
+            std::list<ThreadState>::iterator state;
+        };
+
+        ~ThreadStates() {
+            for(Entry& entry : entries) {
+                StateTable& table = *entry.table;
+                std::lock_guard<std::mutex> lock(table.mtx);
+                if(!table.open) {
+                    continue;
+                }
+                // Writes made by an observer while the line is retired are only appended
+                entry.state->delivering = true;
+                std::string partial = std::move(entry.state->pending);
+                if(!partial.empty()) {
+                    table.retire(partial);
+                }
+                table.states.erase(entry.state);
+            }
+        }
+
+        std::vector<Entry> entries;
+        std::uint64_t cachedId = 0;
+        ThreadState* cached = nullptr;
+    };
+
+    SynchronousStreamBufPimpl(const RedirectOptions& options) : 
+        engine(options.engine), 
+        inlineMode(options.dispatch == DispatchMode::Inline),
+        staging(options.threadStaging && !inlineMode),
+        stateId(nextStateId++),
+        wakeup(options.wakeup),
+        highWaterMark(options.wakeupHighWaterMark),
+        delay(options.wakeupDelay),
+        overflow(options.overflow),
+        blockTimeout(options.blockTimeout),
+        terminated(false), 
+        readerState(ReaderState::Running),
+        signaled(false),
+        initialCapacity(0),
+        maxCapacity(0),
+        peakUsed(0),
+        quietDrains(0),
+        writersWaiting(0),
+        droppedBytes(0),
+        droppedLines(0),
+        readPos(0), 
+        readEnd(0), 
+        publishedPos(0) {};
     ~SynchronousStreamBufPimpl() {};
 
+    /**
+     * @brief Waits until data past `seen` is published or the buffer is terminated, called with `mtx` held.
+     * 
+     * The reader sleeps without a timeout while there is nothing new, then for at most the
+     * coalescing delay if what arrived did not satisfy the wakeup policy.
+     */
+    void waitForData(std::unique_lock<std::mutex>& lock, std::uint64_t seen) {
+        if (publishedPos == seen && !terminated) {
+            readerState = ReaderState::Idle;
+            cv.wait(lock, [this, seen] { return publishedPos != seen || terminated; });
+        }
+
+        if (wakeup != WakeupPolicy::EveryWrite && !signaled && !terminated) {
+            // Give the writers up to the coalescing delay to complete what they started
+            readerState = ReaderState::Coalescing;
+            cv.wait_for(lock, delay, [this] { return signaled || terminated; });
+        }
+        readerState = ReaderState::Running;
+        signaled = false;
+    }
+
+    /**
+     * @brief Applies the wakeup policy to freshly published data, called with `mtx` held.
+     */
+    void signal(const char* data, std::size_t size) {
+        bool wake = wakeup == WakeupPolicy::EveryWrite ||
+            (wakeup == WakeupPolicy::Newline && std::memchr(data, '\n', size) != nullptr) ||
+            publishedPos - readPos >= highWaterMark;
+        if(notifier) {
+            notifier(wake);
+            return;
+        }
+        if(wake) {
+            signaled = true;
+        }
+        if(readerState == ReaderState::Idle || (wake && readerState == ReaderState::Coalescing)) {
+            cv.notify_all();
+        }
+    }
+
+    /**
+     * @brief Wakes the reader whatever the wakeup policy, called with `mtx` held by a writer about to block.
+     */
+    void wakeReader() {
+        if(notifier) {
+            notifier(true);
+            return;
+        }
+        signaled = true;
+        cv.notify_all();
+    }
+
+    /**
+     * @brief Lets writers blocked on a full buffer retry, called with `mtx` held after the reader released data.
+     */
+    void releaseSpace() {
+        if(writersWaiting > 0) {
+            space.notify_all();
+        }
+        if(readPos == publishedPos) {
+            quietDrains = peakUsed <= buffer.capacity() / 4 ? quietDrains + 1 : 0;
+            peakUsed = 0;
+        }
+    }
+
+    /**
+     * @brief Returns how much of a write must fit at once, all of it unless it exceeds half of the buffer limit.
+     */
+    std::size_t wholeSize(std::size_t size) const {
+        return maxCapacity == 0 || size <= maxCapacity / 2 ? size : 1;
+    }
+
+    /**
+     * @brief Counts data discarded by the overflow policy, called with `mtx` held.
+     */
+    void drop(const char* data, std::size_t size) {
+        droppedBytes += size;
+        droppedLines += static_cast<std::uint64_t>(std::count(data, data + size, '\n'));
+    }
+
+    /**
+     * @brief Stamps the data published since the last stamp if it completes a line, called with `mtx` held.
+     */
+    void stamp(bool newline) {
+        if(newline && publishedPos > (stamps.empty() ? readEnd : stamps.back().end)) {
+            stamps.push_back(Stamp{ publishedPos, Capture{ CaptureClock::now(), CaptureClock::nextSequence() } });
+        }
+    }
+
+    /**
+     * @brief Forgets the stamps of the data before `position`, reader side.
+     */
+    void releaseStamps(std::uint64_t position) {
+        while(stampHead < readStamps.size() && readStamps[stampHead].end <= position) {
+            ++stampHead;
+        }
+        if(stampHead == readStamps.size() || (stampHead >= 64 && stampHead * 2 >= readStamps.size())) {
+            readStamps.erase(readStamps.begin(), readStamps.begin() + static_cast<std::ptrdiff_t>(stampHead));
+            stampHead = 0;
+        }
+    }
+
+    /**
+     * @brief Returns the position of the first newline in [from, to) of the circular buffer, or `to`.
+     */
+    std::uint64_t findNewline(std::uint64_t from, std::uint64_t to) const {
+        while(from < to) {
+            std::size_t span = buffer.contiguous(from, static_cast<std::size_t>(to - from));
+            const char* start = buffer.at(from);
+            const char* newline = static_cast<const char*>(std::memchr(start, '\n', span));
+            if(newline) {
+                return from + static_cast<std::uint64_t>(newline - start);
+            }
+            from += span;
+        }
+        return to;
+    }
+
+    /**
+     * @brief Moves `size` bytes of the circular buffer from `from` down to `to`, `to` being before `from`.
+     */
+    void moveDown(std::uint64_t to, std::uint64_t from, std::size_t size) {
+        while(size > 0) {
+            std::size_t span = std::min(buffer.contiguous(to, size), buffer.contiguous(from, size));
+            std::memmove(buffer.at(to), buffer.at(from), span);
+            to += span;
+            from += span;
+            size -= span;
+        }
+    }
+
+    /**
+     * @brief Returns the ThreadState of the calling thread, creating it on first use.
+     * 
+     * The states are kept in `table` so that terminate() can deliver or commit the partial lines
+     * of every thread, and each thread retires its own when it exits. A thread finds its state
+     * through a thread local list keyed by `stateId`, which is never reused, and forgets the
+     * tables of terminated stream buffers when it adds one.
+     */
+    ThreadState& threadState() {
+        thread_local ThreadStates owned;
+
+        if(owned.cachedId != stateId) {
+            auto it = std::find_if(owned.entries.begin(), owned.entries.end(),
+                [this](const ThreadStates::Entry& entry) { return entry.id == stateId; });
+            if(it == owned.entries.end()) {
+                owned.entries.erase(std::remove_if(owned.entries.begin(), owned.entries.end(),
+                    [](const ThreadStates::Entry& entry) { return !entry.table->open; }), owned.entries.end());
+
+                std::lock_guard<std::mutex> lock(table->mtx);
+                table->states.emplace_back();
+                it = owned.entries.insert(owned.entries.end(), ThreadStates::Entry{ stateId, table, std::prev(table->states.end()) });
+            }
+            owned.cachedId = stateId;
+            owned.cached = &*it->state;
+        }
+        return *owned.cached;
+    }
+
+    /**
+     * @brief Closes `table` and takes the partial lines of every thread, for terminate().
+     */
+    std::vector<std::string> closeStates() {
+        std::vector<std::string> partials;
+        std::lock_guard<std::mutex> lock(table->mtx);
+        table->open = false;
+        for(ThreadState& state : table->states) {
+            if(!state.pending.empty()) {
+                partials.push_back(std::move(state.pending));
+                state.pending.clear();
+            }
+        }
+        return partials;
+    }
+
+    /**
+     * @brief Delivers what is left of a thread's output in Inline dispatch mode, a partial line as a line of its own.
+     */
+    void deliverRemaining(const std::string& pending) {
+        std::vector<std::string_view> lines;
+        std::size_t complete = LineSplitter::split(pending.data(), pending.size(), 0, lines);
+        if(complete < pending.size()) {
+            lines.emplace_back(pending.data() + complete, pending.size() - complete);
+        }
+        sink(lines.data(), lines.size());
+    }
+
+    /**
+     * @brief Appends data written by the calling thread and delivers its complete lines on that thread.
+     * 
+     * Writes made by an observer while lines are delivered are only appended, the delivery loop
+     * picks them up once the observers have returned.
+     */
+    void writeInline(const char* data, std::size_t size) {
+        ThreadState& state = threadState();
+        state.pending.append(data, size);
+        if(state.delivering || std::memchr(data, '\n', size) == nullptr) {
+            return;
+        }
+
+        struct DeliveryGuard {
+            bool& delivering;
+            ~DeliveryGuard() { delivering = false; }
+        } guard{ state.delivering };
+        state.delivering = true;
+
+        for(std::size_t end = state.pending.rfind('\n'); end != std::string::npos; end = state.pending.rfind('\n')) {
+            std::swap(state.pending, state.batch);
+            state.pending.assign(state.batch, end + 1, std::string::npos);
+            state.lines.clear();
+            LineSplitter::split(state.batch.data(), end + 1, 0, state.lines);
+            sink(state.lines.data(), state.lines.size());
+        }
+    }
+
+    /**
+     * @brief Sets `data` and `size` to the unconsumed range and marks it as handed out, called with `mtx` held.
+     */
+    void view(const char*& data, std::size_t& size) {
+        readEnd = publishedPos;
+        size = static_cast<std::size_t>(readEnd - readPos);
+        viewStart = readPos;
+        readStamps.insert(readStamps.end(), stamps.begin(), stamps.end());
+        stamps.clear();
+
+        if(buffer.contiguous(readPos, size) == size) {
+            data = buffer.at(readPos);
+        } else {
+            // Unmirrored buffer wrapped, stitch the two halves together once
+            std::size_t first = buffer.contiguous(readPos, size);
+            scratch.resize(size);
+            std::memcpy(scratch.data(), buffer.at(readPos), first);
+            std::memcpy(scratch.data() + first, buffer.at(readPos + first), size - first);
+            data = scratch.data();
+        }
+    }
+
+    /**
+     * @brief Drops the consumed prefix of `readBuffer`, LockFree engine only.
+     */
+    void compactReadBuffer() {
+        if(readOffset > 0) {
+            readBuffer.erase(readBuffer.begin(), readBuffer.begin() + readOffset);
+            readBase += readOffset;
+            readOffset = 0;
+        }
+        viewStart = readBase;
+    }
+
+    /**
+     * @brief Appends every committed record of the ring to `readBuffer` and keeps its stamp, LockFree engine only.
+     */
+    void drainRing() {
+        ring->consume([this](const char* record, std::size_t length, std::uint64_t ticks, std::uint64_t sequence) {
+            readBuffer.insert(readBuffer.end(), record, record + length);
+            if(sequence != 0) {
+                readStamps.push_back(Stamp{ readBase + readBuffer.size(), Capture{ ticks, sequence } });
+            }
+        });
+    }
+
+    static std::atomic<std::uint64_t> nextStateId;
+
+    const BufferEngine engine;
+    const bool inlineMode;
+    const bool staging;
+    const std::uint64_t stateId;
+    std::shared_ptr<StateTable> table = std::make_shared<StateTable>();
+    std::function<void(const std::string_view*, std::size_t)> sink;
+    const WakeupPolicy wakeup;
+    const std::size_t highWaterMark;
+    const std::chrono::microseconds delay;
+    const OverflowPolicy overflow;
+    const std::chrono::milliseconds blockTimeout;
+    std::function<void(bool)> notifier;
     std::mutex mtx;
     //std::recursive_mutex mtx;
     std::condition_variable cv;
-    std::vector<char> buffer;
     std::atomic<bool> terminated;
+
+    // Mutex engine only
+    ReaderState readerState;
+    bool signaled;
+    std::size_t initialCapacity;
+    std::size_t maxCapacity;
+    std::size_t peakUsed;
+    unsigned quietDrains;
+    std::condition_variable space;
+    int writersWaiting;
+    std::uint64_t droppedBytes;
+    std::uint64_t droppedLines;
+    MirroredBuffer buffer;
+    std::vector<MirroredBuffer> retired;
+    std::uint64_t readPos;
+    std::uint64_t readEnd;
+    std::uint64_t publishedPos;
+    std::vector<char> scratch;
+    std::deque<Stamp> stamps;
+
+    // LockFree engine only: the ring shared with the producers and the
+    // consumer side buffer that backs the get area and the views returned
+    // by read(), of which the first `readOffset` bytes have been consumed.
+    std::unique_ptr<RingBuffer> ring;
+    std::vector<char> readBuffer;
+    std::size_t readOffset = 0;
+    std::uint64_t readBase = 0;
+
+    // Reader side: stamps of the current view, of which the first `stampHead` are
+    // no longer needed, and the logical position of the first byte of the view.
+    std::vector<Stamp> readStamps;
+    std::size_t stampHead = 0;
+    std::uint64_t viewStart = 0;
 };
 
+std::atomic<std::uint64_t> SynchronousStreamBuf::SynchronousStreamBufPimpl::nextStateId{1};
+
 /**
  * @brief Constructor for the SynchronousStreamBuf class.
  * 
  * This constructor initializes the SynchronousStreamBuf instance with a specified initial buffer size.
  * It sets up the internal buffer and initializes the stream pointers.
  * 
- * @param initial_size The initial size of the buffer (default is 1024 bytes).
+ * @param options Buffer engine and sizes (defaults are taken from the CMake configuration).
  */
-SynchronousStreamBuf::SynchronousStreamBuf(std::streamsize initial_size) 
+
+SynchronousStreamBuf::SynchronousStreamBuf(const RedirectOptions& options) 
 {
-    d = new SynchronousStreamBufPimpl();
+    d = new SynchronousStreamBufPimpl(options);
+    d->table->retire = [this](std::string& partial) {
+        if(d->inlineMode) {
+            d->deliverRemaining(partial);
+        } else {
+            // Terminated so that the next line committed does not continue it
+            partial += '\n';
+            commit(partial.data(), partial.size());
+        }
+    };
 
-    d->buffer.resize(initial_size);
+    if(d->inlineMode) {
+        // No shared put area, every write goes through xsputn/overflow to the writing thread's state
+        setp(nullptr, nullptr);
+        setg(nullptr, nullptr, nullptr);
+        return;
+    }
 
-    setp(d->buffer.data(), d->buffer.data() + d->buffer.size() - 1);
+    if(d->engine == BufferEngine::LockFree) {
+        // No shared put area, every write goes through xsputn/overflow into the ring
+        d->ring.reset(new RingBuffer(options.ringBufferSize, options.wakeup, 
+                                     options.wakeupHighWaterMark, options.wakeupDelay));
+        d->ring->setOverflow(options.overflow, options.blockTimeout);
+        setp(nullptr, nullptr);
+        setg(nullptr, nullptr, nullptr);
+        return;
+    }
+
+    d->buffer = MirroredBuffer(static_cast<std::size_t>(options.initialBufferSize));
+    d->initialCapacity = d->buffer.capacity();
+    if(options.maxBufferSize > 0) {
+        // Capacities are powers of two, so the limit is the largest one that fits (but at least the initial one)
+        d->maxCapacity = d->initialCapacity;
+        while(d->maxCapacity * 2 <= options.maxBufferSize) {
+            d->maxCapacity *= 2;
+        }
+    }
+
+    if(d->staging) {
+        // Writers stage their lines per thread and copy them in under the mutex
+        setp(nullptr, nullptr);
+    } else {
+        resetPutArea();
+    }
     setg(d->buffer.data(), d->buffer.data(), d->buffer.data());
 }
 
@@ -93,9 +589,43 @@ SynchronousStreamBuf::~SynchronousStreamBuf()
  */
 void SynchronousStreamBuf::terminate() 
 {
+    if(d->inlineMode) {
+        // Deliver the partial lines the running threads left behind, without holding the locks
+        {
+            std::lock_guard<std::mutex> lock(d->mtx);
+            if(d->terminated.exchange(true)) {
+                return;
+            }
+        }
+        for(const std::string& partial : d->closeStates()) {
+            d->deliverRemaining(partial);
+        }
+        return;
+    }
+
+    if(d->staging) {
+        // Commit the partial lines the running threads left behind before the engine stops accepting
+        // data, separated so that each stays a line of its own
+        std::string partial;
+        for(const std::string& pending : d->closeStates()) {
+            partial += partial.empty() ? "" : "\n";
+            partial += pending;
+        }
+        if(!partial.empty()) {
+            commit(partial.data(), partial.size());
+        }
+    }
+
+    if(d->engine == BufferEngine::LockFree) {
+        d->terminated = true;
+        d->ring->terminate();
+        return;
+    }
+
     std::lock_guard<std::mutex> lock(d->mtx);
     d->terminated = true;
     d->cv.notify_all();
+    d->space.notify_all();
 }
 
 /**
@@ -103,30 +633,199 @@ void SynchronousStreamBuf::terminate()
  * 
  * This method is called when the stream buffer needs more data to read. It waits for data to be available
  * or for the stream to be terminated. If data is available, it returns the next character; otherwise, it returns EOF.
+ * Data that was published before the stream was terminated is still returned, so the reader can drain it.
+ * 
+ * With the LockFree engine all committed records are copied from the ring into a consumer side
+ * buffer in one pass, which then backs the get area until it has been read.
  * 
  * @return The next character in the stream or EOF if the stream is terminated.
  */
 std::streambuf::int_type SynchronousStreamBuf::underflow() 
 {
+    if(d->engine == BufferEngine::LockFree) {
+        d->readBuffer.clear();
+        while(d->readBuffer.empty()) {
+            if(!d->ring->wait()) {
+                return traits_type::eof();
+            }
+            d->ring->consume([this](const char* data, std::size_t size, std::uint64_t, std::uint64_t) {
+                d->readBuffer.insert(d->readBuffer.end(), data, data + size);
+            });
+        }
+        setg(d->readBuffer.data(), d->readBuffer.data(), d->readBuffer.data() + d->readBuffer.size());
+        return traits_type::to_int_type(*gptr());
+    }
+
     std::unique_lock<std::mutex> lock(d->mtx);
-    if(d->terminated) {
+
+    // Release what has been read so far, the space can now be reused by the writers
+    d->readPos = d->readEnd - (egptr() - gptr());
+    d->readEnd = d->readPos;
+    d->retired.clear();
+    d->stamps.clear(); // stamps are only used by views returned by read() and poll()
+    d->releaseSpace();
+    d->waitForData(lock, d->readPos);
+
+    std::size_t available = d->buffer.contiguous(d->readPos, d->publishedPos - d->readPos);
+    char* start = d->buffer.at(d->readPos);
+    d->readEnd = d->readPos + available;
+    setg(start, start, start + available);
+
+    if (gptr() == egptr()) {
         return traits_type::eof();
     }
 
-    d->cv.wait(lock,
-        [this]
-        {
-            auto a = gptr();
-            auto b = egptr();
-            return (a != b) || d->terminated; 
+    return traits_type::to_int_type(*gptr());
+}
+
+/**
+ * @brief Returns a view of all unconsumed data, waiting until some of it is new.
+ * 
+ * With the Mutex engine the view points straight into the circular buffer; only when an
+ * unmirrored buffer wraps is the unconsumed data copied once into a scratch buffer.
+ * With the LockFree engine the committed records are appended to the consumer side buffer
+ * and the view covers that buffer.
+ * 
+ * @param data Set to the first unconsumed byte.
+ * @param size Set to the number of unconsumed bytes.
+ * @return true if the view holds data not returned before, false once the stream has been
+ *         terminated and nothing new will arrive (the view then holds what was left unconsumed).
+ */
+bool SynchronousStreamBuf::read(const char*& data, std::size_t& size)
+{
+    if(d->engine == BufferEngine::LockFree) {
+        d->compactReadBuffer();
+
+        const std::size_t before = d->readBuffer.size();
+        while(d->readBuffer.size() == before && d->ring->wait()) {
+            d->drainRing();
         }
-    );
 
-    if (d->terminated) {
-        return traits_type::eof();
+        data = d->readBuffer.data();
+        size = d->readBuffer.size();
+        return size != before;
     }
 
-    return traits_type::to_int_type(*gptr());
+    std::unique_lock<std::mutex> lock(d->mtx);
+    d->retired.clear();
+    d->waitForData(lock, d->readEnd);
+
+    const bool fresh = d->publishedPos != d->readEnd;
+    d->view(data, size);
+    return fresh;
+}
+
+/**
+ * @brief Returns a view of all unconsumed data without waiting.
+ * 
+ * Same as read(), for a reader that is scheduled by the notifier instead of blocking.
+ * 
+ * @param data Set to the first unconsumed byte.
+ * @param size Set to the number of unconsumed bytes.
+ * @return true if the view holds data not returned before.
+ */
+bool SynchronousStreamBuf::poll(const char*& data, std::size_t& size)
+{
+    if(d->engine == BufferEngine::LockFree) {
+        d->compactReadBuffer();
+
+        const std::size_t before = d->readBuffer.size();
+        if(d->ring->readable()) {
+            d->drainRing();
+        }
+
+        data = d->readBuffer.data();
+        size = d->readBuffer.size();
+        return size != before;
+    }
+
+    std::lock_guard<std::mutex> lock(d->mtx);
+    d->retired.clear();
+
+    const bool fresh = d->publishedPos != d->readEnd;
+    d->view(data, size);
+    return fresh;
+}
+
+/**
+ * @brief Installs the callback that receives complete lines in Inline dispatch mode.
+ * 
+ * The callback is called on the writing thread, from several threads at once if several
+ * threads write. Install it before anything is written.
+ * 
+ * @param sink Callback receiving a batch of lines, valid only during the call.
+ */
+void SynchronousStreamBuf::setLineSink(std::function<void(const std::string_view*, std::size_t)> sink)
+{
+    std::lock_guard<std::mutex> lock(d->mtx);
+    d->sink = std::move(sink);
+}
+
+/**
+ * @brief Installs a callback that replaces waking a blocked reader.
+ * 
+ * The notifier is called by the writers after every publish, with true when the wakeup
+ * policy asks for the reader to run now and false when the data may wait for the
+ * coalescing delay. It may be called with internal locks held and must not call back
+ * into the stream buffer. Install it before anything is written.
+ * 
+ * @param notifier Callback taking whether the reader should run immediately.
+ */
+void SynchronousStreamBuf::setNotifier(std::function<void(bool)> notifier)
+{
+    if(d->engine == BufferEngine::LockFree) {
+        d->ring->setNotifier(std::move(notifier));
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(d->mtx);
+    d->notifier = std::move(notifier);
+}
+
+/**
+ * @brief Releases the first bytes of the view returned by read().
+ * 
+ * @param size Number of bytes that have been processed and can be reused by the writers.
+ */
+void SynchronousStreamBuf::consume(std::size_t size)
+{
+    if(d->engine == BufferEngine::LockFree) {
+        d->readOffset += size;
+        d->releaseStamps(d->readBase + d->readOffset);
+        return;
+    }
+
+    std::uint64_t position;
+    {
+        std::lock_guard<std::mutex> lock(d->mtx);
+        d->readPos += size;
+        position = d->readPos;
+        d->releaseSpace();
+    }
+    d->releaseStamps(position);
+}
+
+/**
+ * @brief Returns when and in which order a byte of the view returned by read() or poll() was published.
+ * 
+ * The reader side stamps are sorted by position and searched with a binary search. Bytes after
+ * the last newline belong to the last stamp, so a final line without a newline can be looked
+ * up by the offset just past it.
+ * 
+ * @param offset Offset of the byte in the view.
+ * @return The stamp of the publish that completed the line holding the byte.
+ */
+SynchronousStreamBuf::Capture SynchronousStreamBuf::captured(std::size_t offset) const
+{
+    auto first = d->readStamps.begin() + static_cast<std::ptrdiff_t>(d->stampHead);
+    if(first == d->readStamps.end()) {
+        return Capture{ CaptureClock::now(), 0 };
+    }
+
+    const std::uint64_t position = d->viewStart + offset;
+    auto it = std::upper_bound(first, d->readStamps.end(), position,
+        [](std::uint64_t value, const SynchronousStreamBufPimpl::Stamp& stamp) { return value < stamp.end; });
+    return it != d->readStamps.end() ? it->capture : d->readStamps.back().capture;
 }
 
 /**
@@ -141,56 +840,485 @@ std::streambuf::int_type SynchronousStreamBuf::underflow()
  */
 std::streambuf::int_type SynchronousStreamBuf::overflow(int_type ch)
 {
+    if(d->inlineMode || d->staging) {
+        if (ch != traits_type::eof()) {
+            char_type c = traits_type::to_char_type(ch);
+            return xsputn(&c, 1) == 1 ? ch : traits_type::eof();
+        }
+        return sync() == 0 ? ch : traits_type::eof();
+    }
+
+    if(d->engine == BufferEngine::LockFree) {
+        if (ch != traits_type::eof()) {
+            char_type c = traits_type::to_char_type(ch);
+            return d->ring->write(&c, 1) == 1 ? ch : traits_type::eof();
+        }
+        return sync() == 0 ? ch : traits_type::eof();
+    }
+
     {
-        std::lock_guard<std::mutex> lock(d->mtx);
+        std::unique_lock<std::mutex> lock(d->mtx);
         if (ch != traits_type::eof()) {
-            if (pptr() == epptr()) {
-                // Buffer is full, resize it
-                std::streamsize old_size = d->buffer.size();
-                d->buffer.resize(old_size * 2);
-                setp(d->buffer.data(), d->buffer.data() + d->buffer.size() - 1);
-                pbump(old_size); // Move the put pointer to the correct position
+            // Publish what is pending, the put area then restarts with all free space
+            publish();
+            if (pptr() < epptr() || makeRoom(lock, 1, 1)) {
+                *pptr() = ch;
+                pbump(1);
+            } else if (!d->terminated) {
+                char_type c = traits_type::to_char_type(ch);
+                d->drop(&c, 1);
             }
-            *pptr() = ch;
-            pbump(1);
         }
     }
     return sync() == 0 ? ch : traits_type::eof();
 }
 
+/**
+ * @brief Writes a sequence of characters to the SynchronousStreamBuf instance.
+ * 
+ * With the LockFree engine the sequence is published to the ring without taking any lock.
+ * 
+ * With the Mutex engine a sequence that fits in the put area is copied directly, just like the
+ * default std::streambuf implementation. Otherwise the mutex is taken once: the pending data is
+ * published, the buffer is grown once if the free space is too small for the remainder, and the
+ * remainder is copied in at most two spans (two only when an unmirrored buffer wraps). Once the
+ * buffer has reached maxBufferSize the overflow policy decides whether the writer waits or the
+ * data is dropped, dropped data still counts as written.
+ * 
+ * @param s Pointer to the characters to write.
+ * @param count Number of characters to write.
+ * @return The number of characters written.
+ */
+std::streamsize SynchronousStreamBuf::xsputn(const char_type* s, std::streamsize count)
+{
+    if(count <= 0) {
+        return 0;
+    }
+
+    if(d->inlineMode) {
+        if(d->terminated) {
+            return 0;
+        }
+        d->writeInline(s, static_cast<std::size_t>(count));
+        return count;
+    }
+
+    if(d->staging) {
+        return d->terminated ? 0 : stage(s, count);
+    }
+
+    if(d->engine == BufferEngine::LockFree) {
+        return static_cast<std::streamsize>(d->ring->write(s, static_cast<std::size_t>(count)));
+    }
+
+    std::streamsize room = epptr() - pptr();
+    if(count <= room) {
+        traits_type::copy(pptr(), s, static_cast<std::size_t>(count));
+        pbump(static_cast<int>(count));
+        return count;
+    }
+
+    std::streamsize written = 0;
+    {
+        std::unique_lock<std::mutex> lock(d->mtx);
+        if(d->terminated) {
+            return 0;
+        }
+
+        // The first span is kept whole unless it is too large for the buffer limit
+        std::size_t needed = d->wholeSize(static_cast<std::size_t>(count));
+        while(written < count) {
+            room = epptr() - pptr();
+            if(room == 0 || static_cast<std::size_t>(room) < needed) {
+                publish();
+                if(!makeRoom(lock, static_cast<std::size_t>(count - written), needed)) {
+                    if(d->terminated) {
+                        return written;
+                    }
+                    // The overflow policy dropped the rest, which still counts as written
+                    d->drop(s + written, static_cast<std::size_t>(count - written));
+                    written = count;
+                    break;
+                }
+                room = epptr() - pptr();
+            }
+            needed = 1;
+
+            std::streamsize chunk = std::min(room, count - written);
+            traits_type::copy(pptr(), s + written, static_cast<std::size_t>(chunk));
+            pbump(static_cast<int>(chunk));
+            written += chunk;
+        }
+
+        // Hand the bulk of the write to the reader right away instead of waiting for a flush
+        publish();
+        d->signal(s, static_cast<std::size_t>(count));
+    }
+    return written;
+}
+
+/**
+ * @brief Reads a sequence of characters from the SynchronousStreamBuf instance.
+ * 
+ * The get area is copied span by span and underflow() is only called when it is exhausted,
+ * so a bulk read costs one copy per available span instead of one call per character.
+ * 
+ * @param s Pointer to the destination buffer.
+ * @param count Number of characters to read.
+ * @return The number of characters read, less than count only if the stream was terminated.
+ */
+std::streamsize SynchronousStreamBuf::xsgetn(char_type* s, std::streamsize count)
+{
+    std::streamsize read = 0;
+    while(read < count) {
+        std::streamsize available = egptr() - gptr();
+        if(available == 0) {
+            if(traits_type::eq_int_type(underflow(), traits_type::eof())) {
+                break;
+            }
+            available = egptr() - gptr();
+        }
+
+        std::streamsize chunk = std::min(available, count - read);
+        traits_type::copy(s + read, gptr(), static_cast<std::size_t>(chunk));
+        gbump(static_cast<int>(chunk));
+        read += chunk;
+    }
+    return read;
+}
+
 /**
  * @brief Synchronizes the SynchronousStreamBuf instance.
  * 
- * This method flushes the current contents of the stream buffer, moving any data from the get area to the put area.
- * It resizes the internal buffer if necessary and notifies any waiting threads that new data is available.
+ * This method publishes the current contents of the put area to the reader by advancing the published
+ * position of the circular buffer, without copying, and wakes the reader as the wakeup policy asks.
  * 
  * @return 0 on success, or -1 if the stream has been terminated.
  */
 int SynchronousStreamBuf::sync() 
 {
+    if(d->inlineMode || d->staging) {
+        // Complete lines were handed on when they were written, partial lines wait for their newline
+        return d->terminated ? -1 : 0;
+    }
+
+    if(d->engine == BufferEngine::LockFree) {
+        // Records are visible to the consumer as soon as they are committed
+        return d->terminated ? -1 : 0;
+    }
+
     std::lock_guard<std::mutex> lock(d->mtx);
     
     if(d->terminated) {
         return -1;
     }
 
-    if (pbase() != pptr()) {
-        std::streamsize psize = pptr() - pbase();
-        std::streamsize gsize = egptr() - gptr();
-        
-        if(d->buffer.size() < psize + gsize) {
-            d->buffer.resize(psize+gsize);
+    const char* pending = pbase();
+    std::size_t size = pptr() - pbase();
+    if (publish()) {
+        d->signal(pending, size); // Notify the reader according to the wakeup policy
+    }
+    return 0;
+}
+
+/**
+ * @brief Publishes the pending contents of the put area to the reader.
+ * 
+ * Publishing only advances the published position, the data stays where it was written.
+ * Must be called with the mutex held (Mutex engine only).
+ * 
+ * @return true if any data was published.
+ */
+bool SynchronousStreamBuf::publish()
+{
+    std::size_t pending = pptr() - pbase();
+    if (pending == 0) {
+        return false;
+    }
+    d->publishedPos += pending;
+    d->stamp(*d->buffer.at(d->publishedPos - 1) == '\n' || 
+             d->findNewline(d->publishedPos - pending, d->publishedPos) != d->publishedPos);
+    shrinkBuffer();
+    resetPutArea();
+    return true;
+}
+
+/**
+ * @brief Points the put area at the free space following the published data.
+ * 
+ * With a mirrored buffer the whole free space is contiguous, otherwise the put area
+ * stops at the end of the buffer and continues at its start after the next overflow.
+ * Must be called with the mutex held (Mutex engine only).
+ */
+void SynchronousStreamBuf::resetPutArea()
+{
+    if(d->staging) {
+        return;
+    }
+    std::size_t free = d->buffer.capacity() - static_cast<std::size_t>(d->publishedPos - d->readPos);
+    char* start = d->buffer.at(d->publishedPos);
+    setp(start, start + d->buffer.contiguous(d->publishedPos, free));
+}
+
+/**
+ * @brief Grows the circular buffer so that at least `minimum` bytes are free, or as far as the limit allows.
+ * 
+ * The unread data is copied once into a buffer of at least twice the size. The old
+ * storage is retired rather than released because the reader may still be using it.
+ * Must be called with the mutex held and with nothing pending in the put area.
+ * 
+ * @param minimum Number of bytes that should be free after growing.
+ * @return false if the buffer is already as large as it may get.
+ */
+bool SynchronousStreamBuf::growBuffer(std::size_t minimum)
+{
+    std::size_t used = static_cast<std::size_t>(d->publishedPos - d->readPos);
+    std::size_t capacity = d->buffer.capacity() * 2;
+    while (capacity < used + minimum) {
+        capacity *= 2;
+    }
+    if (d->maxCapacity > 0) {
+        capacity = std::min(capacity, d->maxCapacity);
+        if (capacity <= d->buffer.capacity()) {
+            return false;
+        }
+    }
+
+    MirroredBuffer next(capacity);
+    d->buffer.copyTo(next, d->readPos, used);
+    d->retired.push_back(std::move(d->buffer));
+    d->buffer = std::move(next);
+    d->quietDrains = 0;
+
+    resetPutArea();
+    return true;
+}
+
+/**
+ * @brief Halves the circular buffer once it has stayed a quarter full or less, down to its initial size.
+ * 
+ * Called when data is published, so a buffer that grew during a burst is given back once the
+ * reader has drained it `kShrinkDrains` times in a row without more than a quarter of it in use.
+ * Writes that keep coming close to that size do not reallocate the buffer back and forth.
+ * Must be called with the mutex held and with nothing pending in the put area.
+ */
+void SynchronousStreamBuf::shrinkBuffer()
+{
+    std::size_t capacity = d->buffer.capacity();
+    std::size_t used = static_cast<std::size_t>(d->publishedPos - d->readPos);
+    d->peakUsed = std::max(d->peakUsed, used);
+    if (d->quietDrains < kShrinkDrains || capacity / 2 < d->initialCapacity || used > capacity / 4) {
+        return;
+    }
+
+    MirroredBuffer next(capacity / 2);
+    d->buffer.copyTo(next, d->readPos, used);
+    d->retired.push_back(std::move(d->buffer));
+    d->buffer = std::move(next);
+    d->quietDrains = 0;
+}
+
+/**
+ * @brief Makes room for a write once the put area is exhausted, applying the overflow policy at the size limit.
+ * 
+ * The buffer grows while it is below its limit. At the limit, Block wakes the reader and waits
+ * (for at most the block timeout) until it has released enough data, DropOldest discards the
+ * oldest lines the reader has not been handed yet, and DropNewest gives up right away.
+ * Must be called with the mutex held and with nothing pending in the put area.
+ * 
+ * @param lock The held lock on the mutex, released while blocking.
+ * @param wanted Number of bytes the writer would like to write, used to size the growth.
+ * @param needed Number of bytes that must be free to go on.
+ * @return true if at least `needed` bytes are free and the put area covers them, false if the
+ *         data has to be dropped or the stream buffer was terminated.
+ */
+bool SynchronousStreamBuf::makeRoom(std::unique_lock<std::mutex>& lock, std::size_t wanted, std::size_t needed)
+{
+    auto hasRoom = [this, needed] {
+        return d->buffer.capacity() - static_cast<std::size_t>(d->publishedPos - d->readPos) >= needed;
+    };
+
+    while (!d->terminated && !hasRoom()) {
+        if (growBuffer(wanted)) {
+            continue;
         }
 
-        std::memmove(d->buffer.data(), gptr(), gsize);
-        std::memcpy(d->buffer.data() + gsize, pbase(), psize);
+        if (d->overflow == OverflowPolicy::DropNewest) {
+            return false;
+        }
+        if (d->overflow == OverflowPolicy::DropOldest) {
+            if (!dropOldest(needed)) {
+                return false;
+            }
+            continue;
+        }
 
-        setg(d->buffer.data(), d->buffer.data(), d->buffer.data() + gsize + psize);
-        setp(d->buffer.data() + gsize + psize, d->buffer.data() + d->buffer.size());
+        d->wakeReader();
+        ++d->writersWaiting;
+        bool ready = true;
+        if (d->blockTimeout.count() > 0) {
+            ready = d->space.wait_for(lock, d->blockTimeout, [this, &hasRoom] { return d->terminated || hasRoom(); });
+        } else {
+            d->space.wait(lock, [this, &hasRoom] { return d->terminated || hasRoom(); });
+        }
+        --d->writersWaiting;
+        resetPutArea();
+        if (!ready) {
+            return false;
+        }
+    }
+    if (d->terminated) {
+        return false;
+    }
+    // The reader may have drained an exhausted put area without rebuilding it
+    resetPutArea();
+    return true;
+}
 
-        d->cv.notify_all(); // Notify waiting threads that new data is available
+/**
+ * @brief Discards the oldest complete lines the reader has not been handed yet.
+ * 
+ * The data the reader holds is left alone, and so is a line it has only partly been handed,
+ * so every line that is not dropped arrives whole. Frees at least `needed` bytes or a quarter
+ * of the buffer if it can, fewer if not enough complete lines are waiting.
+ * Must be called with the mutex held and with nothing pending in the put area.
+ * 
+ * @param needed Number of bytes to free.
+ * @return false if nothing could be dropped.
+ */
+bool SynchronousStreamBuf::dropOldest(std::size_t needed)
+{
+    std::uint64_t start = d->readEnd;
+    if (start > d->readPos && *d->buffer.at(start - 1) != '\n') {
+        start = d->findNewline(start, d->publishedPos) + 1;
+        if (start > d->publishedPos) {
+            return false;
+        }
     }
-    return 0;
+
+    const std::size_t target = std::max(needed, d->buffer.capacity() / 4);
+    std::uint64_t end = start;
+    std::uint64_t lines = 0;
+    while (end - start < target) {
+        std::uint64_t newline = d->findNewline(end, d->publishedPos);
+        if (newline == d->publishedPos) {
+            break;
+        }
+        end = newline + 1;
+        ++lines;
+    }
+    if (end == start) {
+        return false;
+    }
+
+    d->droppedBytes += end - start;
+    d->droppedLines += lines;
+    d->moveDown(start, end, static_cast<std::size_t>(d->publishedPos - end));
+    d->publishedPos -= end - start;
+    for (auto& stamp : d->stamps) {
+        // What is left of a publish keeps its stamp
+        stamp.end = stamp.end > end ? stamp.end - (end - start) : std::min(stamp.end, start);
+    }
+    resetPutArea();
+    return true;
+}
+
+/**
+ * @brief Adds data written by the calling thread to its staging buffer and commits its complete lines.
+ * 
+ * When nothing is staged the complete lines are committed straight from `s`, otherwise the staged
+ * partial line is completed first so that the line reaches the engine in one piece.
+ * 
+ * @param s Pointer to the characters to write.
+ * @param count Number of characters to write.
+ * @return The number of characters written, 0 if the stream buffer was terminated.
+ */
+std::streamsize SynchronousStreamBuf::stage(const char_type* s, std::streamsize count)
+{
+    SynchronousStreamBufPimpl::ThreadState& state = d->threadState();
+    const std::size_t size = static_cast<std::size_t>(count);
+    const std::size_t last = std::string_view(s, size).rfind('\n');
+
+    if(last == std::string_view::npos) {
+        state.pending.append(s, size);
+        return count;
+    }
+
+    bool committed;
+    if(state.pending.empty()) {
+        committed = commit(s, last + 1);
+    } else {
+        state.pending.append(s, last + 1);
+        committed = commit(state.pending.data(), state.pending.size());
+        state.pending.clear();
+    }
+    state.pending.append(s + last + 1, size - last - 1);
+    return committed ? count : 0;
+}
+
+/**
+ * @brief Copies complete lines of one writer into the engine as a single unit.
+ * 
+ * The LockFree engine gets a single record (unless the data is larger than half of the ring),
+ * the Mutex engine copies the data in at most two spans behind the published position.
+ * 
+ * @param data Pointer to the bytes to commit.
+ * @param size Number of bytes to commit.
+ * @return true if the data was committed, false if the stream buffer was terminated.
+ */
+bool SynchronousStreamBuf::commit(const char* data, std::size_t size)
+{
+    if(d->engine == BufferEngine::LockFree) {
+        return d->ring->write(data, size) == size;
+    }
+
+    std::unique_lock<std::mutex> lock(d->mtx);
+    if(d->terminated) {
+        return false;
+    }
+
+    for(std::size_t committed = 0; committed < size; ) {
+        std::size_t remaining = size - committed;
+        if(!makeRoom(lock, remaining, committed == 0 ? d->wholeSize(remaining) : 1)) {
+            if(d->terminated) {
+                return false;
+            }
+            d->drop(data + committed, remaining);
+            break;
+        }
+
+        std::size_t free = d->buffer.capacity() - static_cast<std::size_t>(d->publishedPos - d->readPos);
+        std::size_t chunk = std::min(free, remaining);
+        std::size_t first = d->buffer.contiguous(d->publishedPos, chunk);
+        std::memcpy(d->buffer.at(d->publishedPos), data + committed, first);
+        std::memcpy(d->buffer.at(d->publishedPos + first), data + committed + first, chunk - first);
+        d->publishedPos += chunk;
+        committed += chunk;
+    }
+
+    d->stamp(data[size - 1] == '\n' || std::memchr(data, '\n', size) != nullptr);
+    shrinkBuffer();
+    d->signal(data, size);
+    return true;
+}
+
+/**
+ * @brief Returns the dropped data counters and the current size of the buffer.
+ * 
+ * @return Counters of the engine in use, all zero in Inline dispatch mode.
+ */
+RedirectStats SynchronousStreamBuf::stats() const
+{
+    if(d->engine == BufferEngine::LockFree && d->ring) {
+        return d->ring->stats();
+    }
+
+    std::lock_guard<std::mutex> lock(d->mtx);
+    RedirectStats stats;
+    stats.droppedBytes = d->droppedBytes;
+    stats.droppedLines = d->droppedLines;
+    stats.bufferSize = d->buffer.capacity();
+    return stats;
 }
 
 LIB_CREDIRECT_NAMESPACE_END
\ No newline at end of file